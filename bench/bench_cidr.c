@@ -0,0 +1,203 @@
+/*
+ * ss - Socket Statistics for Apple platforms (macOS/iOS)
+ * CIDR list benchmark: prefix trie vs. a linear scan of the prefix list
+ *
+ * Loads n random IPv4/IPv6 prefixes (one in eight a deny entry) and
+ * classifies the remote addresses of a fixed socket population. The trie's
+ * cost per lookup is bounded by the address length and stays flat as the
+ * list grows; the scan's cost grows linearly with the list.
+ *
+ * Usage: bench_cidr [max_prefixes]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include "../src/ss.h"
+
+/* Sockets classified per list size */
+#define NUM_SOCKETS 1000000
+
+/* Prefix comparisons the linear scan gets per list size (LIST_SCAN_WORK / n sockets) */
+#define LIST_SCAN_WORK (1u << 27)
+
+/* A prefix as the scan sees it */
+typedef struct {
+    uint8_t family;
+    uint8_t len;
+    bool deny;
+    uint8_t addr[16];
+} prefix_t;
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t xorshift(uint64_t *state)
+{
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *state = x;
+}
+
+/*
+ * Random prefixes inside 172.16.0.0/12 and fdac::/16, the ranges the
+ * sockets' peers are drawn from, so a good share of lookups hit
+ */
+static prefix_t *make_prefixes(size_t n, uint64_t *rng)
+{
+    prefix_t *p = calloc(n, sizeof(prefix_t));
+    if (!p) {
+        perror("calloc");
+        exit(1);
+    }
+    for (size_t i = 0; i < n; i++) {
+        uint64_t r = xorshift(rng);
+        p[i].deny = (r & 7) == 0;
+        if (i % 4 != 3) {
+            uint32_t a = htonl(0xac100000u | (uint32_t)((r >> 8) & 0xfffff));
+            p[i].family = SS_FAMILY_INET;
+            p[i].len = (uint8_t)(16 + (r >> 32) % 17);
+            memcpy(p[i].addr, &a, 4);
+        } else {
+            p[i].family = SS_FAMILY_INET6;
+            p[i].len = (uint8_t)(24 + (r >> 32) % 41);
+            p[i].addr[0] = 0xfd;
+            p[i].addr[1] = 0xac;
+            uint64_t r2 = xorshift(rng);
+            memcpy(p[i].addr + 2, &r2, 8);
+        }
+    }
+    return p;
+}
+
+static ss_sock_info_t *make_sockets(size_t n, uint64_t *rng)
+{
+    ss_sock_info_t *socks = calloc(n, sizeof(ss_sock_info_t));
+    if (!socks) {
+        perror("calloc");
+        exit(1);
+    }
+    for (size_t i = 0; i < n; i++) {
+        uint64_t r = xorshift(rng);
+        ss_sock_info_t *s = &socks[i];
+        s->protocol = SS_PROTO_TCP;
+        if (i % 4 != 3) {
+            s->family = SS_FAMILY_INET;
+            s->remote_ip.v4.s_addr = htonl(0xac100000u | (uint32_t)(r & 0xfffff));
+        } else {
+            uint8_t *a = (uint8_t *)&s->remote_ip;
+            s->family = SS_FAMILY_INET6;
+            a[0] = 0xfd;
+            a[1] = 0xac;
+            memcpy(a + 2, &r, 8);
+            r = xorshift(rng);
+            memcpy(a + 10, &r, 6);
+        }
+    }
+    return socks;
+}
+
+static bool prefix_covers(const prefix_t *p, const uint8_t *addr)
+{
+    unsigned bytes = p->len / 8;
+    if (memcmp(p->addr, addr, bytes) != 0) {
+        return false;
+    }
+    if (p->len % 8) {
+        uint8_t mask = (uint8_t)(0xff << (8 - p->len % 8));
+        return ((p->addr[bytes] ^ addr[bytes]) & mask) == 0;
+    }
+    return true;
+}
+
+/* Longest-prefix match by scanning the whole list */
+static size_t bench_list_scan(const prefix_t *prefixes, size_t n,
+                              const ss_sock_info_t *socks, size_t num_socks)
+{
+    size_t matched = 0;
+    for (size_t i = 0; i < num_socks; i++) {
+        const ss_sock_info_t *s = &socks[i];
+        const uint8_t *addr = (const uint8_t *)&s->remote_ip;
+        int best = -1;
+        bool deny = false;
+        for (size_t j = 0; j < n; j++) {
+            const prefix_t *p = &prefixes[j];
+            if (p->family == s->family && p->len > best && prefix_covers(p, addr)) {
+                best = p->len;
+                deny = p->deny;
+            }
+        }
+        if (best >= 0 && !deny) {
+            matched++;
+        }
+    }
+    return matched;
+}
+
+static size_t bench_trie(const ss_cidr_trie_t *trie, const ss_sock_info_t *socks,
+                         size_t num_socks)
+{
+    size_t matched = 0;
+    for (size_t i = 0; i < num_socks; i++) {
+        if (cidr_trie_match(trie, &socks[i], &socks[i].remote_ip)) {
+            matched++;
+        }
+    }
+    return matched;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t max = (argc > 1) ? strtoul(argv[1], NULL, 10) : 262144;
+    uint64_t rng = 0x2545f4914f6cdd1dull;
+    ss_sock_info_t *socks = make_sockets(NUM_SOCKETS, &rng);
+
+    printf("%10s %10s %10s %10s %14s %14s\n",
+           "prefixes", "nodes", "build ms", "matched", "trie ns/sock", "scan ns/sock");
+
+    for (size_t n = 1024; n <= max; n *= 4) {
+        prefix_t *prefixes = make_prefixes(n, &rng);
+        ss_cidr_trie_t trie = {0};
+
+        double t0 = now_sec();
+        for (size_t i = 0; i < n; i++) {
+            if (!cidr_trie_add(&trie, prefixes[i].family, prefixes[i].addr,
+                               prefixes[i].len, prefixes[i].deny)) {
+                perror("cidr_trie_add");
+                return 1;
+            }
+        }
+        double build_sec = now_sec() - t0;
+
+        t0 = now_sec();
+        size_t matched = bench_trie(&trie, socks, NUM_SOCKETS);
+        double trie_sec = now_sec() - t0;
+
+        /* Duplicate prefixes: the scan keeps the first, the trie the last */
+        size_t scan_socks = LIST_SCAN_WORK / n;
+        t0 = now_sec();
+        size_t scan_matched = bench_list_scan(prefixes, n, socks, scan_socks);
+        double scan_sec = now_sec() - t0;
+        size_t check = bench_trie(&trie, socks, scan_socks);
+        if (trie.prefixes == n && check != scan_matched) {
+            fprintf(stderr, "mismatch: trie %zu, scan %zu\n", check, scan_matched);
+            return 1;
+        }
+
+        printf("%10zu %10u %10.2f %10zu %14.1f %14.1f\n",
+               n, trie.count, build_sec * 1e3, matched,
+               trie_sec * 1e9 / NUM_SOCKETS, scan_sec * 1e9 / scan_socks);
+        cidr_trie_free(&trie);
+        free(prefixes);
+    }
+    free(socks);
+    return 0;
+}
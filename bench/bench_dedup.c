@@ -0,0 +1,160 @@
+/*
+ * ss - Socket Statistics for Apple platforms (macOS/iOS)
+ * Dedup benchmark: hashed 5-tuple set vs. the old linear list scan
+ *
+ * Inserts n sockets (10% duplicates) and reports the cost per insert.
+ * With the hash set the per-insert cost stays flat as n grows (total cost
+ * linear in n); the list scan's per-insert cost grows with n (quadratic).
+ *
+ * Usage: bench_dedup [max_sockets]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include "../src/ss.h"
+
+/* The linear scan is only timed up to this size */
+#define LIST_SCAN_MAX 40000
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t xorshift(uint64_t *state)
+{
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *state = x;
+}
+
+/* Formatted endpoints, as the old list scan compared them */
+typedef struct {
+    char local[MAX_ADDR_LEN];
+    char remote[MAX_ADDR_LEN];
+} text_addr_t;
+
+/* n TCP/IPv4 sockets; every 10th one repeats an earlier tuple */
+static ss_sock_info_t *make_sockets(size_t n, text_addr_t **texts_out)
+{
+    ss_sock_info_t *socks = calloc(n, sizeof(ss_sock_info_t));
+    text_addr_t *texts = calloc(n, sizeof(text_addr_t));
+    uint64_t rng = 0x2545f4914f6cdd1dull;
+
+    if (!socks || !texts) {
+        perror("calloc");
+        exit(1);
+    }
+    for (size_t i = 0; i < n; i++) {
+        ss_sock_info_t *s = &socks[i];
+        if (i > 0 && i % 10 == 0) {
+            size_t dup = xorshift(&rng) % i;
+            memcpy(s, &socks[dup], sizeof(*s));
+            texts[i] = texts[dup];
+            continue;
+        }
+        uint64_t r = xorshift(&rng);
+        s->family = SS_FAMILY_INET;
+        s->protocol = SS_PROTO_TCP;
+        s->local_ip.v4.s_addr = htonl(0x0a000000u | (uint32_t)(i & 0xffffff));
+        s->remote_ip.v4.s_addr = htonl(0xac100000u | (uint32_t)(r & 0xfffff));
+        s->local_port = (uint16_t)(1024 + i % 60000);
+        s->remote_port = (uint16_t)(r >> 32);
+        format_addr_v4(&s->local_ip.v4, s->local_port, texts[i].local, MAX_ADDR_LEN);
+        format_addr_v4(&s->remote_ip.v4, s->remote_port, texts[i].remote, MAX_ADDR_LEN);
+    }
+    *texts_out = texts;
+    return socks;
+}
+
+/* The pre-hash-set dedup: walk the list, compare formatted addresses */
+static size_t bench_list_scan(const ss_sock_info_t *socks, const text_addr_t *texts,
+                              size_t n)
+{
+    size_t *kept = malloc(n * sizeof(*kept));
+    size_t unique = 0;
+
+    if (!kept) {
+        perror("malloc");
+        exit(1);
+    }
+    for (size_t i = 0; i < n; i++) {
+        const ss_sock_info_t *s = &socks[i];
+        bool found = false;
+        for (size_t j = unique; j-- > 0; ) {
+            const ss_sock_info_t *p = &socks[kept[j]];
+            if (p->protocol == s->protocol && p->family == s->family &&
+                p->local_port == s->local_port && p->remote_port == s->remote_port &&
+                strcmp(texts[kept[j]].local, texts[i].local) == 0 &&
+                strcmp(texts[kept[j]].remote, texts[i].remote) == 0) {
+                found = true;
+                break;
+            }
+        }
+        if (!found) {
+            kept[unique++] = i;
+        }
+    }
+    free(kept);
+    return unique;
+}
+
+static size_t bench_sockset(const ss_sock_info_t *socks, size_t n)
+{
+    ss_sockset_t set;
+    size_t unique = 0;
+
+    if (!sockset_init(&set, 0)) {
+        perror("sockset_init");
+        exit(1);
+    }
+    for (size_t i = 0; i < n; i++) {
+        if (sockset_insert(&set, NULL, &socks[i])) {
+            unique++;
+        }
+    }
+    sockset_free(&set);
+    return unique;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t max = (argc > 1) ? strtoul(argv[1], NULL, 10) : 1280000;
+
+    printf("%10s %12s %12s %14s %14s\n",
+           "sockets", "unique", "set ms", "set ns/insert", "list ns/insert");
+
+    for (size_t n = 10000; n <= max; n *= 2) {
+        text_addr_t *texts;
+        ss_sock_info_t *socks = make_sockets(n, &texts);
+
+        double t0 = now_sec();
+        size_t unique = bench_sockset(socks, n);
+        double set_sec = now_sec() - t0;
+
+        char list_col[32] = "-";
+        if (n <= LIST_SCAN_MAX) {
+            t0 = now_sec();
+            size_t list_unique = bench_list_scan(socks, texts, n);
+            double list_sec = now_sec() - t0;
+            if (list_unique != unique) {
+                fprintf(stderr, "mismatch: set %zu, list %zu\n", unique, list_unique);
+                return 1;
+            }
+            snprintf(list_col, sizeof(list_col), "%.1f", list_sec * 1e9 / n);
+        }
+
+        printf("%10zu %12zu %12.2f %14.1f %14s\n",
+               n, unique, set_sec * 1e3, set_sec * 1e9 / n, list_col);
+        free(socks);
+        free(texts);
+    }
+    return 0;
+}
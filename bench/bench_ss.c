@@ -0,0 +1,507 @@
+/*
+ * ss - Socket Statistics for Apple platforms (macOS/iOS)
+ * Pipeline benchmark over synthetic socket populations (make bench)
+ *
+ * Runs the phases of a listing in-process against the synthetic libproc
+ * provider, for populations of 1k, 10k, 100k and 1M sockets, each with a
+ * uniform spread of sockets over processes and a Zipf-skewed one (a few
+ * processes hold most sockets, as on a proxy or database host):
+ *
+ *   collect   PID/fd walk with process names (-tuxap), inline dedup
+ *   group     sock_table_finalize()
+ *   dedup     every record re-inserted into a fresh sockset
+ *   filter    a compiled state/port expression over every record
+ *   format    table output to /dev/null
+ *   summary   collect_summary() counting pass (-s)
+ *
+ * Each population runs in its own child process. Phases are repeated until
+ * a trial covers BENCH_MIN_WORK sockets and the fastest of BENCH_TRIALS
+ * trials is reported, as ns per socket. Peak RSS is per phase on Linux
+ * (the high-water mark is reset through /proc/self/clear_refs), and the
+ * process peak so far elsewhere.
+ *
+ * -b FILE compares against a stored baseline and exits 1 if a phase is
+ * slower than the baseline by more than the time tolerance (-t, default
+ * 1.5x) or its peak RSS grew by more than the memory tolerance (1.25x).
+ * A population with a slow phase is run up to BENCH_RETRIES more times
+ * and each phase keeps its fastest run, so one noisy run does not fail.
+ * -w FILE writes the results as a new baseline.
+ *
+ * Usage: bench_ss [-m max_sockets] [-t tolerance] [-b baseline] [-w baseline]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "../src/libproc_compat.h"
+#include "../src/ss.h"
+
+/* Sockets per process before skewing */
+#define SOCKS_PER_PROC 20
+
+/* Sockets a trial processes at least, and trials per phase */
+#define BENCH_MIN_WORK 200000
+#define BENCH_TRIALS 5
+
+/* Allowed peak RSS growth over the baseline */
+#define RSS_TOLERANCE 1.25
+
+/* Extra runs of a population before a slow phase counts as a regression */
+#define BENCH_RETRIES 2
+
+enum {
+    PH_COLLECT,
+    PH_GROUP,
+    PH_DEDUP,
+    PH_FILTER,
+    PH_FORMAT,
+    PH_SUMMARY,
+    PH_COUNT
+};
+
+static const char *const phase_names[PH_COUNT] = {
+    "collect", "group", "dedup", "filter", "format", "summary"
+};
+
+/* One phase of one population, as sent from the child */
+typedef struct {
+    char population[24];
+    int phase;
+    uint64_t sockets;       /* Records per run */
+    double ns_per_sock;
+    long rss_kib;
+} result_t;
+
+/* A baseline entry */
+typedef struct {
+    char population[24];
+    char phase[16];
+    double ns_per_sock;
+    long rss_kib;
+} baseline_t;
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Restart the peak RSS measurement (Linux only) */
+static void rss_reset(void)
+{
+#ifdef __linux__
+    int fd = open("/proc/self/clear_refs", O_WRONLY);
+    if (fd >= 0) {
+        if (write(fd, "5", 1) < 0) {
+            /* Not permitted: the process-wide peak is reported */
+        }
+        close(fd);
+    }
+#endif
+}
+
+static long rss_peak_kib(void)
+{
+#ifdef __linux__
+    FILE *fp = fopen("/proc/self/status", "r");
+    if (fp) {
+        char line[256];
+        long kib = -1;
+        while (fgets(line, sizeof(line), fp)) {
+            if (sscanf(line, "VmHWM: %ld", &kib) == 1) {
+                break;
+            }
+        }
+        fclose(fp);
+        if (kib >= 0) {
+            return kib;
+        }
+    }
+#endif
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+#ifdef __APPLE__
+    return ru.ru_maxrss / 1024;
+#else
+    return ru.ru_maxrss;
+#endif
+}
+
+/* Best time and highest peak RSS of a phase in this child */
+typedef struct {
+    double trial_ns;        /* Current trial */
+    double best_ns;         /* Fastest trial, per run */
+    long rss_kib;
+} phase_acc_t;
+
+static phase_acc_t acc[PH_COUNT];
+
+static double phase_begin(void)
+{
+    rss_reset();
+    return now_ns();
+}
+
+static void phase_end(int phase, double t0)
+{
+    acc[phase].trial_ns += now_ns() - t0;
+    long rss = rss_peak_kib();
+    if (rss > acc[phase].rss_kib) {
+        acc[phase].rss_kib = rss;
+    }
+}
+
+/* One listing, phase by phase; returns the number of records collected */
+static size_t run_listing(const ss_options_t *opts, const ss_options_t *filter_opts)
+{
+    ss_sock_table_t table = {0};
+    double t0;
+
+    t0 = phase_begin();
+    if (collect_libproc_sockets(&synthetic_libproc, opts, &table) < 0) {
+        exit(1);
+    }
+    phase_end(PH_COLLECT, t0);
+
+    t0 = phase_begin();
+    if (!sock_table_finalize(&table)) {
+        perror("malloc");
+        exit(1);
+    }
+    phase_end(PH_GROUP, t0);
+
+    size_t begin = table.group_start[0], end = table.group_start[SS_GROUP_COUNT];
+    ss_sockset_t set;
+    t0 = phase_begin();
+    if (!sockset_init(&set, 0)) {
+        perror("malloc");
+        exit(1);
+    }
+    size_t unique = 0;
+    for (size_t i = begin; i < end; i++) {
+        unique += sockset_insert(&set, &table, &table.recs[i]);
+    }
+    sockset_free(&set);
+    phase_end(PH_DEDUP, t0);
+
+    t0 = phase_begin();
+    size_t matched = 0;
+    for (size_t i = begin; i < end; i++) {
+        matched += should_include(&table.recs[i], filter_opts);
+    }
+    phase_end(PH_FILTER, t0);
+
+    t0 = phase_begin();
+    print_begin(opts);
+    for (size_t i = begin; i < end; i++) {
+        print_row(&table, &table.recs[i], opts);
+    }
+    print_end(opts);
+    phase_end(PH_FORMAT, t0);
+
+    /* Every record was unique after the collector's own dedup */
+    if (unique != end - begin || matched > unique) {
+        fprintf(stderr, "bench: %zu of %zu records unique, %zu matched\n",
+                unique, end - begin, matched);
+        exit(1);
+    }
+    sock_table_free(&table);
+    return end - begin;
+}
+
+static void run_summary(const ss_options_t *opts)
+{
+    ss_stats_t stats;
+    double t0 = phase_begin();
+    if (collect_summary(opts, &stats) < 0) {
+        exit(1);
+    }
+    phase_end(PH_SUMMARY, t0);
+}
+
+/* Child: run every phase of one population and write the results to fd */
+static void bench_population(const char *name, size_t sockets, bool skewed, int fd)
+{
+    char spec[128];
+    size_t procs = sockets / SOCKS_PER_PROC;
+    snprintf(spec, sizeof(spec), "procs=%zu,socks=%d,shared=5%s",
+             procs, SOCKS_PER_PROC, skewed ? ",skew=100" : "");
+    if (!synthetic_configure(spec)) {
+        exit(1);
+    }
+
+    /* Table output goes nowhere */
+    int devnull = open("/dev/null", O_WRONLY);
+    if (devnull < 0 || dup2(devnull, STDOUT_FILENO) < 0) {
+        perror("/dev/null");
+        exit(1);
+    }
+    close(devnull);
+
+    ss_options_t opts = {
+        .show_tcp = true, .show_udp = true, .show_unix = true,
+        .show_all = true, .numeric = true, .show_process = true,
+        .collector = "synthetic"
+    };
+    ss_options_t filter_opts = opts;
+    char *expr[] = { "state", "connected", "(", "dport", "=", ":443", "or",
+                     "dport", "=", ":5432", ")" };
+    if (!filter_compile((int)(sizeof(expr) / sizeof(expr[0])), expr, &filter_opts.filter)) {
+        exit(1);
+    }
+
+    int reps = (int)((BENCH_MIN_WORK + sockets - 1) / sockets);
+    size_t records = 0;
+    for (int p = 0; p < PH_COUNT; p++) {
+        acc[p].best_ns = -1;
+    }
+    for (int trial = 0; trial < BENCH_TRIALS; trial++) {
+        for (int p = 0; p < PH_COUNT; p++) {
+            acc[p].trial_ns = 0;
+        }
+        for (int r = 0; r < reps; r++) {
+            records = run_listing(&opts, &filter_opts);
+            run_summary(&opts);
+        }
+        for (int p = 0; p < PH_COUNT; p++) {
+            double per_run = acc[p].trial_ns / reps;
+            if (acc[p].best_ns < 0 || per_run < acc[p].best_ns) {
+                acc[p].best_ns = per_run;
+            }
+        }
+    }
+
+    for (int p = 0; p < PH_COUNT; p++) {
+        result_t res = { .phase = p, .rss_kib = acc[p].rss_kib };
+        snprintf(res.population, sizeof(res.population), "%s", name);
+        /* The summary pass counts the whole population, before dedup */
+        res.sockets = (p == PH_SUMMARY) ? sockets : records;
+        res.ns_per_sock = res.sockets ? acc[p].best_ns / (double)res.sockets : 0;
+        if (write(fd, &res, sizeof(res)) != (ssize_t)sizeof(res)) {
+            exit(1);
+        }
+    }
+    filter_free(&filter_opts.filter);
+}
+
+static int load_baseline(const char *path, baseline_t **out, size_t *count)
+{
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        perror(path);
+        return -1;
+    }
+    baseline_t *list = NULL;
+    size_t n = 0, cap = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), fp)) {
+        baseline_t b;
+        if (line[0] == '#' ||
+            sscanf(line, "%23s %15s %lf %ld", b.population, b.phase,
+                   &b.ns_per_sock, &b.rss_kib) != 4) {
+            continue;
+        }
+        if (n == cap) {
+            cap = cap ? cap * 2 : 32;
+            baseline_t *grown = realloc(list, cap * sizeof(*grown));
+            if (!grown) {
+                perror("realloc");
+                free(list);
+                fclose(fp);
+                return -1;
+            }
+            list = grown;
+        }
+        list[n++] = b;
+    }
+    fclose(fp);
+    *out = list;
+    *count = n;
+    return 0;
+}
+
+static const baseline_t *find_baseline(const baseline_t *list, size_t n, const result_t *r)
+{
+    for (size_t i = 0; i < n; i++) {
+        if (strcmp(list[i].population, r->population) == 0 &&
+            strcmp(list[i].phase, phase_names[r->phase]) == 0) {
+            return &list[i];
+        }
+    }
+    return NULL;
+}
+
+/* One population in a child process; its results, in phase order, in res */
+static int run_population(const char *name, size_t n, int skewed, result_t res[PH_COUNT])
+{
+    int fds[2];
+    if (pipe(fds) < 0) {
+        perror("pipe");
+        return -1;
+    }
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        bench_population(name, n, skewed, fds[1]);
+        _exit(0);
+    }
+    close(fds[1]);
+
+    result_t r;
+    int got = 0;
+    while (read(fds[0], &r, sizeof(r)) == (ssize_t)sizeof(r)) {
+        if (got < PH_COUNT) {
+            res[got] = r;
+        }
+        got++;
+    }
+    close(fds[0]);
+
+    int status;
+    waitpid(pid, &status, 0);
+    if (got != PH_COUNT || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+/* Whether any phase is past the time tolerance */
+static bool slow_phases(const result_t res[PH_COUNT], const baseline_t *list, size_t n,
+                        double tolerance)
+{
+    for (int p = 0; p < PH_COUNT; p++) {
+        const baseline_t *b = find_baseline(list, n, &res[p]);
+        if (b && res[p].ns_per_sock > b->ns_per_sock * tolerance) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-m max_sockets] [-t tolerance] [-b baseline] [-w baseline]\n",
+            prog);
+    exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+    size_t max = 1000000;
+    double tolerance = 1.5;
+    const char *baseline_path = NULL, *write_path = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "m:t:b:w:")) != -1) {
+        switch (opt) {
+            case 'm': max = strtoul(optarg, NULL, 10); break;
+            case 't': tolerance = strtod(optarg, NULL); break;
+            case 'b': baseline_path = optarg; break;
+            case 'w': write_path = optarg; break;
+            default: usage(argv[0]);
+        }
+    }
+    if (tolerance < 1.0) {
+        usage(argv[0]);
+    }
+
+    baseline_t *baseline = NULL;
+    size_t num_baseline = 0;
+    if (baseline_path && load_baseline(baseline_path, &baseline, &num_baseline) < 0) {
+        return 2;
+    }
+    FILE *wfp = NULL;
+    if (write_path) {
+        wfp = fopen(write_path, "w");
+        if (!wfp) {
+            perror(write_path);
+            return 2;
+        }
+        fprintf(wfp, "# make bench baseline: population phase ns/socket peak-RSS-KiB\n");
+    }
+
+    printf("%-14s %-8s %9s %10s %9s %13s%s\n", "population", "phase", "sockets",
+           "ns/sock", "Msock/s", "peak RSS KiB", baseline_path ? "  vs baseline" : "");
+
+    int regressions = 0;
+    for (size_t n = 1000; n <= max; n *= 10) {
+        for (int skewed = 0; skewed <= 1; skewed++) {
+            char name[24];
+            if (n >= 1000000) {
+                snprintf(name, sizeof(name), "%s-%zuM", skewed ? "skewed" : "uniform", n / 1000000);
+            } else {
+                snprintf(name, sizeof(name), "%s-%zuk", skewed ? "skewed" : "uniform", n / 1000);
+            }
+
+            result_t res[PH_COUNT];
+            if (run_population(name, n, skewed, res) < 0) {
+                fprintf(stderr, "bench: population %s failed\n", name);
+                return 2;
+            }
+            /* A slow phase must be slow again to count: retry, keep the faster */
+            for (int retry = 0; retry < BENCH_RETRIES &&
+                 slow_phases(res, baseline, num_baseline, tolerance); retry++) {
+                result_t again[PH_COUNT];
+                if (run_population(name, n, skewed, again) < 0) {
+                    fprintf(stderr, "bench: population %s failed\n", name);
+                    return 2;
+                }
+                for (int p = 0; p < PH_COUNT; p++) {
+                    if (again[p].ns_per_sock < res[p].ns_per_sock) {
+                        res[p].ns_per_sock = again[p].ns_per_sock;
+                    }
+                }
+            }
+
+            for (int p = 0; p < PH_COUNT; p++) {
+                const result_t *r = &res[p];
+                char verdict[48] = "";      /* With its two-space separator */
+                const baseline_t *b = find_baseline(baseline, num_baseline, r);
+                if (baseline_path && !b) {
+                    snprintf(verdict, sizeof(verdict), "  new");
+                } else if (b && r->ns_per_sock > b->ns_per_sock * tolerance) {
+                    snprintf(verdict, sizeof(verdict), "  SLOWER x%.2f", r->ns_per_sock / b->ns_per_sock);
+                    regressions++;
+                } else if (b && r->rss_kib > b->rss_kib * RSS_TOLERANCE) {
+                    snprintf(verdict, sizeof(verdict), "  RSS x%.2f", (double)r->rss_kib / b->rss_kib);
+                    regressions++;
+                } else if (b) {
+                    snprintf(verdict, sizeof(verdict), "  ok x%.2f", r->ns_per_sock / b->ns_per_sock);
+                }
+                printf("%-14s %-8s %9llu %10.1f %9.2f %13ld%s\n", r->population,
+                       phase_names[r->phase], (unsigned long long)r->sockets, r->ns_per_sock,
+                       r->ns_per_sock > 0 ? 1e3 / r->ns_per_sock : 0, r->rss_kib, verdict);
+                if (wfp) {
+                    fprintf(wfp, "%s %s %.1f %ld\n", r->population, phase_names[r->phase],
+                            r->ns_per_sock, r->rss_kib);
+                }
+            }
+            fflush(stdout);
+        }
+    }
+
+    if (wfp && fclose(wfp) != 0) {
+        perror(write_path);
+        return 2;
+    }
+    free(baseline);
+    if (regressions) {
+        printf("%d phase(s) regressed past the baseline (tolerance x%.2f time, x%.2f RSS)\n",
+               regressions, tolerance, RSS_TOLERANCE);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,381 @@
+/*
+ * ss - Socket Statistics for Apple platforms (macOS/iOS)
+ * Per-group totals for --group-by
+ *
+ * Sockets are folded into a hash table of groups as they are committed:
+ * the table keeps one reused record slot (as -s does), so memory grows
+ * with the number of groups, not sockets. Keys are small binary structs
+ * hashed like the dedup set's (sockset.c). A group keeps its socket
+ * count and the sum and maximum of each queue; groups are listed largest
+ * first, ties in key order, so a snapshot lists as the live host did.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include "ss.h"
+
+/* Initial slot count (power of two) */
+#define AGG_MIN_SLOTS 256
+
+/* Group key; fields that do not apply to the grouping stay zero */
+typedef struct {
+    pid_t pid;
+    uint8_t protocol;
+    uint8_t family;
+    uint8_t state;
+    uint8_t connected;
+    uint16_t port;
+    uint8_t pad[6];
+    uint8_t addr[16];
+} agg_key_t;
+
+struct ss_agg_entry {
+    uint64_t hash;              /* 0 = empty */
+    agg_key_t key;
+    uint32_t proc_name;         /* Name of the first socket's process */
+    uint64_t sockets;
+    uint64_t recv_q;
+    uint64_t send_q;
+    uint32_t recv_q_max;
+    uint32_t send_q_max;
+};
+
+static const char *const group_names[] = {
+    [SS_GROUP_BY_PROCESS] = "process",
+    [SS_GROUP_BY_REMOTE]  = "remote",
+    [SS_GROUP_BY_LPORT]   = "lport",
+    [SS_GROUP_BY_STATE]   = "state",
+};
+
+/* Parse a prefix length of at most max; returns the end or NULL */
+static const char *parse_prefix(const char *p, unsigned max, uint8_t *out)
+{
+    char *end;
+    unsigned long n = strtoul(p, &end, 10);
+    if (end == p || n > max) {
+        return NULL;
+    }
+    *out = (uint8_t)n;
+    return end;
+}
+
+/* "process", "remote[/V4[/V6]]", "lport" or "state" */
+bool agg_parse(const char *spec, ss_group_spec_t *out)
+{
+    memset(out, 0, sizeof(*out));
+    out->prefix4 = 32;
+    out->prefix6 = 128;
+
+    size_t len = strcspn(spec, "/");
+    for (int by = SS_GROUP_BY_PROCESS; by <= SS_GROUP_BY_STATE; by++) {
+        if (strlen(group_names[by]) == len && strncmp(spec, group_names[by], len) == 0) {
+            out->by = (uint8_t)by;
+        }
+    }
+    if (out->by == SS_GROUP_BY_NONE) {
+        return false;
+    }
+    if (spec[len] == '\0') {
+        return true;
+    }
+
+    /* Subnets: remote/24 groups IPv4 peers by /24, remote/24/64 also IPv6 by /64 */
+    if (out->by != SS_GROUP_BY_REMOTE) {
+        return false;
+    }
+    const char *p = parse_prefix(spec + len + 1, 32, &out->prefix4);
+    if (p && *p == '/') {
+        p = parse_prefix(p + 1, 128, &out->prefix6);
+    }
+    return p && *p == '\0';
+}
+
+bool agg_init(ss_agg_t *agg, const ss_group_spec_t *spec)
+{
+    agg->spec = *spec;
+    agg->slots = calloc(AGG_MIN_SLOTS, sizeof(ss_agg_entry_t));
+    agg->mask = agg->slots ? AGG_MIN_SLOTS - 1 : 0;
+    agg->count = 0;
+    agg->oom = false;
+    return agg->slots != NULL;
+}
+
+static uint64_t hash_key(const agg_key_t *key)
+{
+    uint64_t w[sizeof(agg_key_t) / sizeof(uint64_t)];
+    uint64_t h = 0x9e3779b97f4a7c15ull;
+
+    memcpy(w, key, sizeof(w));
+    for (size_t i = 0; i < sizeof(w) / sizeof(w[0]); i++) {
+        h = (h ^ w[i]) * 0xbf58476d1ce4e5b9ull;
+        h ^= h >> 29;
+    }
+    h ^= h >> 32;
+    return h ? h : 1;
+}
+
+/* Copy the first prefix bits of an address */
+static void copy_prefix(uint8_t *dst, const void *src, unsigned prefix)
+{
+    memcpy(dst, src, prefix / 8);
+    if (prefix % 8) {
+        dst[prefix / 8] = ((const uint8_t *)src)[prefix / 8] & (uint8_t)(0xff << (8 - prefix % 8));
+    }
+}
+
+static void key_from_sock(const ss_group_spec_t *spec, const ss_sock_info_t *sock,
+                          agg_key_t *key)
+{
+    memset(key, 0, sizeof(*key));
+    switch (spec->by) {
+        case SS_GROUP_BY_PROCESS:
+            key->pid = sock->pid;
+            break;
+        case SS_GROUP_BY_REMOTE:
+            key->family = sock->family;
+            if (sock->family == SS_FAMILY_INET) {
+                copy_prefix(key->addr, &sock->remote_ip.v4, spec->prefix4);
+            } else if (sock->family == SS_FAMILY_INET6) {
+                copy_prefix(key->addr, &sock->remote_ip.v6, spec->prefix6);
+            } else {
+                key->connected = sock->unix_connected;
+            }
+            break;
+        case SS_GROUP_BY_LPORT:
+            key->protocol = sock->protocol;
+            key->port = sock->local_port;
+            break;
+        default:
+            key->protocol = sock->protocol;
+            key->state = sock->state;
+            break;
+    }
+}
+
+static bool agg_grow(ss_agg_t *agg)
+{
+    size_t new_size = (agg->mask + 1) * 2;
+    ss_agg_entry_t *slots = calloc(new_size, sizeof(ss_agg_entry_t));
+    if (!slots) {
+        return false;
+    }
+
+    for (size_t i = 0; i <= agg->mask; i++) {
+        if (agg->slots[i].hash == 0) continue;
+        size_t j = agg->slots[i].hash & (new_size - 1);
+        while (slots[j].hash != 0) {
+            j = (j + 1) & (new_size - 1);
+        }
+        slots[j] = agg->slots[i];
+    }
+
+    free(agg->slots);
+    agg->slots = slots;
+    agg->mask = new_size - 1;
+    return true;
+}
+
+/* Add a socket to its group */
+void agg_add(ss_agg_t *agg, const ss_sock_info_t *sock)
+{
+    agg_key_t key;
+    key_from_sock(&agg->spec, sock, &key);
+    uint64_t h = hash_key(&key);
+
+    size_t i = h & agg->mask;
+    while (agg->slots[i].hash != 0 &&
+           (agg->slots[i].hash != h || memcmp(&agg->slots[i].key, &key, sizeof(key)) != 0)) {
+        i = (i + 1) & agg->mask;
+    }
+
+    ss_agg_entry_t *e = &agg->slots[i];
+    if (e->hash == 0) {
+        /* Keep the load factor at or below 1/2 */
+        if ((agg->count + 1) * 2 > agg->mask + 1) {
+            if (!agg_grow(agg)) {
+                agg->oom = true;
+                return;
+            }
+            agg_add(agg, sock);
+            return;
+        }
+        e->hash = h;
+        e->key = key;
+        agg->count++;
+        e->proc_name = sock->proc_name;
+    }
+
+    e->sockets++;
+    e->recv_q += sock->recv_queue;
+    e->send_q += sock->send_queue;
+    if (sock->recv_queue > e->recv_q_max) {
+        e->recv_q_max = sock->recv_queue;
+    }
+    if (sock->send_queue > e->send_q_max) {
+        e->send_q_max = sock->send_queue;
+    }
+}
+
+static int cmp_u64(uint64_t a, uint64_t b)
+{
+    return (a > b) - (a < b);
+}
+
+/* Most sockets first, then by key */
+static int cmp_groups(const void *a, const void *b)
+{
+    const ss_agg_entry_t *x = *(const ss_agg_entry_t *const *)a;
+    const ss_agg_entry_t *y = *(const ss_agg_entry_t *const *)b;
+    const agg_key_t *p = &x->key;
+    const agg_key_t *q = &y->key;
+
+    int c = cmp_u64(y->sockets, x->sockets);
+    if (c == 0) c = cmp_u64(p->protocol, q->protocol);
+    if (c == 0) c = cmp_u64(p->family, q->family);
+    if (c == 0) c = cmp_u64(p->state, q->state);
+    if (c == 0) c = cmp_u64(p->connected, q->connected);
+    if (c == 0) c = cmp_u64(p->port, q->port);
+    if (c == 0) c = cmp_u64((uint32_t)p->pid, (uint32_t)q->pid);
+    return c ? c : memcmp(p->addr, q->addr, sizeof(p->addr));
+}
+
+/* Key column names of a grouping */
+static void describe_keys(const ss_group_spec_t *spec, ss_group_row_t *row)
+{
+    memset(row, 0, sizeof(*row));
+    switch (spec->by) {
+        case SS_GROUP_BY_PROCESS:
+            row->key[0] = "process";
+            row->title[0] = "Process";
+            row->key[1] = "pid";
+            row->title[1] = "PID";
+            row->width[0] = 20;
+            row->width[1] = 8;
+            row->numeric[1] = true;
+            break;
+        case SS_GROUP_BY_REMOTE:
+            row->key[0] = "peer";
+            row->title[0] = "Peer Address";
+            row->width[0] = 40;
+            break;
+        case SS_GROUP_BY_LPORT:
+            row->key[0] = "netid";
+            row->title[0] = "Netid";
+            row->key[1] = "local_port";
+            row->title[1] = "Port";
+            row->width[0] = 6;
+            row->width[1] = 10;
+            row->numeric[1] = true;
+            break;
+        default:
+            row->key[0] = "netid";
+            row->title[0] = "Netid";
+            row->key[1] = "state";
+            row->title[1] = "State";
+            row->width[0] = 6;
+            row->width[1] = 12;
+            break;
+    }
+}
+
+/* Fill in a group's key values (text in buf) and totals */
+static void describe_group(const ss_group_spec_t *spec, const ss_sock_table_t *table,
+                           const ss_agg_entry_t *e, ss_group_row_t *row,
+                           char *buf, size_t buflen)
+{
+    const agg_key_t *key = &e->key;
+    ss_sock_info_t proto = { .protocol = key->protocol };
+
+    switch (spec->by) {
+        case SS_GROUP_BY_PROCESS:
+            row->val[0] = e->proc_name ? sock_table_str(table, e->proc_name) : "?";
+            if (key->pid > 0) {
+                snprintf(buf, buflen, "%d", (int)key->pid);
+                row->val[1] = buf;
+            }
+            break;
+        case SS_GROUP_BY_REMOTE:
+            if (key->family == SS_FAMILY_INET || key->family == SS_FAMILY_INET6) {
+                bool v4 = (key->family == SS_FAMILY_INET);
+                unsigned prefix = v4 ? spec->prefix4 : spec->prefix6;
+                inet_ntop(v4 ? AF_INET : AF_INET6, key->addr, buf, (socklen_t)buflen);
+                if (prefix < (v4 ? 32u : 128u)) {
+                    size_t len = strlen(buf);
+                    snprintf(buf + len, buflen - len, "/%u", prefix);
+                }
+                row->val[0] = buf;
+            } else {
+                row->val[0] = key->connected ? "[connected]" : "*";
+            }
+            break;
+        case SS_GROUP_BY_LPORT:
+            row->val[0] = get_proto_name(&proto);
+            if (key->protocol == SS_PROTO_TCP || key->protocol == SS_PROTO_UDP) {
+                snprintf(buf, buflen, "%u", key->port);
+                row->val[1] = buf;
+            }
+            break;
+        default:
+            row->val[0] = get_proto_name(&proto);
+            row->val[1] = tcp_state_to_string((ss_tcp_state_t)key->state);
+            break;
+    }
+
+    row->sockets = e->sockets;
+    row->recv_q = e->recv_q;
+    row->send_q = e->send_q;
+    row->recv_q_max = e->recv_q_max;
+    row->send_q_max = e->send_q_max;
+}
+
+/*
+ * Print the groups, largest first (at most --top of them). Process names
+ * are looked up in table, which must be the one the sockets came from.
+ */
+int agg_print(const ss_agg_t *agg, const ss_sock_table_t *table, const ss_options_t *opts)
+{
+    if (agg->oom) {
+        errno = ENOMEM;
+        perror("--group-by");
+        return -1;
+    }
+
+    const ss_agg_entry_t **groups = malloc((agg->count ? agg->count : 1) * sizeof(*groups));
+    if (!groups) {
+        perror("malloc");
+        return -1;
+    }
+    size_t n = 0;
+    for (size_t i = 0; i <= agg->mask && n < agg->count; i++) {
+        if (agg->slots[i].hash != 0) {
+            groups[n++] = &agg->slots[i];
+        }
+    }
+    qsort(groups, n, sizeof(*groups), cmp_groups);
+    if (opts->top && n > opts->top) {
+        n = opts->top;
+    }
+
+    ss_group_row_t row;
+    describe_keys(&agg->spec, &row);
+    print_group_begin(&row, opts);
+    for (size_t i = 0; i < n; i++) {
+        char buf[MAX_ADDR_LEN];
+        describe_keys(&agg->spec, &row);
+        describe_group(&agg->spec, table, groups[i], &row, buf, sizeof(buf));
+        print_group(&row, opts);
+    }
+    print_end(opts);
+    free(groups);
+    return 0;
+}
+
+void agg_free(ss_agg_t *agg)
+{
+    free(agg->slots);
+    memset(agg, 0, sizeof(*agg));
+}
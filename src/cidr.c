@@ -0,0 +1,236 @@
+/*
+ * ss - Socket Statistics for Apple platforms (macOS/iOS)
+ * CIDR prefix tries for --src-file / --dst-file
+ *
+ * Each list file is loaded into a binary trie with one root for IPv4 and
+ * one for IPv6; every node tests one address bit. A lookup walks the bits
+ * of the socket address and remembers the last prefix it passed, so it is
+ * a longest-prefix match in at most 32 or 128 steps, however many prefixes
+ * the list holds. Nodes live in one array and link by 32-bit index.
+ *
+ * List format: one ADDR or ADDR/LEN per line; blank lines and '#' comments
+ * are ignored. A leading '!' makes the prefix a deny entry, so
+ *
+ *     10.0.0.0/8
+ *     !10.66.0.0/16
+ *
+ * matches 10.0.0.0/8 except 10.66.0.0/16.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <arpa/inet.h>
+#include "ss.h"
+
+/* Node verdicts */
+enum {
+    CIDR_NONE,              /* No prefix ends here */
+    CIDR_ALLOW,
+    CIDR_DENY
+};
+
+/* Fixed root nodes */
+#define CIDR_ROOT_V4 0
+#define CIDR_ROOT_V6 1
+
+struct ss_cidr_node {
+    uint32_t child[2];      /* Node index per next bit; 0 = none (roots are never children) */
+    uint8_t verdict;
+};
+
+/* Room for n more nodes */
+static bool reserve(ss_cidr_trie_t *trie, uint32_t n)
+{
+    if (trie->count + n <= trie->cap) {
+        return true;
+    }
+    uint32_t new_cap = trie->cap ? trie->cap : 256;
+    while (new_cap < trie->count + n) {
+        new_cap *= 2;
+    }
+    ss_cidr_node_t *nodes = realloc(trie->nodes, (size_t)new_cap * sizeof(*nodes));
+    if (!nodes) {
+        return false;
+    }
+    trie->nodes = nodes;
+    trie->cap = new_cap;
+    return true;
+}
+
+static uint32_t new_node(ss_cidr_trie_t *trie)
+{
+    memset(&trie->nodes[trie->count], 0, sizeof(ss_cidr_node_t));
+    return trie->count++;
+}
+
+static unsigned addr_bit(const uint8_t *addr, unsigned i)
+{
+    return (addr[i >> 3] >> (7 - (i & 7))) & 1;
+}
+
+/* Add one prefix; a later entry for the same prefix replaces the verdict */
+bool cidr_trie_add(ss_cidr_trie_t *trie, ss_family_t family, const uint8_t *addr,
+                   unsigned prefix, bool deny)
+{
+    /* At most one node per prefix bit, plus the roots */
+    if (!reserve(trie, prefix + 2)) {
+        return false;
+    }
+    if (trie->count == 0) {
+        new_node(trie);     /* CIDR_ROOT_V4 */
+        new_node(trie);     /* CIDR_ROOT_V6 */
+    }
+
+    uint32_t node = (family == SS_FAMILY_INET) ? CIDR_ROOT_V4 : CIDR_ROOT_V6;
+    for (unsigned i = 0; i < prefix; i++) {
+        unsigned bit = addr_bit(addr, i);
+        uint32_t next = trie->nodes[node].child[bit];
+        if (next == 0) {
+            next = new_node(trie);
+            trie->nodes[node].child[bit] = next;
+        }
+        node = next;
+    }
+    if (trie->nodes[node].verdict == CIDR_NONE) {
+        trie->prefixes++;
+    }
+    trie->nodes[node].verdict = deny ? CIDR_DENY : CIDR_ALLOW;
+    return true;
+}
+
+/* Parse "[!]ADDR[/LEN]" into a trie entry */
+static bool parse_entry(const char *s, ss_cidr_trie_t *trie)
+{
+    char host[INET6_ADDRSTRLEN];
+    uint8_t addr[16];
+    bool deny = false;
+    long prefix = -1;
+
+    if (*s == '!') {
+        deny = true;
+        s++;
+        while (isspace((unsigned char)*s)) s++;
+    }
+    size_t len = strcspn(s, "/");
+    if (len >= sizeof(host)) {
+        return false;
+    }
+    memcpy(host, s, len);
+    host[len] = '\0';
+    if (s[len] == '/') {
+        char *end;
+        prefix = strtol(s + len + 1, &end, 10);
+        if (end == s + len + 1 || *end != '\0' || prefix < 0) {
+            return false;
+        }
+    }
+
+    if (inet_pton(AF_INET, host, addr) == 1) {
+        if (prefix > 32) return false;
+        return cidr_trie_add(trie, SS_FAMILY_INET, addr,
+                             (unsigned)(prefix < 0 ? 32 : prefix), deny);
+    }
+    if (inet_pton(AF_INET6, host, addr) == 1) {
+        if (prefix > 128) return false;
+        return cidr_trie_add(trie, SS_FAMILY_INET6, addr,
+                             (unsigned)(prefix < 0 ? 128 : prefix), deny);
+    }
+    return false;
+}
+
+/* Add the prefixes listed in a file. Returns -1 (after a message) on error. */
+int cidr_trie_load(ss_cidr_trie_t *trie, const char *path)
+{
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        perror(path);
+        return -1;
+    }
+
+    char *line = NULL;
+    size_t line_cap = 0;
+    unsigned long lineno = 0;
+    int ret = 0;
+    while (getline(&line, &line_cap, fp) != -1) {
+        lineno++;
+        char *hash = strchr(line, '#');
+        if (hash) {
+            *hash = '\0';
+        }
+        char *s = line;
+        while (isspace((unsigned char)*s)) s++;
+        char *end = s + strlen(s);
+        while (end > s && isspace((unsigned char)end[-1])) end--;
+        *end = '\0';
+        if (*s == '\0') {
+            continue;
+        }
+
+        if (!parse_entry(s, trie)) {
+            fprintf(stderr, "%s:%lu: invalid prefix '%s'\n", path, lineno, s);
+            ret = -1;
+            break;
+        }
+    }
+    if (ret == 0 && ferror(fp)) {
+        perror(path);
+        ret = -1;
+    }
+    free(line);
+    fclose(fp);
+    return ret;
+}
+
+/*
+ * Whether an address of sock is covered by an allow entry, i.e. its
+ * longest matching prefix is not a deny entry. IPv4-mapped IPv6 addresses
+ * are looked up as IPv4. UNIX sockets never match.
+ */
+bool cidr_trie_match(const ss_cidr_trie_t *trie, const ss_sock_info_t *sock,
+                     const ss_addr_t *addr)
+{
+    static const uint8_t v4_mapped[12] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff };
+    const uint8_t *a = (const uint8_t *)addr;
+    uint32_t node;
+    unsigned bits;
+
+    if (trie->count == 0) {
+        return false;
+    }
+    if (sock->family == SS_FAMILY_INET) {
+        node = CIDR_ROOT_V4;
+        bits = 32;
+    } else if (sock->family == SS_FAMILY_INET6) {
+        if (memcmp(a, v4_mapped, sizeof(v4_mapped)) == 0) {
+            node = CIDR_ROOT_V4;
+            a += sizeof(v4_mapped);
+            bits = 32;
+        } else {
+            node = CIDR_ROOT_V6;
+            bits = 128;
+        }
+    } else {
+        return false;
+    }
+
+    const ss_cidr_node_t *nodes = trie->nodes;
+    uint8_t verdict = nodes[node].verdict;
+    for (unsigned i = 0; i < bits; i++) {
+        node = nodes[node].child[addr_bit(a, i)];
+        if (node == 0) {
+            break;
+        }
+        if (nodes[node].verdict != CIDR_NONE) {
+            verdict = nodes[node].verdict;
+        }
+    }
+    return verdict == CIDR_ALLOW;
+}
+
+void cidr_trie_free(ss_cidr_trie_t *trie)
+{
+    free(trie->nodes);
+    memset(trie, 0, sizeof(*trie));
+}
@@ -0,0 +1,421 @@
+/*
+ * ss - Socket Statistics for Apple platforms (macOS/iOS)
+ * Multi-threaded libproc collection with work stealing (-j)
+ *
+ * The PID array is sharded across a worker pool. Each worker owns a task
+ * deque: it pops from the bottom, idle workers steal from the top. A process
+ * whose fd table is larger than FD_CHUNK is split into fd-range chunks that
+ * are pushed back as tasks, so a single huge process is spread over all
+ * workers. Every worker fills its own socket table; the tables are merged
+ * at the end in serial discovery order and deduplicated there.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "libproc_compat.h"
+#include "ss.h"
+
+/* fd table entries per stealable chunk */
+#define FD_CHUNK 512
+
+/* fd table shared by the chunks of one process */
+typedef struct {
+    struct proc_fdinfo *fdinfo;
+    atomic_int refs;
+} shared_fds_t;
+
+/* A whole process (fds == NULL) or one fd-range chunk of it */
+typedef struct {
+    pid_t pid;
+    uint32_t pid_idx;
+    shared_fds_t *fds;
+    int lo, hi;
+} walk_task_t;
+
+/* Per-worker task deque: [head, tail) */
+typedef struct {
+    pthread_mutex_t lock;
+    walk_task_t *tasks;
+    size_t head, tail, cap;
+} task_deque_t;
+
+typedef struct worker worker_t;
+
+/* State shared by the pool */
+typedef struct {
+    const ss_libproc_ops_t *ops;
+    const ss_options_t *opts;
+    worker_t *workers;
+    int num_workers;
+    atomic_size_t pending;      /* Tasks queued or running */
+    pthread_mutex_t idle_lock;
+    pthread_cond_t idle_cond;   /* Signalled on new tasks and on pending == 0 */
+    size_t posted;              /* Chunk batches pushed, under idle_lock */
+} pool_t;
+
+struct worker {
+    pthread_t thread;
+    int id;
+    pool_t *pool;
+    task_deque_t deque;
+    ss_sock_table_t table;      /* This worker's results */
+};
+
+static bool deque_push(task_deque_t *dq, const walk_task_t *task)
+{
+    bool ok = true;
+
+    pthread_mutex_lock(&dq->lock);
+    if (dq->tail == dq->cap) {
+        /* Compact before growing */
+        if (dq->head > 0) {
+            memmove(dq->tasks, dq->tasks + dq->head,
+                    (dq->tail - dq->head) * sizeof(walk_task_t));
+            dq->tail -= dq->head;
+            dq->head = 0;
+        }
+        if (dq->tail == dq->cap) {
+            size_t new_cap = dq->cap ? dq->cap * 2 : 64;
+            walk_task_t *tasks = realloc(dq->tasks, new_cap * sizeof(walk_task_t));
+            if (tasks) {
+                dq->tasks = tasks;
+                dq->cap = new_cap;
+            } else {
+                ok = false;
+            }
+        }
+    }
+    if (ok) {
+        dq->tasks[dq->tail++] = *task;
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return ok;
+}
+
+/* Owner end: newest task first */
+static bool deque_pop(task_deque_t *dq, walk_task_t *task)
+{
+    bool ok = false;
+
+    pthread_mutex_lock(&dq->lock);
+    if (dq->tail > dq->head) {
+        *task = dq->tasks[--dq->tail];
+        ok = true;
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return ok;
+}
+
+/* Thief end: oldest task first */
+static bool deque_steal(task_deque_t *dq, walk_task_t *task)
+{
+    bool ok = false;
+
+    pthread_mutex_lock(&dq->lock);
+    if (dq->tail > dq->head) {
+        *task = dq->tasks[dq->head++];
+        ok = true;
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return ok;
+}
+
+/* Wake idle workers: new tasks were pushed or the pool has drained */
+static void wake_idle(pool_t *pool)
+{
+    pthread_mutex_lock(&pool->idle_lock);
+    pool->posted++;
+    pthread_cond_broadcast(&pool->idle_cond);
+    pthread_mutex_unlock(&pool->idle_lock);
+}
+
+static void release_fds(shared_fds_t *fds)
+{
+    if (atomic_fetch_sub(&fds->refs, 1) == 1) {
+        free(fds->fdinfo);
+        free(fds);
+    }
+}
+
+/* Scan a whole process, splitting a large fd table into chunk tasks */
+static void run_process_task(worker_t *w, const walk_task_t *task)
+{
+    pool_t *pool = w->pool;
+    struct proc_fdinfo *fdinfo;
+    int num_fds = list_process_fds(pool->ops, task->pid, &fdinfo);
+
+    if (num_fds <= FD_CHUNK) {
+        if (num_fds > 0) {
+            collect_fd_range(pool->ops, task->pid, task->pid_idx, fdinfo,
+                             0, num_fds, &w->table, pool->opts, NULL);
+        }
+        free(fdinfo);
+        return;
+    }
+
+    shared_fds_t *fds = malloc(sizeof(shared_fds_t));
+    if (!fds) {
+        free(fdinfo);
+        return;
+    }
+    fds->fdinfo = fdinfo;
+    atomic_init(&fds->refs, 1);
+
+    /* Queue every chunk but the first, which this worker scans itself */
+    for (int lo = FD_CHUNK; lo < num_fds; lo += FD_CHUNK) {
+        walk_task_t chunk = {
+            .pid = task->pid,
+            .pid_idx = task->pid_idx,
+            .fds = fds,
+            .lo = lo,
+            .hi = (lo + FD_CHUNK < num_fds) ? lo + FD_CHUNK : num_fds
+        };
+        atomic_fetch_add(&fds->refs, 1);
+        atomic_fetch_add(&pool->pending, 1);
+        if (!deque_push(&w->deque, &chunk)) {
+            /* Out of memory: scan the chunk inline instead */
+            collect_fd_range(pool->ops, chunk.pid, chunk.pid_idx, fdinfo,
+                             chunk.lo, chunk.hi, &w->table, pool->opts, NULL);
+            atomic_fetch_sub(&pool->pending, 1);
+            atomic_fetch_sub(&fds->refs, 1);
+        }
+    }
+    wake_idle(pool);
+
+    collect_fd_range(pool->ops, task->pid, task->pid_idx, fdinfo,
+                     0, FD_CHUNK, &w->table, pool->opts, NULL);
+    release_fds(fds);
+}
+
+static void run_task(worker_t *w, const walk_task_t *task)
+{
+    if (task->fds == NULL) {
+        run_process_task(w, task);
+    } else {
+        collect_fd_range(w->pool->ops, task->pid, task->pid_idx,
+                         task->fds->fdinfo, task->lo, task->hi,
+                         &w->table, w->pool->opts, NULL);
+        release_fds(task->fds);
+    }
+    if (atomic_fetch_sub(&w->pool->pending, 1) == 1) {
+        wake_idle(w->pool);
+    }
+}
+
+static bool steal_task(worker_t *w, walk_task_t *task)
+{
+    pool_t *pool = w->pool;
+
+    for (int i = 1; i < pool->num_workers; i++) {
+        worker_t *victim = &pool->workers[(w->id + i) % pool->num_workers];
+        if (deque_steal(&victim->deque, task)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void *worker_main(void *arg)
+{
+    worker_t *w = arg;
+    pool_t *pool = w->pool;
+    walk_task_t task;
+
+    for (;;) {
+        /* Sample before looking so a push after the scan is not missed */
+        pthread_mutex_lock(&pool->idle_lock);
+        size_t seen = pool->posted;
+        pthread_mutex_unlock(&pool->idle_lock);
+
+        if (deque_pop(&w->deque, &task) || steal_task(w, &task)) {
+            run_task(w, &task);
+            continue;
+        }
+
+        /* Others are still splitting large processes: sleep until they
+         * push chunks or the last task finishes */
+        pthread_mutex_lock(&pool->idle_lock);
+        while (atomic_load(&pool->pending) > 0 && pool->posted == seen) {
+            pthread_cond_wait(&pool->idle_cond, &pool->idle_lock);
+        }
+        bool done = atomic_load(&pool->pending) == 0;
+        pthread_mutex_unlock(&pool->idle_lock);
+        if (done) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+/* A worker result and the table whose string pool it references */
+typedef struct {
+    const ss_sock_info_t *sock;
+    const ss_sock_table_t *src;
+} merge_ref_t;
+
+static int cmp_seq(const void *a, const void *b)
+{
+    const ss_sock_info_t *x = ((const merge_ref_t *)a)->sock;
+    const ss_sock_info_t *y = ((const merge_ref_t *)b)->sock;
+    return (x->seq > y->seq) - (x->seq < y->seq);
+}
+
+/* Re-intern a string from a worker's pool into the output pool */
+static uint32_t copy_str(ss_sock_table_t *out, const ss_sock_table_t *src, uint32_t off)
+{
+    const char *s = sock_table_str(src, off);
+    return sock_table_intern(out, s, strlen(s));
+}
+
+/*
+ * Append worker results to the output table in the order a serial walk
+ * would have produced them: discovery order, first occurrence of a
+ * duplicate kept.
+ */
+static int merge_results(pool_t *pool, ss_sock_table_t *out)
+{
+    size_t total = 0;
+
+    for (int i = 0; i < pool->num_workers; i++) {
+        total += pool->workers[i].table.count;
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    merge_ref_t *order = malloc(total * sizeof(merge_ref_t));
+    if (!order) {
+        perror("malloc");
+        return -1;
+    }
+    size_t n = 0;
+    for (int i = 0; i < pool->num_workers; i++) {
+        ss_sock_table_t *t = &pool->workers[i].table;
+        for (size_t j = 0; j < t->count; j++) {
+            order[n].sock = &t->recs[j];
+            order[n].src = t;
+            n++;
+        }
+    }
+    qsort(order, n, sizeof(order[0]), cmp_seq);
+
+    ss_sockset_t seen;
+    if (!sockset_init(&seen, total)) {
+        free(order);
+        return -1;
+    }
+
+    /* Records of one process are adjacent, so its name is copied once */
+    const ss_sock_table_t *name_src = NULL;
+    uint32_t name_off = 0, name_copy = 0;
+    int ret = 0;
+    for (size_t i = 0; i < n; i++) {
+        const ss_sock_info_t *rec = order[i].sock;
+        const ss_sock_table_t *src = order[i].src;
+        if (!sockset_insert(&seen, src, rec)) {
+            continue;
+        }
+        ss_sock_info_t *sock = sock_table_next(out);
+        if (!sock) {
+            perror("realloc");
+            ret = -1;
+            break;
+        }
+        *sock = *rec;
+        const ss_sock_ext_t *ext = sock_table_ext_of(src, rec);
+        if (ext) {
+            ss_sock_ext_t *copy = sock_table_ext(out);
+            if (copy) {
+                *copy = *ext;
+            }
+        }
+        if (rec->unix_path) {
+            sock->unix_path = copy_str(out, src, rec->unix_path);
+        }
+        if (rec->proc_name) {
+            if (src != name_src || rec->proc_name != name_off) {
+                name_src = src;
+                name_off = rec->proc_name;
+                name_copy = copy_str(out, src, rec->proc_name);
+            }
+            sock->proc_name = name_copy;
+        }
+        sock_table_commit(out);
+    }
+    sockset_free(&seen);
+    free(order);
+    return ret;
+}
+
+/* Collect sockets from the given PIDs with opts->threads workers */
+int collect_parallel(const ss_libproc_ops_t *ops, const pid_t *pids,
+                     int num_pids, const ss_options_t *opts, ss_sock_table_t *table)
+{
+    pool_t pool = { .ops = ops, .opts = opts, .num_workers = opts->threads };
+    int started = 0;
+
+    pool.workers = calloc((size_t)pool.num_workers, sizeof(worker_t));
+    if (!pool.workers) {
+        perror("calloc");
+        return -1;
+    }
+    atomic_init(&pool.pending, 0);
+    pthread_mutex_init(&pool.idle_lock, NULL);
+    pthread_cond_init(&pool.idle_cond, NULL);
+
+    /* Shard the PID array into contiguous blocks, one per worker */
+    int per_worker = (num_pids + pool.num_workers - 1) / pool.num_workers;
+    for (int w = 0; w < pool.num_workers; w++) {
+        worker_t *worker = &pool.workers[w];
+        worker->id = w;
+        worker->pool = &pool;
+        pthread_mutex_init(&worker->deque.lock, NULL);
+
+        /* Push in reverse so the owner pops its block in PID order */
+        int lo = w * per_worker;
+        int hi = (lo + per_worker < num_pids) ? lo + per_worker : num_pids;
+        for (int i = hi - 1; i >= lo; i--) {
+            if (pids[i] == 0) continue;
+            walk_task_t task = { .pid = pids[i], .pid_idx = (uint32_t)i };
+            if (deque_push(&worker->deque, &task)) {
+                atomic_fetch_add(&pool.pending, 1);
+            }
+        }
+    }
+
+    selfstats_phase_begin(SS_PHASE_SCAN);
+    for (int w = 0; w < pool.num_workers; w++) {
+        if (pthread_create(&pool.workers[w].thread, NULL, worker_main,
+                           &pool.workers[w]) != 0) {
+            break;
+        }
+        started++;
+    }
+
+    /* If no thread could be started, drain the queues on this one */
+    if (started == 0) {
+        worker_main(&pool.workers[0]);
+    }
+    for (int w = 0; w < started; w++) {
+        pthread_join(pool.workers[w].thread, NULL);
+    }
+
+    selfstats_phase_end(SS_PHASE_SCAN);
+
+    selfstats_phase_begin(SS_PHASE_MERGE);
+    int ret = merge_results(&pool, table);
+    selfstats_phase_end(SS_PHASE_MERGE);
+
+    for (int w = 0; w < pool.num_workers; w++) {
+        pthread_mutex_destroy(&pool.workers[w].deque.lock);
+        free(pool.workers[w].deque.tasks);
+        sock_table_free(&pool.workers[w].table);
+    }
+    free(pool.workers);
+    pthread_cond_destroy(&pool.idle_cond);
+    pthread_mutex_destroy(&pool.idle_lock);
+    return ret;
+}
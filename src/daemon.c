@@ -0,0 +1,565 @@
+/*
+ * ss - Socket Statistics for Apple platforms (macOS/iOS)
+ * Resident collector (ssd / --daemon) and its clients (--shm, --query)
+ *
+ * The daemon collects every socket, in all states and with process
+ * information, every --interval seconds and publishes the table as a
+ * snapshot image (snapshot.c) in a POSIX shared-memory segment. Clients
+ * (--shm) copy the latest image out under a seqlock and list from the
+ * copy with the usual filters, so a listing costs a memcpy instead of a
+ * libproc sweep.
+ *
+ * Seqlock: the daemon makes the sequence number odd, rewrites the image
+ * and makes it even again. A reader copies the image between two reads of
+ * the sequence number and retries if they differ or were odd. Readers
+ * never write to the segment, so any number of them can read at once and
+ * none can hold up the daemon.
+ *
+ * A segment cannot be resized portably (macOS allows one ftruncate), so
+ * when the image outgrows it the daemon creates a larger segment under the
+ * same name and sets "moved" in the old one; readers that see it reopen.
+ *
+ * The query endpoint (--query) is a UNIX stream socket. A client sends its
+ * command line as NUL-terminated arguments followed by an empty one; the
+ * daemon forks, the child parses the arguments and writes the listing
+ * (and any error) back over the connection, filtering the table it
+ * inherited. A slow client only holds up its own child, and only until
+ * the I/O timeout; the number of children is capped.
+ *
+ * A root daemon sees every process's sockets, so the segment and the
+ * socket are open only to the daemon's user unless --public is given, and
+ * a query may not use options that open files (main.c).
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include "ss.h"
+
+#define SHM_MAGIC "ss-shm"
+#define SHM_VERSION 1
+
+/* Image offset in the segment; keeps the records 8-byte aligned */
+#define SHM_DATA_OFF 64
+
+/* Smallest segment capacity; grown segments get twice the image size */
+#define SHM_MIN_CAPACITY (1u << 20)
+
+/* Seqlock read attempts before giving up on a busy segment */
+#define SHM_READ_TRIES 1000
+
+/* Refresh period without --interval, in seconds */
+#define SSD_INTERVAL 2.0
+
+/* Query request limits */
+#define QUERY_MAX_BYTES 65536
+#define QUERY_MAX_ARGS 256
+
+/* Queries answered at once; more connections are turned away */
+#define QUERY_MAX_CHILDREN 32
+
+/* Seconds a query connection may stall reading or writing */
+#define QUERY_TIMEOUT 10
+
+/* Shared-memory segment header, followed by the image at SHM_DATA_OFF */
+typedef struct {
+    char magic[8];              /* SHM_MAGIC, NUL-padded */
+    uint32_t version;
+    _Atomic uint32_t moved;     /* Replaced by a larger segment: reopen */
+    uint64_t capacity;          /* Image bytes the segment holds */
+    _Atomic uint64_t seq;       /* Odd while the image is being rewritten */
+    _Atomic uint64_t len;       /* Bytes of the current image */
+} shm_header_t;
+
+_Static_assert(sizeof(shm_header_t) <= SHM_DATA_OFF, "shm header overlaps the image");
+
+/* A mapped segment */
+typedef struct {
+    shm_header_t *hdr;
+    size_t map_len;
+} shm_seg_t;
+
+static volatile sig_atomic_t stop_requested;
+
+/* Query children not yet reaped */
+static int num_children;
+
+static void on_stop_signal(int sig)
+{
+    (void)sig;
+    stop_requested = 1;
+}
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static bool write_all(int fd, const void *data, size_t len)
+{
+    const char *p = data;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+/* Replace the segment called name with an empty one of the given capacity */
+static int shm_create(const char *name, size_t capacity, mode_t mode, shm_seg_t *seg)
+{
+    shm_unlink(name);
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, mode);
+    if (fd < 0) {
+        perror(name);
+        return -1;
+    }
+    /* Exactly mode, regardless of the daemon's umask */
+    fchmod(fd, mode);
+
+    size_t len = SHM_DATA_OFF + capacity;
+    if (ftruncate(fd, (off_t)len) < 0) {
+        perror(name);
+        close(fd);
+        shm_unlink(name);
+        return -1;
+    }
+    void *map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror(name);
+        shm_unlink(name);
+        return -1;
+    }
+
+    shm_header_t *hdr = map;
+    memcpy(hdr->magic, SHM_MAGIC, sizeof(SHM_MAGIC));
+    hdr->version = SHM_VERSION;
+    hdr->capacity = capacity;
+    atomic_init(&hdr->moved, 0);
+    atomic_init(&hdr->seq, 0);
+    atomic_init(&hdr->len, 0);
+    seg->hdr = hdr;
+    seg->map_len = len;
+    return 0;
+}
+
+/* Publish a finalized table, moving to a larger segment if it does not fit */
+static int shm_publish(const char *name, mode_t mode, shm_seg_t *seg,
+                       const ss_sock_table_t *table)
+{
+    size_t size = snapshot_size(table);
+
+    if (!seg->hdr || size > seg->hdr->capacity) {
+        size_t capacity = SHM_MIN_CAPACITY;
+        while (capacity < size * 2) {
+            capacity *= 2;
+        }
+        shm_seg_t grown;
+        if (shm_create(name, capacity, mode, &grown) < 0) {
+            return -1;
+        }
+        if (seg->hdr) {
+            atomic_store_explicit(&seg->hdr->moved, 1, memory_order_release);
+            munmap(seg->hdr, seg->map_len);
+        }
+        *seg = grown;
+    }
+
+    shm_header_t *hdr = seg->hdr;
+    uint64_t seq = atomic_load_explicit(&hdr->seq, memory_order_relaxed);
+    atomic_store_explicit(&hdr->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    snapshot_encode(table, (char *)hdr + SHM_DATA_OFF);
+    atomic_store_explicit(&hdr->len, size, memory_order_relaxed);
+    atomic_store_explicit(&hdr->seq, seq + 2, memory_order_release);
+    return 0;
+}
+
+static int listen_query(const char *path, mode_t mode)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "%s: path too long\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    /* A socket left behind by a daemon that did not exit cleanly */
+    struct stat st;
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        unlink(path);
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    /* Same audience as the shared-memory segment, set before anyone can connect */
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || chmod(path, mode) < 0 ||
+        listen(fd, 16) < 0) {
+        perror(path);
+        close(fd);
+        unlink(path);
+        return -1;
+    }
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return fd;
+}
+
+/* Read a request into buf and split it into argv (argv[0] is "ss") */
+static int read_request(int fd, char *buf, size_t cap, char **argv)
+{
+    size_t len = 0;
+    int argc = 0;
+
+    argv[argc++] = "ss";
+    for (;;) {
+        /* Complete once the last argument read is empty */
+        if (len > 0 && buf[len - 1] == '\0' && (len == 1 || buf[len - 2] == '\0')) {
+            break;
+        }
+        if (len == cap) {
+            return -1;
+        }
+        ssize_t n = read(fd, buf + len, cap - len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        len += (size_t)n;
+    }
+
+    for (size_t off = 0; buf[off] != '\0'; off += strlen(buf + off) + 1) {
+        if (argc == QUERY_MAX_ARGS) {
+            return -1;
+        }
+        argv[argc++] = buf + off;
+    }
+    argv[argc] = NULL;
+    return argc;
+}
+
+/* Whether the peer is the daemon's user or root (always, with --public) */
+static bool peer_allowed(int conn, bool public)
+{
+    uid_t uid;
+
+    if (public) {
+        return true;
+    }
+#ifdef SO_PEERCRED
+    struct ucred cred;
+    socklen_t len = sizeof(cred);
+    if (getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0) {
+        return false;
+    }
+    uid = cred.uid;
+#else
+    gid_t gid;
+    if (getpeereid(conn, &uid, &gid) < 0) {
+        return false;
+    }
+#endif
+    return uid == 0 || uid == geteuid();
+}
+
+/* Child side of a query: the connection becomes stdout and stderr */
+static void serve_connection(int conn, const ss_sock_table_t *table, ss_query_fn serve)
+{
+    static char buf[QUERY_MAX_BYTES];
+    char *argv[QUERY_MAX_ARGS + 1];
+
+    /* An idle or stalled client must not pin the child */
+    struct timeval tv = { .tv_sec = QUERY_TIMEOUT };
+    setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(conn, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    int argc = read_request(conn, buf, sizeof(buf), argv);
+    if (argc < 0) {
+        _exit(1);
+    }
+    dup2(conn, STDOUT_FILENO);
+    dup2(conn, STDERR_FILENO);
+    close(conn);
+
+    int ret = serve(argc, argv, table);
+    out_flush();
+    fflush(stdout);
+    fflush(stderr);
+    _exit(ret < 0 ? 1 : 0);
+}
+
+static void reap_children(void)
+{
+    while (num_children > 0 && waitpid(-1, NULL, WNOHANG) > 0) {
+        num_children--;
+    }
+}
+
+/* Fork a child for every connection waiting on the (non-blocking) socket */
+static void accept_queries(int listen_fd, bool public, const ss_sock_table_t *table,
+                           ss_query_fn serve)
+{
+    static const char busy[] = "ss: too many queries in progress\n";
+    static const char denied[] = "ss: permission denied\n";
+    int conn;
+
+    while ((conn = accept(listen_fd, NULL, NULL)) >= 0) {
+        /* BSD accept() passes O_NONBLOCK on to the connection */
+        fcntl(conn, F_SETFL, fcntl(conn, F_GETFL) & ~O_NONBLOCK);
+        if (!peer_allowed(conn, public)) {
+            write_all(conn, denied, sizeof(denied) - 1);
+            close(conn);
+            continue;
+        }
+        reap_children();
+        if (num_children >= QUERY_MAX_CHILDREN) {
+            write_all(conn, busy, sizeof(busy) - 1);
+            close(conn);
+            continue;
+        }
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(listen_fd);
+            serve_connection(conn, table, serve);
+        }
+        if (pid < 0) {
+            perror("fork");
+        } else {
+            num_children++;
+        }
+        close(conn);
+    }
+}
+
+/*
+ * Answer queries until the deadline. Queries already waiting are answered
+ * even when the collection overran the interval, so a slow host cannot
+ * starve them.
+ */
+static void serve_until(double deadline, int listen_fd, bool public,
+                        const ss_sock_table_t *table, ss_query_fn serve)
+{
+    while (!stop_requested) {
+        reap_children();
+
+        double left = deadline - now_seconds();
+        struct pollfd pfd = { .fd = listen_fd, .events = POLLIN };
+        if (poll(&pfd, 1, left > 0 ? (int)(left * 1000) + 1 : 0) > 0) {
+            accept_queries(listen_fd, public, table, serve);
+        }
+        if (left <= 0) {
+            return;
+        }
+    }
+}
+
+/*
+ * Run the daemon until SIGINT or SIGTERM: refresh the table every
+ * --interval seconds, publish it in the --shm segment, and answer queries
+ * on the --query socket. Both are removed on exit.
+ */
+int daemon_run(const ss_options_t *opts, ss_query_fn serve)
+{
+    const char *shm_name = opts->shm_name ? opts->shm_name : SSD_SHM_NAME;
+    const char *query_path = opts->query_path ? opts->query_path : SSD_QUERY_PATH;
+    double interval = opts->watch ? opts->interval : SSD_INTERVAL;
+    mode_t shm_mode = opts->daemon_public ? 0644 : 0600;
+
+    ss_options_t full_opts;
+    snapshot_options(opts, &full_opts);
+
+    struct sigaction sa = { .sa_handler = on_stop_signal };
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    int listen_fd = listen_query(query_path, opts->daemon_public ? 0666 : 0600);
+    if (listen_fd < 0) {
+        return -1;
+    }
+
+    shm_seg_t seg = {0};
+    ss_sock_table_t table = {0};
+    int ret = 0;
+    while (!stop_requested) {
+        double deadline = now_seconds() + interval;
+
+        sock_table_reset(&table);
+        if (collect_all_sockets(&full_opts, &table) == 0 &&
+            shm_publish(shm_name, shm_mode, &seg, &table) < 0) {
+            ret = -1;
+            break;
+        }
+        serve_until(deadline, listen_fd, opts->daemon_public, &table, serve);
+    }
+
+    close(listen_fd);
+    unlink(query_path);
+    if (seg.hdr) {
+        munmap(seg.hdr, seg.map_len);
+        shm_unlink(shm_name);
+    }
+    sock_table_free(&table);
+    return ret;
+}
+
+static int shm_open_segment(const char *name, shm_seg_t *seg)
+{
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) {
+        if (errno == ENOENT) {
+            fprintf(stderr, "%s: no snapshot published (is ssd running?)\n", name);
+        } else {
+            perror(name);
+        }
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < SHM_DATA_OFF) {
+        fprintf(stderr, "%s: not an ssd segment\n", name);
+        close(fd);
+        return -1;
+    }
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror(name);
+        return -1;
+    }
+
+    shm_header_t *hdr = map;
+    if (memcmp(hdr->magic, SHM_MAGIC, sizeof(SHM_MAGIC)) != 0 || hdr->version != SHM_VERSION ||
+        hdr->capacity > (size_t)st.st_size - SHM_DATA_OFF) {
+        fprintf(stderr, "%s: not an ssd segment\n", name);
+        munmap(map, (size_t)st.st_size);
+        return -1;
+    }
+    seg->hdr = hdr;
+    seg->map_len = (size_t)st.st_size;
+    return 0;
+}
+
+/*
+ * Copy the latest published snapshot out of the segment and use the copy
+ * as a read-only table (freed with sock_table_free()).
+ */
+int daemon_read_shm(const char *name, ss_sock_table_t *table)
+{
+    shm_seg_t seg = {0};
+
+    for (int tries = 0; tries < SHM_READ_TRIES; tries++) {
+        if (!seg.hdr && shm_open_segment(name, &seg) < 0) {
+            return -1;
+        }
+        shm_header_t *hdr = seg.hdr;
+        if (atomic_load_explicit(&hdr->moved, memory_order_acquire)) {
+            munmap(seg.hdr, seg.map_len);
+            seg.hdr = NULL;
+            continue;
+        }
+
+        /* Odd: being rewritten; 0: nothing published yet */
+        uint64_t seq = atomic_load_explicit(&hdr->seq, memory_order_acquire);
+        uint64_t len = atomic_load_explicit(&hdr->len, memory_order_relaxed);
+        if (seq == 0 || seq % 2 || len == 0 || len > hdr->capacity) {
+            sched_yield();
+            continue;
+        }
+
+        void *copy = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (copy == MAP_FAILED) {
+            perror("mmap");
+            break;
+        }
+        memcpy(copy, (const char *)hdr + SHM_DATA_OFF, len);
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&hdr->seq, memory_order_relaxed) != seq) {
+            munmap(copy, len);
+            continue;
+        }
+
+        munmap(seg.hdr, seg.map_len);
+        return snapshot_attach(copy, len, name, table);
+    }
+
+    if (seg.hdr) {
+        munmap(seg.hdr, seg.map_len);
+        fprintf(stderr, "%s: no consistent snapshot after %d attempts\n", name, SHM_READ_TRIES);
+    }
+    return -1;
+}
+
+/*
+ * Send a command line to the daemon at path and copy the answer to
+ * stdout. The arguments are parsed by the daemon, which ignores the
+ * --query option itself.
+ */
+int daemon_query(const char *path, int argc, char **argv)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "%s: path too long\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+
+    bool ok = true;
+    for (int i = 1; i < argc && ok; i++) {
+        ok = write_all(fd, argv[i], strlen(argv[i]) + 1);
+    }
+    if (!ok || !write_all(fd, "", 1)) {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+
+    char buf[65536];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0 || (n < 0 && errno == EINTR)) {
+        if (n > 0 && !write_all(STDOUT_FILENO, buf, (size_t)n)) {
+            break;
+        }
+    }
+    close(fd);
+    return n < 0 ? -1 : 0;
+}
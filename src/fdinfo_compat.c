@@ -0,0 +1,91 @@
+/*
+ * ss - Socket Statistics for Apple platforms (macOS/iOS)
+ * socket_fdinfo blobs read into the libproc_compat.h structs
+ *
+ * ss-ios walks sockets with the same code as the macOS build, which reads
+ * struct socket_fdinfo. On iOS that struct comes from libproc_compat.h
+ * (the xnu-6153 layout), so each blob the kernel returns is rewritten
+ * into it here. Fields the calibration located are taken from
+ * fdinfo_parse(). The others are read at their compat offset moved by as
+ * much as the nearest calibrated field has moved on this OS build:
+ * socket_info up to soi_kind with soi_family, and the protocol union with
+ * insi_lport.
+ *
+ * Builds on Linux too, where tests/ replays recorded blobs through it.
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include <sys/socket.h>
+#include "libproc_compat.h"
+#include "fdinfo_layout.h"
+
+/* Copy n bytes of the blob at off to dst, if the blob holds them */
+static void read_at(void *dst, size_t n, const uint8_t *blob, int len, long off)
+{
+    if (off >= 0 && off + (long)n <= len) {
+        memcpy(dst, blob + off, n);
+    }
+}
+
+/* A member of out, read at its compat offset moved by shift */
+#define READ_MOVED(member, shift) \
+    read_at(&out->member, sizeof(out->member), blob, len, \
+            (long)offsetof(struct socket_fdinfo, member) + (shift))
+
+/*
+ * Rewrite a PROC_PIDFDSOCKETINFO blob as struct socket_fdinfo. Returns
+ * false if the blob is shorter than the one the layout was measured on.
+ */
+bool fdinfo_read_socket(const fdinfo_layout_t *layout, const uint8_t *blob, int len,
+                        struct socket_fdinfo *out)
+{
+    long head = layout->family - (long)offsetof(struct socket_fdinfo, psi.soi_family);
+    long proto = layout->lport -
+                 (long)offsetof(struct socket_fdinfo, psi.soi_proto.pri_in.insi_lport);
+
+    if (len < layout->size) {
+        return false;
+    }
+    memset(out, 0, sizeof(*out));
+
+    READ_MOVED(psi.soi_family, head);
+    READ_MOVED(psi.soi_type, head);
+    READ_MOVED(psi.soi_protocol, head);
+    READ_MOVED(psi.soi_rcv.sbi_cc, head);
+    READ_MOVED(psi.soi_rcv.sbi_hiwat, head);
+    READ_MOVED(psi.soi_snd.sbi_cc, head);
+    READ_MOVED(psi.soi_snd.sbi_hiwat, head);
+
+    if (out->psi.soi_family == AF_UNIX) {
+        READ_MOVED(psi.soi_proto.pri_un.unsi_conn_so, proto);
+        READ_MOVED(psi.soi_proto.pri_un.unsi_addr, proto);
+        return true;
+    }
+
+    fdinfo_sock_t sock;
+    if (!fdinfo_parse(layout, blob, len, &sock)) {
+        /* Another family: the walker skips it */
+        return true;
+    }
+    struct in_sockinfo *in = &out->psi.soi_proto.pri_in;
+    out->psi.soi_family = sock.family;
+    out->psi.soi_protocol = sock.protocol;
+    in->insi_lport = htons(sock.lport);
+    in->insi_fport = htons(sock.fport);
+    if (sock.family == FDINFO_AF_INET) {
+        memcpy(&in->insi_laddr.ina_46.i46a_addr4, sock.laddr, 4);
+        memcpy(&in->insi_faddr.ina_46.i46a_addr4, sock.faddr, 4);
+    } else {
+        memcpy(&INSI_ADDR6(in->insi_laddr), sock.laddr, 16);
+        memcpy(&INSI_ADDR6(in->insi_faddr), sock.faddr, 16);
+    }
+    if (sock.tcp_state != FDINFO_NONE) {
+        /* -i / -o internals */
+        out->psi.soi_proto.pri_tcp.tcpsi_state = sock.tcp_state;
+        READ_MOVED(psi.soi_proto.pri_tcp.tcpsi_timer, proto);
+        READ_MOVED(psi.soi_proto.pri_tcp.tcpsi_mss, proto);
+        READ_MOVED(psi.soi_proto.pri_tcp.tcpsi_flags, proto);
+    }
+    return true;
+}
@@ -0,0 +1,338 @@
+/*
+ * ss - Socket Statistics for Apple platforms (macOS/iOS)
+ * socket_fdinfo layout calibration, parsing and on-disk cache
+ *
+ * Calibration looks for each field independently: an offset is a candidate
+ * if every probe the field applies to holds its known value there. The
+ * probes are chosen so the values differ between them (listening vs.
+ * connected, TCP vs. UDP, IPv4 vs. IPv6, distinct ports), which leaves
+ * one candidate per field. If a field ends up with none, or with several
+ * that cannot be told apart, calibration fails rather than guessing.
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+#include "fdinfo_layout.h"
+
+/* Calibrated fields: layout member, width, alignment */
+typedef enum {
+    F_FAMILY,
+    F_PROTOCOL,
+    F_LPORT,
+    F_FPORT,
+    F_LADDR4,
+    F_FADDR4,
+    F_LADDR6,
+    F_FADDR6,
+    F_TCP_STATE,
+    F_COUNT
+} field_t;
+
+static const struct {
+    const char *name;
+    size_t off;             /* Member of fdinfo_layout_t */
+    int width;
+    int align;
+} fields[F_COUNT] = {
+    [F_FAMILY]    = { "family",    offsetof(fdinfo_layout_t, family),    4,  4 },
+    [F_PROTOCOL]  = { "protocol",  offsetof(fdinfo_layout_t, protocol),  4,  4 },
+    [F_LPORT]     = { "lport",     offsetof(fdinfo_layout_t, lport),     2,  2 },
+    [F_FPORT]     = { "fport",     offsetof(fdinfo_layout_t, fport),     2,  2 },
+    [F_LADDR4]    = { "laddr4",    offsetof(fdinfo_layout_t, laddr4),    4,  4 },
+    [F_FADDR4]    = { "faddr4",    offsetof(fdinfo_layout_t, faddr4),    4,  4 },
+    [F_LADDR6]    = { "laddr6",    offsetof(fdinfo_layout_t, laddr6),    16, 4 },
+    [F_FADDR6]    = { "faddr6",    offsetof(fdinfo_layout_t, faddr6),    16, 4 },
+    [F_TCP_STATE] = { "tcp_state", offsetof(fdinfo_layout_t, tcp_state), 4,  4 },
+};
+
+static int *layout_field(fdinfo_layout_t *layout, field_t f)
+{
+    return (int *)((char *)layout + fields[f].off);
+}
+
+static int layout_value(const fdinfo_layout_t *layout, field_t f)
+{
+    int v;
+    memcpy(&v, (const char *)layout + fields[f].off, sizeof(v));
+    return v;
+}
+
+/*
+ * Bytes a probe is known to hold for a field, in blob order. Returns false
+ * if the field does not apply to the probe (IPv6 address of an IPv4
+ * socket, TCP state of a UDP socket).
+ */
+static bool expected_bytes(const fdinfo_sock_t *s, field_t f, uint8_t *buf)
+{
+    int32_t v;
+
+    switch (f) {
+        case F_FAMILY:
+            v = s->family;
+            break;
+        case F_PROTOCOL:
+            v = s->protocol;
+            break;
+        case F_TCP_STATE:
+            if (s->tcp_state == FDINFO_NONE) {
+                return false;
+            }
+            v = s->tcp_state;
+            break;
+        case F_LPORT:
+        case F_FPORT: {
+            uint16_t port = htons(f == F_LPORT ? s->lport : s->fport);
+            memcpy(buf, &port, 2);
+            return true;
+        }
+        case F_LADDR4:
+        case F_FADDR4:
+            if (s->family != FDINFO_AF_INET) {
+                return false;
+            }
+            memcpy(buf, f == F_LADDR4 ? s->laddr : s->faddr, 4);
+            return true;
+        default:
+            if (s->family != FDINFO_AF_INET6) {
+                return false;
+            }
+            memcpy(buf, f == F_LADDR6 ? s->laddr : s->faddr, 16);
+            return true;
+    }
+    /* Native byte order, like the kernel wrote it */
+    memcpy(buf, &v, 4);
+    return true;
+}
+
+/* Offset of one field, or FDINFO_NONE with a message in err */
+static int find_field(const fdinfo_probe_t *probes, int num_probes, int len, field_t f,
+                      const fdinfo_layout_t *found, char *err, size_t err_len)
+{
+    int width = fields[f].width;
+    uint8_t want[16], first[16];
+    int applicable = 0;
+    bool distinct = false;
+
+    for (int i = 0; i < num_probes; i++) {
+        if (expected_bytes(&probes[i].sock, f, want)) {
+            if (applicable++ == 0) {
+                memcpy(first, want, (size_t)width);
+            } else if (memcmp(first, want, (size_t)width) != 0) {
+                distinct = true;
+            }
+        }
+    }
+    /* All-equal values would match any run of the same bytes */
+    if (!distinct) {
+        snprintf(err, err_len, "probes do not tell %s apart", fields[f].name);
+        return FDINFO_NONE;
+    }
+
+    int match = FDINFO_NONE;
+    int matches = 0;
+    int preferred = FDINFO_NONE;
+    for (int off = 0; off + width <= len; off += fields[f].align) {
+        bool ok = true;
+        for (int i = 0; i < num_probes && ok; i++) {
+            if (expected_bytes(&probes[i].sock, f, want)) {
+                ok = memcmp(probes[i].blob + off, want, (size_t)width) == 0;
+            }
+        }
+        if (!ok) {
+            continue;
+        }
+        match = off;
+        matches++;
+
+        /* An IPv4 address is the tail of the 16-byte in4in6 union */
+        if ((f == F_LADDR6 && found->laddr4 == off + 12) ||
+            (f == F_FADDR6 && found->faddr4 == off + 12)) {
+            preferred = off;
+        }
+    }
+
+    if (matches == 1) {
+        return match;
+    }
+    if (preferred != FDINFO_NONE) {
+        return preferred;
+    }
+    snprintf(err, err_len, matches ? "%s is ambiguous (%d offsets match)" : "%s not found",
+             fields[f].name, matches);
+    return FDINFO_NONE;
+}
+
+/*
+ * Measure the field offsets from probe blobs. Returns false, with the
+ * reason in err, if any field cannot be located unambiguously.
+ */
+bool fdinfo_calibrate(const fdinfo_probe_t *probes, int num_probes,
+                      fdinfo_layout_t *layout, char *err, size_t err_len)
+{
+    if (num_probes == 0) {
+        snprintf(err, err_len, "no probe sockets");
+        return false;
+    }
+
+    memset(layout, 0, sizeof(*layout));
+    layout->size = probes[0].len;
+    for (int i = 1; i < num_probes; i++) {
+        if (probes[i].len < layout->size) {
+            layout->size = probes[i].len;
+        }
+    }
+
+    /* In enum order: the IPv4 addresses are known before the IPv6 ones */
+    for (field_t f = 0; f < F_COUNT; f++) {
+        int off = find_field(probes, num_probes, layout->size, f, layout, err, err_len);
+        if (off == FDINFO_NONE) {
+            return false;
+        }
+        *layout_field(layout, f) = off;
+    }
+    return true;
+}
+
+static int32_t read_int(const uint8_t *blob, int off)
+{
+    int32_t v;
+    memcpy(&v, blob + off, sizeof(v));
+    return v;
+}
+
+static uint16_t read_port(const uint8_t *blob, int off)
+{
+    uint16_t v;
+    memcpy(&v, blob + off, sizeof(v));
+    return ntohs(v);
+}
+
+/* Fields of an IPv4/IPv6 socket; false for other families and short blobs */
+bool fdinfo_parse(const fdinfo_layout_t *layout, const uint8_t *blob, int len,
+                  fdinfo_sock_t *out)
+{
+    if (len < layout->size) {
+        return false;
+    }
+
+    memset(out, 0, sizeof(*out));
+    out->family = read_int(blob, layout->family);
+    if (out->family == FDINFO_AF_INET) {
+        memcpy(out->laddr, blob + layout->laddr4, 4);
+        memcpy(out->faddr, blob + layout->faddr4, 4);
+    } else if (out->family == FDINFO_AF_INET6) {
+        memcpy(out->laddr, blob + layout->laddr6, 16);
+        memcpy(out->faddr, blob + layout->faddr6, 16);
+    } else {
+        return false;
+    }
+
+    out->protocol = read_int(blob, layout->protocol);
+    out->lport = read_port(blob, layout->lport);
+    out->fport = read_port(blob, layout->fport);
+    out->tcp_state = (out->protocol == IPPROTO_TCP) ? read_int(blob, layout->tcp_state)
+                                                    : FDINFO_NONE;
+    return true;
+}
+
+/*
+ * Read a saved layout. Returns false if the file is missing, incomplete,
+ * or was measured on another OS build.
+ */
+bool fdinfo_layout_load(fdinfo_layout_t *layout, const char *path, const char *os_build)
+{
+    /* Only a regular file of our own that nobody else can rewrite */
+    int fd = open(path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_uid != geteuid() ||
+        (st.st_mode & (S_IWGRP | S_IWOTH))) {
+        close(fd);
+        return false;
+    }
+    FILE *fp = fdopen(fd, "r");
+    if (!fp) {
+        close(fd);
+        return false;
+    }
+
+    char line[256];
+    bool same_os = false;
+    unsigned seen = 0;
+    memset(layout, 0, sizeof(*layout));
+    while (fgets(line, sizeof(line), fp)) {
+        char key[32], val[128];
+        if (line[0] == '#' || sscanf(line, "%31s %127s", key, val) != 2) {
+            continue;
+        }
+        if (strcmp(key, "os") == 0) {
+            same_os = (strcmp(val, os_build) == 0);
+        } else if (strcmp(key, "size") == 0) {
+            layout->size = atoi(val);
+            seen |= 1u << F_COUNT;
+        } else {
+            for (field_t f = 0; f < F_COUNT; f++) {
+                if (strcmp(key, fields[f].name) == 0) {
+                    *layout_field(layout, f) = atoi(val);
+                    seen |= 1u << f;
+                }
+            }
+        }
+    }
+    fclose(fp);
+
+    if (!same_os || seen != (1u << (F_COUNT + 1)) - 1) {
+        return false;
+    }
+    /* Never trust offsets that point outside the blob */
+    for (field_t f = 0; f < F_COUNT; f++) {
+        int off = layout_value(layout, f);
+        if (off < 0 || off + fields[f].width > layout->size) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Write the layout to a fresh temporary file (mkstemp: O_EXCL, mode 0600,
+ * never through a planted symlink) and rename it into place.
+ */
+bool fdinfo_layout_save(const fdinfo_layout_t *layout, const char *path,
+                        const char *os_build)
+{
+    char tmp[1024];
+    if (snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path) >= (int)sizeof(tmp)) {
+        return false;
+    }
+
+    int fd = mkstemp(tmp);
+    if (fd < 0) {
+        return false;
+    }
+    FILE *fp = fdopen(fd, "w");
+    if (!fp) {
+        close(fd);
+        remove(tmp);
+        return false;
+    }
+    fprintf(fp, "# ss_proc socket_fdinfo layout\n");
+    fprintf(fp, "os %s\n", os_build);
+    fprintf(fp, "size %d\n", layout->size);
+    for (field_t f = 0; f < F_COUNT; f++) {
+        fprintf(fp, "%s %d\n", fields[f].name, layout_value(layout, f));
+    }
+    if (fclose(fp) != 0 || rename(tmp, path) != 0) {
+        remove(tmp);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,86 @@
+/*
+ * ss - Socket Statistics for Apple platforms (macOS/iOS)
+ * Calibrated socket_fdinfo layout for ss-ios and ss_proc
+ *
+ * The iOS SDK does not ship <sys/proc_info.h>, and struct socket_fdinfo
+ * has changed size between releases, so the result of PROC_PIDFDSOCKETINFO
+ * is treated as an opaque blob. The offsets of the fields needed are
+ * measured once per OS build from sockets the process opens itself (whose
+ * ports, addresses and states it knows), saved to disk, and used for plain
+ * offset reads afterwards.
+ *
+ * Only the probes (fdinfo_probe.c) call libproc, so the calibration and
+ * parsing code also builds on Linux, where tests/ replays recorded blobs
+ * through it.
+ */
+
+#ifndef FDINFO_LAYOUT_H
+#define FDINFO_LAYOUT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Darwin address families and TCP states (TSI_S_*), as found in the blob */
+#define FDINFO_AF_INET          2
+#define FDINFO_AF_INET6         30
+#define FDINFO_TCP_CLOSED       0
+#define FDINFO_TCP_LISTEN       1
+#define FDINFO_TCP_ESTABLISHED  4
+
+/* No value known / field not found */
+#define FDINFO_NONE (-1)
+
+/* Large enough for socket_fdinfo on every release so far */
+#define FDINFO_BUF_SIZE 2048
+
+/* Byte offsets of the fields in a socket_fdinfo blob */
+typedef struct {
+    int size;               /* Blob size the layout was measured on */
+    int family;             /* int32 soi_family */
+    int protocol;           /* int32 soi_protocol */
+    int lport;              /* Network-order 16-bit ports */
+    int fport;
+    int laddr4;             /* IPv4 addresses (4 bytes) */
+    int faddr4;
+    int laddr6;             /* IPv6 addresses (16 bytes) */
+    int faddr6;
+    int tcp_state;          /* int32 TSI_S_* */
+} fdinfo_layout_t;
+
+/* Socket fields, either known (probes) or parsed from a blob */
+typedef struct {
+    int family;             /* FDINFO_AF_INET / FDINFO_AF_INET6 */
+    int protocol;           /* IPPROTO_TCP / IPPROTO_UDP */
+    uint16_t lport;         /* Host order */
+    uint16_t fport;
+    uint8_t laddr[16];      /* IPv4: first 4 bytes */
+    uint8_t faddr[16];
+    int tcp_state;          /* FDINFO_NONE if not TCP */
+} fdinfo_sock_t;
+
+/* A calibration sample: a raw blob and what it is known to describe */
+typedef struct {
+    const uint8_t *blob;
+    int len;
+    fdinfo_sock_t sock;
+} fdinfo_probe_t;
+
+bool fdinfo_calibrate(const fdinfo_probe_t *probes, int num_probes,
+                      fdinfo_layout_t *layout, char *err, size_t err_len);
+bool fdinfo_parse(const fdinfo_layout_t *layout, const uint8_t *blob, int len,
+                  fdinfo_sock_t *out);
+
+/* On-disk cache, valid only for the OS build it was measured on */
+bool fdinfo_layout_load(fdinfo_layout_t *layout, const char *path, const char *os_build);
+bool fdinfo_layout_save(const fdinfo_layout_t *layout, const char *path,
+                        const char *os_build);
+
+/* Cached layout for this OS build, or a fresh calibration (fdinfo_probe.c, Darwin) */
+bool fdinfo_layout_get(fdinfo_layout_t *layout, bool recalibrate, bool dump);
+
+/* A blob as the libproc_compat.h struct (fdinfo_compat.c) */
+struct socket_fdinfo;
+bool fdinfo_read_socket(const fdinfo_layout_t *layout, const uint8_t *blob, int len,
+                        struct socket_fdinfo *out);
+
+#endif /* FDINFO_LAYOUT_H */
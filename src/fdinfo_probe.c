@@ -0,0 +1,311 @@
+/*
+ * ss - Socket Statistics for Apple platforms (macOS/iOS)
+ * socket_fdinfo layout calibration against sockets of this process
+ *
+ * Opens a handful of sockets whose ports, addresses and TCP states are
+ * known, reads their PROC_PIDFDSOCKETINFO blobs and hands them to
+ * fdinfo_calibrate(). The result is cached in SS_PROC_LAYOUT (default
+ * /var/db/ss_proc.layout), shared by ss-ios and ss_proc.
+ *
+ * Darwin only: unlike fdinfo_layout.c this calls libproc.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/sysctl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "fdinfo_layout.h"
+
+/* libproc (not in iOS SDK headers) */
+#ifndef PROC_PIDFDSOCKETINFO
+#define PROC_PIDFDSOCKETINFO 3
+#endif
+extern int proc_pidfdinfo(int pid, int fd, int flavor, void *buffer, int buffersize);
+
+/* Default layout cache, in a directory only root can write */
+#define LAYOUT_CACHE_PATH "/var/db/ss_proc.layout"
+
+/* Calibration sockets */
+#define MAX_PROBES 8
+
+/* What getsockopt() says of fields the calibration leaves alone, for -d */
+typedef struct {
+    int rcvbuf;             /* SO_RCVBUF: sbi_hiwat */
+    int sndbuf;
+    int mss;                /* TCP_MAXSEG: tcpsi_mss; FDINFO_NONE if not TCP */
+} probe_opts_t;
+
+/* Probe sockets: the fds, the blobs read back and what they must say */
+typedef struct {
+    int fds[MAX_PROBES + 1];
+    int num_fds;
+    uint8_t blobs[MAX_PROBES][FDINFO_BUF_SIZE];
+    fdinfo_probe_t probes[MAX_PROBES];
+    probe_opts_t opts[MAX_PROBES];
+    int num_probes;
+    uint8_t unix_blob[FDINFO_BUF_SIZE];   /* A non-IP socket, for -d */
+    int unix_len;
+} probe_set_t;
+
+static int probe_fd(probe_set_t *set, int domain, int type)
+{
+    int fd = socket(domain, type, 0);
+    if (fd >= 0) {
+        set->fds[set->num_fds++] = fd;
+    }
+    return fd;
+}
+
+static uint16_t bound_port(int fd)
+{
+    struct sockaddr_storage ss;
+    socklen_t len = sizeof(ss);
+    if (getsockname(fd, (struct sockaddr *)&ss, &len) < 0) {
+        return 0;
+    }
+    if (ss.ss_family == AF_INET6) {
+        return ntohs(((struct sockaddr_in6 *)&ss)->sin6_port);
+    }
+    return ntohs(((struct sockaddr_in *)&ss)->sin_port);
+}
+
+static int sockopt_int(int fd, int level, int name)
+{
+    int v = FDINFO_NONE;
+    socklen_t len = sizeof(v);
+    getsockopt(fd, level, name, &v, &len);
+    return v;
+}
+
+/* Read a probe's blob and record what is known about it */
+static bool add_probe(probe_set_t *set, int fd, int family, int protocol,
+                      const void *laddr, const void *faddr, uint16_t fport, int state)
+{
+    if (fd < 0 || set->num_probes == MAX_PROBES) {
+        return false;
+    }
+    int n = set->num_probes;
+    int ret = proc_pidfdinfo(getpid(), fd, PROC_PIDFDSOCKETINFO,
+                             set->blobs[n], FDINFO_BUF_SIZE);
+    if (ret <= 0) {
+        return false;
+    }
+
+    fdinfo_probe_t *p = &set->probes[n];
+    size_t alen = (family == FDINFO_AF_INET6) ? 16 : 4;
+    memset(p, 0, sizeof(*p));
+    p->blob = set->blobs[n];
+    p->len = ret;
+    p->sock.family = family;
+    p->sock.protocol = protocol;
+    p->sock.lport = bound_port(fd);
+    p->sock.fport = fport;
+    memcpy(p->sock.laddr, laddr, alen);
+    memcpy(p->sock.faddr, faddr, alen);
+    p->sock.tcp_state = state;
+
+    probe_opts_t *o = &set->opts[n];
+    o->rcvbuf = sockopt_int(fd, SOL_SOCKET, SO_RCVBUF);
+    o->sndbuf = sockopt_int(fd, SOL_SOCKET, SO_SNDBUF);
+    o->mss = (protocol == IPPROTO_TCP) ? sockopt_int(fd, IPPROTO_TCP, TCP_MAXSEG) : FDINFO_NONE;
+    set->num_probes++;
+    return true;
+}
+
+/*
+ * Open sockets whose fields differ from one another in every calibrated
+ * field: TCP listening, connected (both ends) and closed; UDP connected;
+ * IPv6 TCP listening on :: and UDP on ::1.
+ */
+static bool open_probes(probe_set_t *set)
+{
+    struct in_addr lo4 = { htonl(INADDR_LOOPBACK) };
+    struct in_addr any4 = { 0 };
+    struct sockaddr_in sin;
+    struct sockaddr_in6 sin6;
+
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_addr = lo4;
+
+    int lfd = probe_fd(set, AF_INET, SOCK_STREAM);
+    if (lfd < 0 || bind(lfd, (struct sockaddr *)&sin, sizeof(sin)) < 0 || listen(lfd, 1) < 0) {
+        return false;
+    }
+    uint16_t lport = bound_port(lfd);
+    sin.sin_port = htons(lport);
+
+    int cfd = probe_fd(set, AF_INET, SOCK_STREAM);
+    if (cfd < 0 || connect(cfd, (struct sockaddr *)&sin, sizeof(sin)) < 0) {
+        return false;
+    }
+    int afd = accept(lfd, NULL, NULL);
+    if (afd < 0) {
+        return false;
+    }
+    set->fds[set->num_fds++] = afd;
+
+    int bfd = probe_fd(set, AF_INET, SOCK_STREAM);
+    struct sockaddr_in any = { .sin_family = AF_INET };
+    if (bfd < 0 || bind(bfd, (struct sockaddr *)&any, sizeof(any)) < 0) {
+        return false;
+    }
+
+    int ufd = probe_fd(set, AF_INET, SOCK_DGRAM);
+    if (ufd < 0 || connect(ufd, (struct sockaddr *)&sin, sizeof(sin)) < 0) {
+        return false;
+    }
+
+    bool ok = add_probe(set, lfd, FDINFO_AF_INET, IPPROTO_TCP, &lo4, &any4, 0,
+                        FDINFO_TCP_LISTEN) &&
+              add_probe(set, cfd, FDINFO_AF_INET, IPPROTO_TCP, &lo4, &lo4, lport,
+                        FDINFO_TCP_ESTABLISHED) &&
+              add_probe(set, afd, FDINFO_AF_INET, IPPROTO_TCP, &lo4, &lo4,
+                        bound_port(cfd), FDINFO_TCP_ESTABLISHED) &&
+              add_probe(set, bfd, FDINFO_AF_INET, IPPROTO_TCP, &any4, &any4, 0,
+                        FDINFO_TCP_CLOSED) &&
+              add_probe(set, ufd, FDINFO_AF_INET, IPPROTO_UDP, &lo4, &lo4, lport,
+                        FDINFO_NONE);
+    if (!ok) {
+        return false;
+    }
+
+    /* IPv6: listening on ::, UDP from ::1 to the IPv4 listener's port */
+    memset(&sin6, 0, sizeof(sin6));
+    sin6.sin6_family = AF_INET6;
+    int l6fd = probe_fd(set, AF_INET6, SOCK_STREAM);
+    if (l6fd < 0 || bind(l6fd, (struct sockaddr *)&sin6, sizeof(sin6)) < 0 ||
+        listen(l6fd, 1) < 0) {
+        return false;
+    }
+    sin6.sin6_addr = in6addr_loopback;
+    sin6.sin6_port = htons(lport);
+    int u6fd = probe_fd(set, AF_INET6, SOCK_DGRAM);
+    if (u6fd < 0 || connect(u6fd, (struct sockaddr *)&sin6, sizeof(sin6)) < 0) {
+        return false;
+    }
+    ok = add_probe(set, l6fd, FDINFO_AF_INET6, IPPROTO_TCP, &in6addr_any, &in6addr_any, 0,
+                   FDINFO_TCP_LISTEN) &&
+         add_probe(set, u6fd, FDINFO_AF_INET6, IPPROTO_UDP, &in6addr_loopback,
+                   &in6addr_loopback, lport, FDINFO_NONE);
+
+    /* A UNIX socket, recorded for the corpus only */
+    int ufds[2];
+    if (ok && socketpair(AF_UNIX, SOCK_STREAM, 0, ufds) == 0) {
+        set->unix_len = proc_pidfdinfo(getpid(), ufds[0], PROC_PIDFDSOCKETINFO,
+                                       set->unix_blob, FDINFO_BUF_SIZE);
+        close(ufds[0]);
+        close(ufds[1]);
+    }
+    return ok;
+}
+
+static void close_probes(probe_set_t *set)
+{
+    for (int i = 0; i < set->num_fds; i++) {
+        close(set->fds[i]);
+    }
+    set->num_fds = 0;
+}
+
+/* One corpus record: known fields, then the blob in hex */
+static void dump_record(const char *kind, const fdinfo_sock_t *s, const probe_opts_t *o,
+                        const uint8_t *blob, int len)
+{
+    char laddr[INET6_ADDRSTRLEN], faddr[INET6_ADDRSTRLEN];
+    int af = (s->family == FDINFO_AF_INET6) ? AF_INET6 : AF_INET;
+
+    if (s->family == FDINFO_AF_INET || s->family == FDINFO_AF_INET6) {
+        inet_ntop(af, s->laddr, laddr, sizeof(laddr));
+        inet_ntop(af, s->faddr, faddr, sizeof(faddr));
+        printf("%s family=%d protocol=%d lport=%u fport=%u laddr=%s faddr=%s state=%d ",
+               kind, s->family, s->protocol, s->lport, s->fport, laddr, faddr, s->tcp_state);
+        printf("rcvbuf=%d sndbuf=%d ", o->rcvbuf, o->sndbuf);
+        if (o->mss != FDINFO_NONE) {
+            printf("mss=%d ", o->mss);
+        }
+        printf("blob=");
+    } else {
+        printf("%s family=%d blob=", kind, s->family);
+    }
+    for (int i = 0; i < len; i++) {
+        printf("%02x", blob[i]);
+    }
+    printf("\n");
+}
+
+/* OS build the layout is valid for */
+static void os_build(char *buf, size_t len)
+{
+    size_t n = len;
+    if (sysctlbyname("kern.osversion", buf, &n, NULL, 0) < 0 || n == 0) {
+        strncpy(buf, "unknown", len);
+    }
+}
+
+/*
+ * Cached layout for this OS build, or a fresh calibration (saved for next
+ * time). With dump, always calibrate and print the probe blobs as a
+ * tests/fdinfo corpus file instead of saving.
+ */
+bool fdinfo_layout_get(fdinfo_layout_t *layout, bool recalibrate, bool dump)
+{
+    const char *path = getenv("SS_PROC_LAYOUT");
+    char build[64] = "";
+    char err[128];
+    probe_set_t *set;
+
+    if (!path || !*path) {
+        path = LAYOUT_CACHE_PATH;
+    }
+    os_build(build, sizeof(build));
+    if (!recalibrate && !dump && fdinfo_layout_load(layout, path, build)) {
+        return true;
+    }
+
+    set = calloc(1, sizeof(*set));
+    if (!set) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return false;
+    }
+    bool ok = open_probes(set);
+    if (!ok) {
+        fprintf(stderr, "%s: cannot set up calibration sockets: %s\n", getprogname(),
+                strerror(errno));
+    } else if (!(ok = fdinfo_calibrate(set->probes, set->num_probes, layout, err, sizeof(err)))) {
+        fprintf(stderr, "%s: socket_fdinfo calibration failed: %s\n", getprogname(), err);
+    }
+
+    if (dump) {
+        printf("# socket_fdinfo blobs recorded by %s -d on OS build %s\n", getprogname(), build);
+        if (ok) {
+            printf("expect size=%d family=%d protocol=%d lport=%d fport=%d laddr4=%d "
+                   "faddr4=%d laddr6=%d faddr6=%d tcp_state=%d\n",
+                   layout->size, layout->family, layout->protocol, layout->lport,
+                   layout->fport, layout->laddr4, layout->faddr4, layout->laddr6,
+                   layout->faddr6, layout->tcp_state);
+        }
+        for (int i = 0; i < set->num_probes; i++) {
+            dump_record("probe", &set->probes[i].sock, &set->opts[i], set->probes[i].blob,
+                        set->probes[i].len);
+        }
+        if (set->unix_len > 0) {
+            fdinfo_sock_t unix_sock = { .family = AF_UNIX };
+            dump_record("sock", &unix_sock, NULL, set->unix_blob, set->unix_len);
+        }
+    } else if (ok && !fdinfo_layout_save(layout, path, build)) {
+        /* Still usable; calibrate again next run */
+        fprintf(stderr, "%s: cannot save layout to %s\n", getprogname(), path);
+    }
+
+    close_probes(set);
+    free(set);
+    return ok;
+}
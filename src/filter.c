@@ -0,0 +1,649 @@
+/*
+ * ss - Socket Statistics for Apple platforms (macOS/iOS)
+ * Linux ss filter expressions: state/exclude lists and sport, dport, src,
+ * dst terms combined with and/or/not and parentheses
+ *
+ *   ss -ta state established '( dport = :443 or sport = :8080 ) and dst 10.0.0.0/8'
+ *
+ * The arguments are parsed once into a state bitmask plus a short postfix
+ * program over binary record fields. Collectors evaluate it through
+ * should_include() right after a record is built, before any address
+ * formatting or process name lookup.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include "ss.h"
+
+/* Deepest operand stack the evaluator supports */
+#define FILTER_MAX_DEPTH 64
+
+/* Deepest nesting of '(' and 'not' the recursive parser accepts */
+#define FILTER_MAX_NEST 256
+
+/* Postfix instructions */
+enum {
+    FOP_SPORT,              /* Local port <cmp> port */
+    FOP_DPORT,              /* Remote port <cmp> port */
+    FOP_SRC,                /* Local address in prefix (and port, if set) */
+    FOP_DST,                /* Remote address in prefix (and port, if set) */
+    FOP_AND,
+    FOP_OR,
+    FOP_NOT
+};
+
+/* Port comparisons */
+enum {
+    FCMP_EQ,
+    FCMP_NE,
+    FCMP_LT,
+    FCMP_GT,
+    FCMP_LE,
+    FCMP_GE
+};
+
+#define STATE_BIT(s) (1u << (s))
+
+/* TCP states of "all": everything but SS_TCP_UNKNOWN */
+#define STATES_ALL \
+    (STATE_BIT(SS_TCP_CLOSED) | STATE_BIT(SS_TCP_LISTEN) | STATE_BIT(SS_TCP_SYN_SENT) | \
+     STATE_BIT(SS_TCP_SYN_RECV) | STATE_BIT(SS_TCP_ESTABLISHED) | \
+     STATE_BIT(SS_TCP_CLOSE_WAIT) | STATE_BIT(SS_TCP_FIN_WAIT1) | \
+     STATE_BIT(SS_TCP_CLOSING) | STATE_BIT(SS_TCP_LAST_ACK) | \
+     STATE_BIT(SS_TCP_FIN_WAIT2) | STATE_BIT(SS_TCP_TIME_WAIT))
+
+#define STATES_CONNECTED \
+    (STATES_ALL & ~(STATE_BIT(SS_TCP_LISTEN) | STATE_BIT(SS_TCP_CLOSED)))
+
+#define STATES_BUCKET (STATE_BIT(SS_TCP_SYN_RECV) | STATE_BIT(SS_TCP_TIME_WAIT))
+
+/* State names and groups accepted after "state" / "exclude" */
+static const struct {
+    const char *name;
+    uint16_t mask;
+} state_names[] = {
+    { "established",  STATE_BIT(SS_TCP_ESTABLISHED) },
+    { "estab",        STATE_BIT(SS_TCP_ESTABLISHED) },
+    { "syn-sent",     STATE_BIT(SS_TCP_SYN_SENT) },
+    { "syn-recv",     STATE_BIT(SS_TCP_SYN_RECV) },
+    { "syn-rcvd",     STATE_BIT(SS_TCP_SYN_RECV) },     /* netstat spelling */
+    { "fin-wait-1",   STATE_BIT(SS_TCP_FIN_WAIT1) },
+    { "fin-wait-2",   STATE_BIT(SS_TCP_FIN_WAIT2) },
+    { "time-wait",    STATE_BIT(SS_TCP_TIME_WAIT) },
+    { "closed",       STATE_BIT(SS_TCP_CLOSED) },
+    { "close-wait",   STATE_BIT(SS_TCP_CLOSE_WAIT) },
+    { "last-ack",     STATE_BIT(SS_TCP_LAST_ACK) },
+    { "listening",    STATE_BIT(SS_TCP_LISTEN) },
+    { "listen",       STATE_BIT(SS_TCP_LISTEN) },
+    { "closing",      STATE_BIT(SS_TCP_CLOSING) },
+    { "all",          STATES_ALL },
+    { "connected",    STATES_CONNECTED },
+    { "synchronized", STATES_CONNECTED & ~STATE_BIT(SS_TCP_SYN_SENT) },
+    { "bucket",       STATES_BUCKET },
+    { "big",          STATES_ALL & ~STATES_BUCKET },
+};
+
+/* Parser state: the argument text split into tokens */
+typedef struct {
+    char **toks;
+    int count;
+    int pos;
+    ss_filter_t *out;
+    int cap;
+    int depth;              /* Operand stack depth after the emitted code */
+    int max_depth;
+    int nest;               /* Open '(' and 'not' around the current term */
+} parser_t;
+
+static const char *peek(const parser_t *p)
+{
+    return p->pos < p->count ? p->toks[p->pos] : NULL;
+}
+
+static bool accept_tok(parser_t *p, const char *a, const char *b)
+{
+    const char *t = peek(p);
+    if (t && (strcmp(t, a) == 0 || (b && strcmp(t, b) == 0))) {
+        p->pos++;
+        return true;
+    }
+    return false;
+}
+
+static bool emit(parser_t *p, const ss_filter_insn_t *insn)
+{
+    if (p->out->len == p->cap) {
+        int new_cap = p->cap ? p->cap * 2 : 16;
+        ss_filter_insn_t *prog = realloc(p->out->prog, (size_t)new_cap * sizeof(*prog));
+        if (!prog) {
+            perror("realloc");
+            return false;
+        }
+        p->out->prog = prog;
+        p->cap = new_cap;
+    }
+    p->out->prog[p->out->len++] = *insn;
+
+    /* Terms push one operand, and/or pop two and push one */
+    if (insn->op == FOP_AND || insn->op == FOP_OR) {
+        p->depth--;
+    } else if (insn->op != FOP_NOT) {
+        p->depth++;
+    }
+    if (p->depth > p->max_depth) {
+        p->max_depth = p->depth;
+    }
+    return true;
+}
+
+static bool emit_op(parser_t *p, uint8_t op)
+{
+    ss_filter_insn_t insn = { .op = op };
+    return emit(p, &insn);
+}
+
+/* Split the arguments into tokens: words, "(", ")" and operator runs */
+static bool tokenize(int argc, char **argv, parser_t *p)
+{
+    static const char opchars[] = "=!<>&|";
+    int cap = 0;
+
+    for (int i = 0; i < argc; i++) {
+        const char *s = argv[i];
+        while (*s) {
+            if (*s == ' ' || *s == '\t' || *s == '\n') {
+                s++;
+                continue;
+            }
+            size_t len;
+            if (*s == '(' || *s == ')') {
+                len = 1;
+            } else if (strchr(opchars, *s)) {
+                len = strspn(s, opchars);
+            } else {
+                len = strcspn(s, " \t\n()=!<>&|");
+            }
+            if (p->count == cap) {
+                cap = cap ? cap * 2 : 32;
+                char **toks = realloc(p->toks, (size_t)cap * sizeof(char *));
+                if (!toks) {
+                    perror("realloc");
+                    return false;
+                }
+                p->toks = toks;
+            }
+            p->toks[p->count] = strndup(s, len);
+            if (!p->toks[p->count]) {
+                perror("strndup");
+                return false;
+            }
+            p->count++;
+            s += len;
+        }
+    }
+    return true;
+}
+
+/* Port number or service name, with an optional leading ':' */
+static bool parse_port(const char *s, uint16_t *port)
+{
+    if (*s == ':') {
+        s++;
+    }
+    if (*s == '*' && s[1] == '\0') {
+        *port = 0;
+        return true;
+    }
+    char *end;
+    unsigned long v = strtoul(s, &end, 10);
+    if (end != s && *end == '\0' && v <= 65535) {
+        *port = (uint16_t)v;
+        return true;
+    }
+    struct servent *se = getservbyname(s, NULL);
+    if (se) {
+        *port = ntohs((uint16_t)se->s_port);
+        return true;
+    }
+    return false;
+}
+
+/*
+ * Address pattern: "*", "ADDR", "ADDR/LEN", each optionally followed by
+ * ":PORT"; IPv6 addresses with a port are written "[ADDR]:PORT". ":PORT"
+ * alone matches any address.
+ */
+static bool parse_addr(const char *s, ss_filter_insn_t *insn)
+{
+    char host[INET6_ADDRSTRLEN + 8];
+    const char *port = NULL;
+    const char *end;
+
+    insn->family = SS_FAMILY_UNKNOWN;
+    insn->prefix = 0;
+    insn->port = 0;
+
+    if (*s == '[') {
+        end = strchr(s, ']');
+        if (!end) {
+            return false;
+        }
+        s++;
+        if (end[1] == ':') {
+            port = end + 2;
+        } else if (end[1] != '\0' && end[1] != '/') {
+            return false;
+        }
+        /* Keep a "/LEN" written after the bracket */
+        size_t n = (size_t)(end - s);
+        if (n >= sizeof(host)) {
+            return false;
+        }
+        memcpy(host, s, n);
+        host[n] = '\0';
+        if (end[1] == '/') {
+            if (strlen(host) + strlen(end + 1) >= sizeof(host)) {
+                return false;
+            }
+            strcat(host, end + 1);
+        }
+    } else {
+        const char *colon = strchr(s, ':');
+        if (colon && strchr(colon + 1, ':') == NULL) {
+            /* One colon: IPv4 or "*" with a port */
+            port = colon + 1;
+            end = colon;
+        } else {
+            /* No colon, or a bare IPv6 address */
+            end = s + strlen(s);
+        }
+        size_t n = (size_t)(end - s);
+        if (n >= sizeof(host)) {
+            return false;
+        }
+        memcpy(host, s, n);
+        host[n] = '\0';
+    }
+
+    if (port && !parse_port(port, &insn->port)) {
+        return false;
+    }
+    if (host[0] == '\0' || strcmp(host, "*") == 0) {
+        return true;
+    }
+
+    char *slash = strchr(host, '/');
+    long prefix = -1;
+    if (slash) {
+        char *pend;
+        *slash = '\0';
+        prefix = strtol(slash + 1, &pend, 10);
+        if (pend == slash + 1 || *pend != '\0' || prefix < 0) {
+            return false;
+        }
+    }
+
+    if (inet_pton(AF_INET, host, insn->addr) == 1) {
+        insn->family = SS_FAMILY_INET;
+        if (prefix > 32) {
+            return false;
+        }
+        insn->prefix = (uint8_t)(prefix < 0 ? 32 : prefix);
+    } else if (inet_pton(AF_INET6, host, insn->addr) == 1) {
+        insn->family = SS_FAMILY_INET6;
+        if (prefix > 128) {
+            return false;
+        }
+        insn->prefix = (uint8_t)(prefix < 0 ? 128 : prefix);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static bool parse_cmp(parser_t *p, uint8_t *cmp)
+{
+    static const struct {
+        const char *a, *b, *c;
+        uint8_t cmp;
+    } ops[] = {
+        { "=",  "==", "eq",  FCMP_EQ },
+        { "!=", "ne", "neq", FCMP_NE },
+        { "<",  "lt", NULL,  FCMP_LT },
+        { ">",  "gt", NULL,  FCMP_GT },
+        { "<=", "le", NULL,  FCMP_LE },
+        { ">=", "ge", NULL,  FCMP_GE },
+    };
+    const char *t = peek(p);
+
+    for (size_t i = 0; t && i < sizeof(ops) / sizeof(ops[0]); i++) {
+        if (strcmp(t, ops[i].a) == 0 || strcmp(t, ops[i].b) == 0 ||
+            (ops[i].c && strcmp(t, ops[i].c) == 0)) {
+            *cmp = ops[i].cmp;
+            p->pos++;
+            return true;
+        }
+    }
+    /* "sport :22" means equality */
+    *cmp = FCMP_EQ;
+    return true;
+}
+
+static bool parse_or(parser_t *p);
+
+static bool parse_term(parser_t *p)
+{
+    const char *t = peek(p);
+    if (!t) {
+        fprintf(stderr, "ss: filter: unexpected end of expression\n");
+        return false;
+    }
+
+    bool paren = accept_tok(p, "(", NULL);
+    if (paren || accept_tok(p, "not", "!")) {
+        /* Bound the recursion before it can exhaust the stack */
+        if (p->nest == FILTER_MAX_NEST) {
+            fprintf(stderr, "ss: filter: expression too deeply nested\n");
+            return false;
+        }
+        p->nest++;
+        bool ok = paren ? parse_or(p) : parse_term(p);
+        p->nest--;
+        if (!ok) {
+            return false;
+        }
+        if (!paren) {
+            return emit_op(p, FOP_NOT);
+        }
+        if (!accept_tok(p, ")", NULL)) {
+            fprintf(stderr, "ss: filter: missing ')'\n");
+            return false;
+        }
+        return true;
+    }
+
+    ss_filter_insn_t insn = {0};
+    bool is_port = false;
+    if (accept_tok(p, "sport", NULL)) {
+        insn.op = FOP_SPORT;
+        is_port = true;
+    } else if (accept_tok(p, "dport", NULL)) {
+        insn.op = FOP_DPORT;
+        is_port = true;
+    } else if (accept_tok(p, "src", NULL)) {
+        insn.op = FOP_SRC;
+    } else if (accept_tok(p, "dst", NULL)) {
+        insn.op = FOP_DST;
+    } else {
+        fprintf(stderr, "ss: filter: unexpected '%s'\n", t);
+        return false;
+    }
+
+    if (!parse_cmp(p, &insn.cmp)) {
+        return false;
+    }
+    const char *val = peek(p);
+    if (!val) {
+        fprintf(stderr, "ss: filter: missing value after '%s'\n", t);
+        return false;
+    }
+    p->pos++;
+
+    bool ok = is_port ? parse_port(val, &insn.port) : parse_addr(val, &insn);
+    if (!ok) {
+        fprintf(stderr, "ss: filter: bad %s '%s'\n", is_port ? "port" : "address", val);
+        return false;
+    }
+
+    /* src/dst only compare for (in)equality */
+    if (!is_port && insn.cmp != FCMP_EQ) {
+        if (insn.cmp != FCMP_NE) {
+            fprintf(stderr, "ss: filter: '%s' only supports = and !=\n", t);
+            return false;
+        }
+        insn.cmp = FCMP_EQ;
+        return emit(p, &insn) && emit_op(p, FOP_NOT);
+    }
+    return emit(p, &insn);
+}
+
+/* Terms joined by "and", "&&", "&" or nothing at all */
+static bool parse_and(parser_t *p)
+{
+    if (!parse_term(p)) {
+        return false;
+    }
+    for (;;) {
+        const char *t = peek(p);
+        if (!t || strcmp(t, ")") == 0 || strcmp(t, "or") == 0 ||
+            strcmp(t, "||") == 0 || strcmp(t, "|") == 0) {
+            return true;
+        }
+        if (!accept_tok(p, "and", "&&")) {
+            accept_tok(p, "&", NULL);
+        }
+        if (!parse_term(p) || !emit_op(p, FOP_AND)) {
+            return false;
+        }
+    }
+}
+
+static bool parse_or(parser_t *p)
+{
+    if (!parse_and(p)) {
+        return false;
+    }
+    while (accept_tok(p, "or", "||") || accept_tok(p, "|", NULL)) {
+        if (!parse_and(p) || !emit_op(p, FOP_OR)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Index of a state name in state_names, or -1. Case and '_' for '-' are
+ * ignored, so the netstat spellings (ESTABLISHED, TIME_WAIT) work too.
+ */
+static int find_state(const char *name)
+{
+    for (size_t i = 0; name && i < sizeof(state_names) / sizeof(state_names[0]); i++) {
+        const char *a = name, *b = state_names[i].name;
+        while (*a && (tolower((unsigned char)*a) == *b || (*a == '_' && *b == '-'))) {
+            a++;
+            b++;
+        }
+        if (*a == '\0' && *b == '\0') {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+/*
+ * "state NAME" / "exclude NAME" clauses at the start. A bare state name
+ * ("ss -t established") is read as "state NAME", as ss-ios.sh did.
+ */
+static bool parse_states(parser_t *p)
+{
+    for (;;) {
+        bool exclude;
+        if (accept_tok(p, "state", NULL)) {
+            exclude = false;
+        } else if (accept_tok(p, "exclude", "excl")) {
+            exclude = true;
+        } else if (find_state(peek(p)) >= 0) {
+            exclude = false;
+        } else {
+            return true;
+        }
+
+        const char *name = peek(p);
+        int i = find_state(name);
+        if (i < 0) {
+            fprintf(stderr, "ss: filter: unknown state '%s'\n", name ? name : "");
+            return false;
+        }
+        p->pos++;
+
+        if (exclude) {
+            /* Exclusions start from all states */
+            if (!p->out->has_states) {
+                p->out->states = STATES_ALL;
+            }
+            p->out->states &= (uint16_t)~state_names[i].mask;
+        } else {
+            if (!p->out->has_states) {
+                p->out->states = 0;
+            }
+            p->out->states |= state_names[i].mask;
+        }
+        p->out->has_states = true;
+    }
+}
+
+/*
+ * Compile the non-option arguments into filter. Returns false (after a
+ * message on stderr) if they do not parse.
+ */
+bool filter_compile(int argc, char **argv, ss_filter_t *filter)
+{
+    parser_t p = { .out = filter };
+    bool ok;
+
+    memset(filter, 0, sizeof(*filter));
+    ok = tokenize(argc, argv, &p) && parse_states(&p);
+    if (ok && p.pos < p.count) {
+        ok = parse_or(&p);
+        if (ok && p.pos < p.count) {
+            fprintf(stderr, "ss: filter: unexpected '%s'\n", p.toks[p.pos]);
+            ok = false;
+        }
+    }
+    if (ok && p.max_depth > FILTER_MAX_DEPTH) {
+        fprintf(stderr, "ss: filter: expression too deeply nested\n");
+        ok = false;
+    }
+
+    for (int i = 0; i < p.count; i++) {
+        free(p.toks[i]);
+    }
+    free(p.toks);
+    if (!ok) {
+        filter_free(filter);
+    }
+    return ok;
+}
+
+void filter_free(ss_filter_t *filter)
+{
+    free(filter->prog);
+    memset(filter, 0, sizeof(*filter));
+}
+
+/*
+ * Whether the state filter admits a socket. UDP and UNIX records carry no
+ * TCP state: as in Linux ss, a connected one counts as established and
+ * any other as closed.
+ */
+bool filter_state_match(const ss_filter_t *filter, const ss_sock_info_t *sock)
+{
+    ss_tcp_state_t state;
+
+    switch (sock->protocol) {
+        case SS_PROTO_TCP:
+            state = (sock->state == SS_TCP_UNKNOWN) ? SS_TCP_CLOSED
+                                                    : (ss_tcp_state_t)sock->state;
+            break;
+        case SS_PROTO_UDP:
+            state = sock->remote_port ? SS_TCP_ESTABLISHED : SS_TCP_CLOSED;
+            break;
+        default:
+            state = sock->unix_connected ? SS_TCP_ESTABLISHED : SS_TCP_CLOSED;
+            break;
+    }
+    return (filter->states & STATE_BIT(state)) != 0;
+}
+
+static bool port_cmp(uint16_t v, uint8_t cmp, uint16_t port)
+{
+    switch (cmp) {
+        case FCMP_EQ: return v == port;
+        case FCMP_NE: return v != port;
+        case FCMP_LT: return v < port;
+        case FCMP_GT: return v > port;
+        case FCMP_LE: return v <= port;
+        default:      return v >= port;
+    }
+}
+
+static bool addr_match(const ss_filter_insn_t *insn, const ss_sock_info_t *sock,
+                       const ss_addr_t *addr, uint16_t port)
+{
+    if (sock->family != SS_FAMILY_INET && sock->family != SS_FAMILY_INET6) {
+        return false;
+    }
+    if (insn->port != 0 && port != insn->port) {
+        return false;
+    }
+    if (insn->family == SS_FAMILY_UNKNOWN) {
+        return true;
+    }
+    if (insn->family != sock->family) {
+        return false;
+    }
+
+    const uint8_t *a = (const uint8_t *)addr;
+    unsigned bits = insn->prefix;
+    unsigned bytes = bits / 8;
+    if (memcmp(a, insn->addr, bytes) != 0) {
+        return false;
+    }
+    if (bits % 8) {
+        uint8_t mask = (uint8_t)(0xff << (8 - bits % 8));
+        return ((a[bytes] ^ insn->addr[bytes]) & mask) == 0;
+    }
+    return true;
+}
+
+/* Run the expression program on a record */
+bool filter_match(const ss_filter_t *filter, const ss_sock_info_t *sock)
+{
+    bool stack[FILTER_MAX_DEPTH];
+    int sp = 0;
+    bool inet = (sock->family == SS_FAMILY_INET || sock->family == SS_FAMILY_INET6);
+
+    for (int i = 0; i < filter->len; i++) {
+        const ss_filter_insn_t *insn = &filter->prog[i];
+        switch (insn->op) {
+            case FOP_SPORT:
+                stack[sp++] = inet && port_cmp(sock->local_port, insn->cmp, insn->port);
+                break;
+            case FOP_DPORT:
+                stack[sp++] = inet && port_cmp(sock->remote_port, insn->cmp, insn->port);
+                break;
+            case FOP_SRC:
+                stack[sp++] = addr_match(insn, sock, &sock->local_ip, sock->local_port);
+                break;
+            case FOP_DST:
+                stack[sp++] = addr_match(insn, sock, &sock->remote_ip, sock->remote_port);
+                break;
+            case FOP_AND:
+                sp--;
+                stack[sp - 1] = stack[sp - 1] && stack[sp];
+                break;
+            case FOP_OR:
+                sp--;
+                stack[sp - 1] = stack[sp - 1] || stack[sp];
+                break;
+            case FOP_NOT:
+                stack[sp - 1] = !stack[sp - 1];
+                break;
+        }
+    }
+    return sp == 0 || stack[0];
+}
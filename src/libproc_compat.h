@@ -2,16 +2,25 @@
  * libproc compatibility header for iOS
  * These definitions are not included in the iOS SDK but the functions
  * exist on jailbroken devices.
+ *
+ * On Linux there is no libproc at all: SS_NETLINK_BACKEND is defined and
+ * sockets are collected from NETLINK_SOCK_DIAG dumps (sockets_netlink.c).
+ * The structures are still defined there for the synthetic provider.
  */
 
 #ifndef LIBPROC_COMPAT_H
 #define LIBPROC_COMPAT_H
 
-#ifdef IOS_BUILD
-
 #include <sys/types.h>
 #include <stdint.h>
 
+#if defined(IOS_BUILD) || defined(__linux__)
+
+/* libproc structures come from this header rather than the SDK */
+#define SS_COMPAT_STRUCTS 1
+
+#include <netinet/in.h>
+
 /* Process list types */
 #define PROC_ALL_PIDS       1
 #define PROC_PGRP_ONLY      2
@@ -31,7 +40,7 @@
 /* Process info flavors */
 #define PROC_PIDLISTFDS     1
 #define PROC_PIDTBSDINFO    3
-#define PROC_PIDFDSOCKETINFO 8
+#define PROC_PIDFDSOCKETINFO 3
 
 /* Path info max size */
 #define PROC_PIDPATHINFO_MAXSIZE 4096
@@ -68,6 +77,47 @@ struct proc_bsdinfo {
     uint64_t pbi_start_tvusec;
 };
 
+/*
+ * socket_fdinfo and its members below follow <sys/proc_info.h> of
+ * xnu-6153 (iOS 13), which tests/fdinfo/xnu-6153-arm64.txt records. Later
+ * releases move fields, so iOS builds read the kernel's blob through a
+ * calibrated layout (fdinfo_compat.c) rather than casting it to these.
+ */
+
+/* Open file info */
+struct proc_fileinfo {
+    uint32_t fi_openflags;
+    uint32_t fi_status;
+    int64_t  fi_offset;
+    int32_t  fi_type;
+    uint32_t fi_guardflags;
+};
+
+/* stat of the socket's vnode */
+struct vinfo_stat {
+    uint32_t vst_dev;
+    uint16_t vst_mode;
+    uint16_t vst_nlink;
+    uint64_t vst_ino;
+    uid_t    vst_uid;
+    gid_t    vst_gid;
+    int64_t  vst_atime;
+    int64_t  vst_atimensec;
+    int64_t  vst_mtime;
+    int64_t  vst_mtimensec;
+    int64_t  vst_ctime;
+    int64_t  vst_ctimensec;
+    int64_t  vst_birthtime;
+    int64_t  vst_birthtimensec;
+    int64_t  vst_size;
+    int64_t  vst_blocks;
+    int32_t  vst_blksize;
+    uint32_t vst_flags;
+    uint32_t vst_gen;
+    uint32_t vst_rdev;
+    int64_t  vst_qspare[2];
+};
+
 /* Socket buffer info */
 struct sockbuf_info {
     uint32_t sbi_cc;
@@ -79,44 +129,59 @@ struct sockbuf_info {
     short    sbi_timeo;
 };
 
-/* In address union */
+/* IPv4 address in the last 4 bytes of an IPv6-sized slot */
+struct in4in6_addr {
+    uint32_t       i46a_pad32[3];
+    struct in_addr i46a_addr4;
+};
+
+/* Internet address */
 union in_addr_4_6 {
-    struct in_addr  i46a_addr4;
-    struct in6_addr i46a_addr6;
+    struct in4in6_addr ina_46;
+    struct in6_addr    ina_6;
 };
 
-/* Internet address info */
-struct in_addr_info {
-    int                  ina_family;
-    union in_addr_4_6    ina_46;
+/* Internet socket info; ports are network order in the low 16 bits */
+struct in_sockinfo {
+    int                 insi_fport;
+    int                 insi_lport;
+    uint64_t            insi_gencnt;
+    uint32_t            insi_flags;
+    uint32_t            insi_flow;
+    uint8_t             insi_vflag;
+    uint8_t             insi_ip_ttl;
+    uint32_t            rfu_1;
+    union in_addr_4_6   insi_faddr;
+    union in_addr_4_6   insi_laddr;
+    struct {
+        uint8_t         in4_tos;
+    }                   insi_v4;
+    struct {
+        uint8_t         in6_hlim;
+        int             in6_cksum;
+        uint16_t        in6_ifindex;
+        short           in6_hops;
+    }                   insi_v6;
 };
 
+/* tcpsi_timer[] slots */
+#define TSI_T_REXMT         0   /* Retransmit */
+#define TSI_T_PERSIST       1   /* Retransmit persistence */
+#define TSI_T_KEEP          2   /* Keepalive */
+#define TSI_T_2MSL          3   /* 2*MSL quiet time */
+#define TSI_T_NTIMERS       4
+
 /* TCP socket info */
 struct tcp_sockinfo {
-    struct in_addr_info tcpsi_ini;
+    struct in_sockinfo  tcpsi_ini;      /* Shares the in_sockinfo prefix */
     int                 tcpsi_state;
-    int                 tcpsi_timer[4];
-    uint32_t            tcpsi_mss;
+    int                 tcpsi_timer[TSI_T_NTIMERS];
+    int                 tcpsi_mss;
     uint32_t            tcpsi_flags;
     uint32_t            rfu_1;
     uint64_t            tcpsi_tp;
 };
 
-/* Internet socket info */
-struct in_sockinfo {
-    struct in_addr_info insi_laddr;
-    struct in_addr_info insi_faddr;
-    int                 insi_v4;
-    int                 insi_v6;
-    int                 insi_vflag;
-    int                 insi_lport;
-    int                 insi_fport;
-    uint32_t            insi_flags;
-    uint32_t            insi_flow;
-    uint8_t             insi_ip_ttl;
-    uint32_t            rfu_1;
-};
-
 /* UNIX socket address */
 struct un_sockaddr_un {
     uint8_t  sun_len;
@@ -124,10 +189,10 @@ struct un_sockaddr_un {
     char     sun_path[104];
 };
 
-/* UNIX address */
+/* UNIX address (SOCK_MAXADDRLEN bytes) */
 union un_addr {
     struct un_sockaddr_un ua_sun;
-    char                  ua_dummy[256];
+    char                  ua_dummy[255];
 };
 
 /* UNIX socket info */
@@ -145,6 +210,9 @@ union proto_info {
     struct un_sockinfo  pri_un;
 };
 
+/* IPv6 member of an in_sockinfo address */
+#define INSI_ADDR6(ina)     ((ina).ina_6)
+
 /* Socket info kinds */
 #define SOCKINFO_GENERIC    0
 #define SOCKINFO_IN         1
@@ -153,9 +221,9 @@ union proto_info {
 
 /* Socket info structure */
 struct socket_info {
-    struct sockbuf_info soi_rcv;
-    struct sockbuf_info soi_snd;
-    int                 soi_so;
+    struct vinfo_stat   soi_stat;
+    uint64_t            soi_so;
+    uint64_t            soi_pcb;
     int                 soi_type;
     int                 soi_protocol;
     int                 soi_family;
@@ -168,17 +236,23 @@ struct socket_info {
     short               soi_timeo;
     uint16_t            soi_error;
     uint32_t            soi_oobmark;
-    uint32_t            rfu_1;
+    struct sockbuf_info soi_rcv;
+    struct sockbuf_info soi_snd;
     int                 soi_kind;
+    uint32_t            rfu_1;
     union proto_info    soi_proto;
 };
 
 /* Socket FD info structure */
 struct socket_fdinfo {
-    struct proc_fdinfo pfi;
-    struct socket_info psi;
+    struct proc_fileinfo pfi;
+    struct socket_info   psi;
 };
 
+#endif /* IOS_BUILD || __linux__ */
+
+#if defined(IOS_BUILD)
+
 /* Function declarations */
 extern int proc_listpids(uint32_t type, uint32_t typeinfo, void *buffer, int buffersize);
 extern int proc_pidinfo(int pid, int flavor, uint64_t arg, void *buffer, int buffersize);
@@ -186,11 +260,35 @@ extern int proc_pidfdinfo(int pid, int fd, int flavor, void *buffer, int buffers
 extern int proc_pidpath(int pid, void *buffer, uint32_t buffersize);
 extern int proc_name(int pid, void *buffer, uint32_t buffersize);
 
-#else /* !IOS_BUILD */
+#elif defined(__linux__)
+
+/* Socket collection backend: sock_diag netlink dumps instead of libproc */
+#define SS_NETLINK_BACKEND 1
+
+#else /* !IOS_BUILD && !__linux__ */
 
 #include <libproc.h>
 #include <sys/proc_info.h>
 
+/* IPv6 member of an in_sockinfo address */
+#define INSI_ADDR6(ina)     ((ina).ina_6)
+
 #endif /* IOS_BUILD */
 
+/*
+ * libproc provider: the calls made by the PID/fd walker in sockets.c.
+ * The system provider forwards to libproc; the synthetic provider
+ * (synthetic.c) answers them in-process from a generated population.
+ */
+typedef struct ss_libproc_ops {
+    const char *name;
+    int (*listpids)(uint32_t type, uint32_t typeinfo, void *buffer, int buffersize);
+    int (*pidinfo)(int pid, int flavor, uint64_t arg, void *buffer, int buffersize);
+    int (*pidfdinfo)(int pid, int fd, int flavor, void *buffer, int buffersize);
+    int (*pidpath)(int pid, void *buffer, uint32_t buffersize);
+    int (*procname)(int pid, void *buffer, uint32_t buffersize);
+} ss_libproc_ops_t;
+
+extern const ss_libproc_ops_t synthetic_libproc;
+
 #endif /* LIBPROC_COMPAT_H */
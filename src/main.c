@@ -8,16 +8,58 @@
 #include <string.h>
 #include <getopt.h>
 #include <unistd.h>
+#include <pwd.h>
 #include "ss.h"
 
+/* Long-only options */
+enum {
+    OPT_COLLECTOR = 256,
+    OPT_SYNTHETIC,
+    OPT_JSON,
+    OPT_NDJSON,
+    OPT_CSV,
+    OPT_INTERVAL,
+    OPT_COUNT,
+    OPT_UID,
+    OPT_PGRP,
+    OPT_PID,
+    OPT_SRC_FILE,
+    OPT_DST_FILE,
+    OPT_SELF_STATS,
+    OPT_TRACE,
+    OPT_SAVE,
+    OPT_LOAD,
+    OPT_DAEMON,
+    OPT_SHM,
+    OPT_QUERY,
+    OPT_PUBLIC,
+    OPT_SORT,
+    OPT_TOP,
+    OPT_GROUP_BY
+};
+
+/* PIDs listed by --self-stats without a count */
+#define SELF_STATS_TOP 10
+
+/* Order of --top without --sort: the fullest queues */
+#define TOP_DEFAULT_SORT "recvq,sendq"
+
 static void parse_args(int argc, char *argv[], ss_options_t *opts);
-static void collect_and_display(const ss_options_t *opts);
-static void calculate_stats(ss_sock_info_t *list, ss_stats_t *stats);
+static bool parse_pid_list(const char *arg, ss_options_t *opts);
+static int collect_and_display(const ss_options_t *opts);
+static int serve_query(int argc, char **argv, const ss_sock_table_t *table);
+
+/* Parsing a --query request inside the daemon */
+static bool parsing_query;
 
 int main(int argc, char *argv[])
 {
     ss_options_t opts = {0};
     
+    /* Installed as ssd: the resident collector */
+    const char *base = strrchr(argv[0], '/');
+    opts.daemon = strcmp(base ? base + 1 : argv[0], "ssd") == 0;
+    
     /* Parse command line arguments */
     parse_args(argc, argv, &opts);
     
@@ -38,10 +80,28 @@ int main(int argc, char *argv[])
         opts.show_udp = true;
     }
     
+    /* Resident collector, or a query answered by it */
+    if (opts.daemon) {
+        return daemon_run(&opts, serve_query) < 0 ? 1 : 0;
+    }
+    if (opts.query_path) {
+        return daemon_query(opts.query_path, argc, argv) < 0 ? 1 : 0;
+    }
+    
+    if (opts.self_stats || opts.trace_file) {
+        selfstats_start();
+    }
+    
+    /* Watch mode: redisplay every --interval seconds */
+    if (opts.watch) {
+        int ret = watch_sockets(&opts);
+        return (selfstats_finish(&opts) < 0 || ret < 0) ? 1 : 0;
+    }
+    
     /* Collect and display socket information */
-    collect_and_display(&opts);
+    int ret = collect_and_display(&opts);
     
-    return 0;
+    return (selfstats_finish(&opts) < 0 || ret < 0) ? 1 : 0;
 }
 
 static void parse_args(int argc, char *argv[], ss_options_t *opts)
@@ -55,19 +115,62 @@ static void parse_args(int argc, char *argv[], ss_options_t *opts)
         {"numeric",   no_argument, 0, 'n'},
         {"processes", no_argument, 0, 'p'},
         {"extended",  no_argument, 0, 'e'},
+        {"info",      no_argument, 0, 'i'},
+        {"options",   no_argument, 0, 'o'},
         {"summary",   no_argument, 0, 's'},
         {"ipv4",      no_argument, 0, '4'},
         {"ipv6",      no_argument, 0, '6'},
+        {"no-header", no_argument, 0, 'H'},
         {"version",   no_argument, 0, 'V'},
         {"help",      no_argument, 0, 'h'},
+        {"threads",   required_argument, 0, 'j'},
+        {"collector", required_argument, 0, OPT_COLLECTOR},
+        {"synthetic", required_argument, 0, OPT_SYNTHETIC},
+        {"json",      no_argument, 0, OPT_JSON},
+        {"ndjson",    no_argument, 0, OPT_NDJSON},
+        {"csv",       no_argument, 0, OPT_CSV},
+        {"interval",  required_argument, 0, OPT_INTERVAL},
+        {"count",     required_argument, 0, OPT_COUNT},
+        {"uid",       required_argument, 0, OPT_UID},
+        {"pgrp",      required_argument, 0, OPT_PGRP},
+        {"pid",       required_argument, 0, OPT_PID},
+        {"src-file",  required_argument, 0, OPT_SRC_FILE},
+        {"dst-file",  required_argument, 0, OPT_DST_FILE},
+        {"self-stats", optional_argument, 0, OPT_SELF_STATS},
+        {"trace",     required_argument, 0, OPT_TRACE},
+        {"save",      required_argument, 0, OPT_SAVE},
+        {"load",      required_argument, 0, OPT_LOAD},
+        {"daemon",    no_argument, 0, OPT_DAEMON},
+        {"shm",       optional_argument, 0, OPT_SHM},
+        {"query",     optional_argument, 0, OPT_QUERY},
+        {"public",    no_argument, 0, OPT_PUBLIC},
+        {"sort",      required_argument, 0, OPT_SORT},
+        {"top",       required_argument, 0, OPT_TOP},
+        {"group-by",  required_argument, 0, OPT_GROUP_BY},
         {0, 0, 0, 0}
     };
     
     int opt;
     int option_index = 0;
     
-    while ((opt = getopt_long(argc, argv, "tuxlanpes46Vh", 
+    while ((opt = getopt_long(argc, argv, "tuxlanpeios46HVhj:", 
                                long_options, &option_index)) != -1) {
+        /* A query runs with the daemon's privileges: nothing that opens a file */
+        if (parsing_query) {
+            switch (opt) {
+                case OPT_SRC_FILE:
+                case OPT_DST_FILE:
+                case OPT_SELF_STATS:
+                case OPT_TRACE:
+                case OPT_SAVE:
+                case OPT_LOAD:
+                case OPT_DAEMON:
+                case OPT_PUBLIC:
+                    fprintf(stderr, "%s: --%s is not available in a query\n", argv[0],
+                            long_options[option_index].name);
+                    exit(1);
+            }
+        }
         switch (opt) {
             case 't':
                 opts->show_tcp = true;
@@ -93,6 +196,12 @@ static void parse_args(int argc, char *argv[], ss_options_t *opts)
             case 'e':
                 opts->extended = true;
                 break;
+            case 'i':
+                opts->tcp_info = true;
+                break;
+            case 'o':
+                opts->timers = true;
+                break;
             case 's':
                 opts->summary = true;
                 break;
@@ -102,117 +211,477 @@ static void parse_args(int argc, char *argv[], ss_options_t *opts)
             case '6':
                 opts->ipv6_only = true;
                 break;
+            case 'H':
+                opts->no_header = true;
+                break;
             case 'V':
                 opts->version = true;
                 break;
             case 'h':
                 opts->help = true;
                 break;
+            case 'j': {
+                char *end;
+                long n = strtol(optarg, &end, 10);
+                if (end == optarg || *end != '\0' || n < 0 || n > 1024) {
+                    fprintf(stderr, "%s: invalid thread count '%s'\n", argv[0], optarg);
+                    exit(1);
+                }
+                /* -j 0: one worker per online CPU */
+                if (n == 0) {
+                    n = sysconf(_SC_NPROCESSORS_ONLN);
+                }
+                opts->threads = (int)n;
+                break;
+            }
+            case OPT_COLLECTOR:
+                if (!find_collector(optarg)) {
+                    fprintf(stderr, "%s: unknown collector '%s'\n", argv[0], optarg);
+                    exit(1);
+                }
+                opts->collector = optarg;
+                break;
+            case OPT_SYNTHETIC:
+                if (!synthetic_configure(optarg)) {
+                    exit(1);
+                }
+                opts->collector = "synthetic";
+                break;
+            case OPT_JSON:
+                opts->format = SS_FORMAT_JSON;
+                break;
+            case OPT_NDJSON:
+                opts->format = SS_FORMAT_NDJSON;
+                break;
+            case OPT_CSV:
+                opts->format = SS_FORMAT_CSV;
+                break;
+            case OPT_INTERVAL: {
+                char *end;
+                double secs = strtod(optarg, &end);
+                if (end == optarg || *end != '\0' || !(secs >= 0 && secs <= 86400)) {
+                    fprintf(stderr, "%s: invalid interval '%s'\n", argv[0], optarg);
+                    exit(1);
+                }
+                opts->interval = secs;
+                opts->watch = true;
+                break;
+            }
+            case OPT_COUNT: {
+                char *end;
+                long n = strtol(optarg, &end, 10);
+                if (end == optarg || *end != '\0' || n < 0) {
+                    fprintf(stderr, "%s: invalid count '%s'\n", argv[0], optarg);
+                    exit(1);
+                }
+                /* --count 0: until interrupted */
+                opts->count = n;
+                break;
+            }
+            case OPT_UID: {
+                char *end;
+                long n = strtol(optarg, &end, 10);
+                if (end == optarg || *end != '\0') {
+                    struct passwd *pw = getpwnam(optarg);
+                    if (!pw) {
+                        fprintf(stderr, "%s: unknown user '%s'\n", argv[0], optarg);
+                        exit(1);
+                    }
+                    n = (long)pw->pw_uid;
+                } else if (n < 0) {
+                    fprintf(stderr, "%s: invalid uid '%s'\n", argv[0], optarg);
+                    exit(1);
+                }
+                opts->uid = (uid_t)n;
+                opts->filter_uid = true;
+                break;
+            }
+            case OPT_PGRP: {
+                char *end;
+                long n = strtol(optarg, &end, 10);
+                if (end == optarg || *end != '\0' || n <= 0) {
+                    fprintf(stderr, "%s: invalid process group '%s'\n", argv[0], optarg);
+                    exit(1);
+                }
+                opts->pgrp = (pid_t)n;
+                opts->filter_pgrp = true;
+                break;
+            }
+            case OPT_PID:
+                if (!parse_pid_list(optarg, opts)) {
+                    fprintf(stderr, "%s: invalid pid list '%s'\n", argv[0], optarg);
+                    exit(1);
+                }
+                break;
+            case OPT_SRC_FILE:
+            case OPT_DST_FILE: {
+                /* Repeated options add to the same list */
+                static ss_cidr_trie_t src_cidrs, dst_cidrs;
+                ss_cidr_trie_t *trie = (opt == OPT_SRC_FILE) ? &src_cidrs : &dst_cidrs;
+                if (cidr_trie_load(trie, optarg) < 0) {
+                    exit(1);
+                }
+                if (opt == OPT_SRC_FILE) {
+                    opts->src_cidrs = trie;
+                } else {
+                    opts->dst_cidrs = trie;
+                }
+                break;
+            }
+            case OPT_SELF_STATS: {
+                long n = SELF_STATS_TOP;
+                if (optarg) {
+                    char *end;
+                    n = strtol(optarg, &end, 10);
+                    if (end == optarg || *end != '\0' || n < 0 || n > 100000) {
+                        fprintf(stderr, "%s: invalid PID count '%s'\n", argv[0], optarg);
+                        exit(1);
+                    }
+                }
+                opts->self_stats = true;
+                opts->self_stats_top = (int)n;
+                break;
+            }
+            case OPT_TRACE:
+                opts->trace_file = optarg;
+                break;
+            case OPT_SAVE:
+                opts->save_file = optarg;
+                break;
+            case OPT_LOAD:
+                opts->load_file = optarg;
+                break;
+            case OPT_DAEMON:
+                opts->daemon = true;
+                break;
+            case OPT_SHM:
+                opts->shm_name = optarg ? optarg : SSD_SHM_NAME;
+                break;
+            case OPT_QUERY:
+                opts->query_path = optarg ? optarg : SSD_QUERY_PATH;
+                break;
+            case OPT_PUBLIC:
+                opts->daemon_public = true;
+                break;
+            case OPT_SORT:
+                if (!sort_parse(optarg, &opts->sort)) {
+                    fprintf(stderr, "%s: invalid sort '%s' (fields: recvq, sendq, sport, dport, "
+                            "src, dst, state, pid, process)\n", argv[0], optarg);
+                    exit(1);
+                }
+                break;
+            case OPT_TOP: {
+                char *end;
+                long n = strtol(optarg, &end, 10);
+                if (end == optarg || *end != '\0' || n <= 0) {
+                    fprintf(stderr, "%s: invalid count '%s'\n", argv[0], optarg);
+                    exit(1);
+                }
+                opts->top = (size_t)n;
+                break;
+            }
+            case OPT_GROUP_BY:
+                if (!agg_parse(optarg, &opts->group_by)) {
+                    fprintf(stderr, "%s: invalid grouping '%s' (process, remote[/V4[/V6]], "
+                            "lport, state)\n", argv[0], optarg);
+                    exit(1);
+                }
+                break;
             default:
                 print_help(argv[0]);
                 exit(1);
         }
     }
+    
+    /* Groups replace the socket rows; --top keeps the largest groups */
+    if (opts->group_by.by) {
+        if (opts->summary || opts->sort.num_keys || opts->watch || opts->save_file || opts->daemon) {
+            fprintf(stderr, "%s: --group-by cannot be combined with %s\n", argv[0],
+                    opts->summary ? "-s" : opts->sort.num_keys ? "--sort" :
+                    opts->save_file ? "--save" : opts->daemon ? "--daemon" : "--interval");
+            exit(1);
+        }
+        if (opts->group_by.by == SS_GROUP_BY_PROCESS) {
+            opts->show_process = true;
+        }
+    } else if (opts->top && opts->sort.num_keys == 0) {
+        sort_parse(TOP_DEFAULT_SORT, &opts->sort);
+    }
+    if (opts->sort.num_keys && opts->watch && !opts->daemon) {
+        fprintf(stderr, "%s: --sort and --top cannot be combined with --interval\n", argv[0]);
+        exit(1);
+    }
+    
+    /* A snapshot has no live processes to watch or process groups to match */
+    const char *snapshot = opts->load_file ? "--load" : opts->shm_name ? "--shm" : NULL;
+    if (opts->daemon_public && !opts->daemon) {
+        fprintf(stderr, "%s: --public only applies to --daemon\n", argv[0]);
+        exit(1);
+    }
+    if (opts->daemon) {
+        if (opts->save_file || opts->load_file) {
+            fprintf(stderr, "%s: the daemon cannot be combined with %s\n", argv[0],
+                    opts->save_file ? "--save" : "--load");
+            exit(1);
+        }
+    } else if (snapshot && (opts->save_file || opts->query_path || (opts->load_file && opts->shm_name) ||
+                            opts->watch || opts->filter_pgrp)) {
+        fprintf(stderr, "%s: %s cannot be combined with %s\n", argv[0], snapshot,
+                opts->save_file ? "--save" : opts->query_path ? "--query" :
+                (opts->load_file && opts->shm_name) ? "--shm" :
+                opts->watch ? "--interval" : "--pgrp");
+        exit(1);
+    } else if ((opts->save_file || opts->query_path) && opts->watch) {
+        fprintf(stderr, "%s: %s cannot be combined with --interval\n", argv[0],
+                opts->save_file ? "--save" : "--query");
+        exit(1);
+    }
+    
+    /* Remaining arguments: [ state STATE ... ] [ EXPRESSION ] */
+    if (optind < argc && !filter_compile(argc - optind, argv + optind, &opts->filter)) {
+        exit(1);
+    }
 }
 
-static void collect_and_display(const ss_options_t *opts)
+/* --pid=PID[,PID...]; repeated options add to the list */
+static bool parse_pid_list(const char *arg, ss_options_t *opts)
 {
-    ss_sock_info_t *list = NULL;
-    ss_stats_t stats = {0};
-    
-    /* Collect all sockets */
-    list = collect_all_sockets(opts);
+    static pid_t *pids;
+    static int cap;
+    int n = opts->num_pids;
+
+    for (const char *p = arg; ; ) {
+        char *end;
+        long pid = strtol(p, &end, 10);
+        if (end == p || pid <= 0 || (*end != ',' && *end != '\0')) {
+            return false;
+        }
+        if (n == cap) {
+            int new_cap = cap ? cap * 2 : 16;
+            pid_t *grown = realloc(pids, (size_t)new_cap * sizeof(pid_t));
+            if (!grown) {
+                return false;
+            }
+            pids = grown;
+            cap = new_cap;
+        }
+        pids[n++] = (pid_t)pid;
+        if (*end == '\0') {
+            break;
+        }
+        p = end + 1;
+    }
+
+    opts->pids = pids;
+    opts->num_pids = n;
+    return true;
+}
+
+/*
+ * Print in --sort order, at most --top records. With a snapshot the
+ * records are filtered first; a collected table holds only matches.
+ */
+static int print_sorted(const ss_options_t *opts, const ss_sock_table_t *table, bool snapshot)
+{
+    uint32_t *idx = malloc((table->count ? table->count : 1) * sizeof(uint32_t));
+    if (!idx) {
+        perror("malloc");
+        return -1;
+    }
+    size_t n = 0;
+    for (int g = 0; g < SS_GROUP_COUNT; g++) {
+        if (snapshot && !snapshot_group_shown((ss_group_t)g, opts)) {
+            continue;
+        }
+        for (size_t i = table->group_start[g]; i < table->group_start[g + 1]; i++) {
+            if (!snapshot || snapshot_include(&table->recs[i], opts)) {
+                idx[n++] = (uint32_t)i;
+            }
+        }
+    }
+    if (!sort_indices(&opts->sort, table, idx, n)) {
+        perror("malloc");
+        free(idx);
+        return -1;
+    }
+    if (opts->top && n > opts->top) {
+        n = opts->top;
+    }
     
+    print_begin(opts);
+    for (size_t i = 0; i < n; i++) {
+        print_row(table, &table->recs[idx[i]], opts);
+    }
+    print_end(opts);
+    free(idx);
+    return 0;
+}
+
+/* List or summarize a snapshot (--load, --shm or a query), filtering as it goes */
+static int print_snapshot(const ss_options_t *opts, const ss_sock_table_t *table)
+{
     if (opts->summary) {
-        /* Calculate and print statistics */
-        calculate_stats(list, &stats);
-        print_summary(&stats);
-    } else {
-        /* Print header and sockets */
-        print_header(opts);
-        
-        /* Print UDP first (Linux ss order) */
-        for (ss_sock_info_t *s = list; s != NULL; s = s->next) {
-            if (s->protocol == SS_PROTO_UDP) {
-                print_socket(s, opts);
+        ss_stats_t stats = {0};
+        for (int g = 0; g < SS_GROUP_COUNT; g++) {
+            if (!snapshot_group_shown((ss_group_t)g, opts)) {
+                continue;
+            }
+            for (size_t i = table->group_start[g]; i < table->group_start[g + 1]; i++) {
+                if (snapshot_include(&table->recs[i], opts)) {
+                    stats_add(&stats, &table->recs[i]);
+                }
             }
         }
-        
-        /* Then print TCP */
-        for (ss_sock_info_t *s = list; s != NULL; s = s->next) {
-            if (s->protocol == SS_PROTO_TCP) {
-                print_socket(s, opts);
+        print_totals(&stats, opts);
+        return 0;
+    }
+    
+    if (opts->group_by.by) {
+        ss_agg_t agg;
+        if (!agg_init(&agg, &opts->group_by)) {
+            perror("malloc");
+            return -1;
+        }
+        for (int g = 0; g < SS_GROUP_COUNT; g++) {
+            if (!snapshot_group_shown((ss_group_t)g, opts)) {
+                continue;
+            }
+            for (size_t i = table->group_start[g]; i < table->group_start[g + 1]; i++) {
+                if (snapshot_include(&table->recs[i], opts)) {
+                    agg_add(&agg, &table->recs[i]);
+                }
             }
         }
-        
-        /* Finally print UNIX sockets */
-        for (ss_sock_info_t *s = list; s != NULL; s = s->next) {
-            if (s->protocol == SS_PROTO_UNIX_STREAM || 
-                s->protocol == SS_PROTO_UNIX_DGRAM) {
-                print_socket(s, opts);
+        selfstats_phase_begin(SS_PHASE_OUTPUT);
+        int ret = agg_print(&agg, table, opts);
+        selfstats_phase_end(SS_PHASE_OUTPUT);
+        agg_free(&agg);
+        return ret;
+    }
+    
+    selfstats_phase_begin(SS_PHASE_OUTPUT);
+    if (opts->sort.num_keys) {
+        int ret = print_sorted(opts, table, true);
+        selfstats_phase_end(SS_PHASE_OUTPUT);
+        return ret;
+    }
+    print_begin(opts);
+    for (int g = 0; g < SS_GROUP_COUNT; g++) {
+        if (!snapshot_group_shown((ss_group_t)g, opts)) {
+            continue;
+        }
+        for (size_t i = table->group_start[g]; i < table->group_start[g + 1]; i++) {
+            if (snapshot_include(&table->recs[i], opts)) {
+                print_row(table, &table->recs[i], opts);
             }
         }
     }
+    print_end(opts);
+    selfstats_phase_end(SS_PHASE_OUTPUT);
+    return 0;
+}
+
+/* One --query request, in a child of the daemon holding its latest table */
+static int serve_query(int argc, char **argv, const ss_sock_table_t *table)
+{
+    ss_options_t opts = {0};
     
-    /* Cleanup */
-    free_socket_list(list);
+    optind = 1;
+#if defined(__APPLE__)
+    optreset = 1;
+#endif
+    parsing_query = true;
+    parse_args(argc, argv, &opts);
+    if (opts.watch || opts.filter_pgrp) {
+        fprintf(stderr, "ss: --interval and --pgrp are not available in a query\n");
+        return -1;
+    }
+    if (opts.version) {
+        print_version();
+        return 0;
+    }
+    if (opts.help) {
+        print_help(argv[0]);
+        return 0;
+    }
+    if (!opts.show_tcp && !opts.show_udp && !opts.show_unix) {
+        opts.show_tcp = true;
+        opts.show_udp = true;
+    }
+    return print_snapshot(&opts, table);
 }
 
-static void calculate_stats(ss_sock_info_t *list, ss_stats_t *stats)
+static int collect_and_display(const ss_options_t *opts)
 {
-    for (ss_sock_info_t *s = list; s != NULL; s = s->next) {
-        switch (s->protocol) {
-            case SS_PROTO_TCP:
-                stats->tcp_total++;
-                switch (s->state) {
-                    case SS_TCP_ESTABLISHED:
-                        stats->tcp_established++;
-                        break;
-                    case SS_TCP_SYN_SENT:
-                        stats->tcp_syn_sent++;
-                        break;
-                    case SS_TCP_SYN_RECV:
-                        stats->tcp_syn_recv++;
-                        break;
-                    case SS_TCP_FIN_WAIT1:
-                        stats->tcp_fin_wait1++;
-                        break;
-                    case SS_TCP_FIN_WAIT2:
-                        stats->tcp_fin_wait2++;
-                        break;
-                    case SS_TCP_TIME_WAIT:
-                        stats->tcp_time_wait++;
-                        break;
-                    case SS_TCP_CLOSE_WAIT:
-                        stats->tcp_close_wait++;
-                        break;
-                    case SS_TCP_LAST_ACK:
-                        stats->tcp_last_ack++;
-                        break;
-                    case SS_TCP_LISTEN:
-                        stats->tcp_listen++;
-                        break;
-                    case SS_TCP_CLOSING:
-                        stats->tcp_closing++;
-                        break;
-                    case SS_TCP_CLOSED:
-                        stats->tcp_closed++;
-                        break;
-                    default:
-                        break;
-                }
-                break;
-            case SS_PROTO_UDP:
-                stats->udp_total++;
-                break;
-            case SS_PROTO_UNIX_STREAM:
-                stats->unix_stream_total++;
-                break;
-            case SS_PROTO_UNIX_DGRAM:
-                stats->unix_dgram_total++;
-                break;
-            default:
-                break;
+    if (opts->save_file) {
+        return snapshot_save(opts, opts->save_file);
+    }
+    
+    ss_sock_table_t table = {0};
+    
+    /* A snapshot holds every socket: filter while reading it */
+    if (opts->load_file || opts->shm_name) {
+        selfstats_phase_begin(SS_PHASE_SCAN);
+        int ret = opts->load_file ? snapshot_load(opts->load_file, &table)
+                                  : daemon_read_shm(opts->shm_name, &table);
+        selfstats_phase_end(SS_PHASE_SCAN);
+        if (ret < 0) {
+            return -1;
         }
+        ret = print_snapshot(opts, &table);
+        sock_table_free(&table);
+        return ret;
+    }
+    
+    if (opts->summary) {
+        /* Count only: no socket records are built */
+        ss_stats_t stats = {0};
+        collect_summary(opts, &stats);
+        print_totals(&stats, opts);
+        return 0;
     }
+    
+    if (opts->group_by.by) {
+        /* Fold sockets into their groups: no socket records are kept */
+        ss_agg_t agg;
+        if (!agg_init(&agg, &opts->group_by)) {
+            perror("malloc");
+            return -1;
+        }
+        table.agg = &agg;
+        collect_all_sockets(opts, &table);
+        selfstats_phase_begin(SS_PHASE_OUTPUT);
+        int ret = agg_print(&agg, &table, opts);
+        selfstats_phase_end(SS_PHASE_OUTPUT);
+        agg_free(&agg);
+        sock_table_free(&table);
+        return ret;
+    }
+    
+    /* With --top only the first N in sort order are kept while collecting */
+    table.top = opts->top;
+    table.top_sort = &opts->sort;
+    
+    /* Collect all sockets, grouped UDP, TCP, UNIX (Linux ss order) */
+    collect_all_sockets(opts, &table);
+    
+    /* Print header and sockets */
+    selfstats_phase_begin(SS_PHASE_OUTPUT);
+    if (opts->sort.num_keys) {
+        int ret = print_sorted(opts, &table, false);
+        selfstats_phase_end(SS_PHASE_OUTPUT);
+        sock_table_free(&table);
+        return ret;
+    }
+    print_begin(opts);
+    size_t end = table.group_start[SS_GROUP_COUNT];
+    for (size_t i = table.group_start[0]; i < end; i++) {
+        print_row(&table, &table.recs[i], opts);
+    }
+    print_end(opts);
+    selfstats_phase_end(SS_PHASE_OUTPUT);
+    
+    /* Cleanup */
+    sock_table_free(&table);
+    return 0;
 }
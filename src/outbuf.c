@@ -0,0 +1,129 @@
+/*
+ * ss - Socket Statistics for Apple platforms (macOS/iOS)
+ * Buffered bulk output writer
+ *
+ * Rows are formatted into one reusable buffer with hand-rolled integer and
+ * padding routines and written to stdout with a single write() per full
+ * buffer, instead of several printf() calls per row.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "ss.h"
+
+/* Output chunk size */
+#define OUTBUF_SIZE (64 * 1024)
+
+static char outbuf[OUTBUF_SIZE];
+static size_t outlen;
+
+static void write_all(const char *data, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = write(STDOUT_FILENO, data, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return;  /* Reader went away: drop the rest */
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+}
+
+/* Write out everything buffered so far */
+void out_flush(void)
+{
+    /* Anything printed through stdio goes first */
+    fflush(stdout);
+    write_all(outbuf, outlen);
+    outlen = 0;
+}
+
+void out_write(const char *data, size_t len)
+{
+    if (outlen + len > OUTBUF_SIZE) {
+        out_flush();
+        if (len > OUTBUF_SIZE) {
+            write_all(data, len);
+            return;
+        }
+    }
+    memcpy(outbuf + outlen, data, len);
+    outlen += len;
+}
+
+void out_char(char c)
+{
+    if (outlen == OUTBUF_SIZE) {
+        out_flush();
+    }
+    outbuf[outlen++] = c;
+}
+
+void out_str(const char *s)
+{
+    out_write(s, strlen(s));
+}
+
+/* n copies of c */
+void out_fill(char c, int n)
+{
+    while (n > 0) {
+        size_t room = OUTBUF_SIZE - outlen;
+        if (room == 0) {
+            out_flush();
+            continue;
+        }
+        size_t chunk = (size_t)n < room ? (size_t)n : room;
+        memset(outbuf + outlen, c, chunk);
+        outlen += chunk;
+        n -= (int)chunk;
+    }
+}
+
+/* s padded with spaces to width: "%-*s" (left) or "%*s" */
+void out_pad(const char *s, size_t len, int width, bool left)
+{
+    int pad = width - (int)len;
+    if (!left) {
+        out_fill(' ', pad);
+    }
+    out_write(s, len);
+    if (left) {
+        out_fill(' ', pad);
+    }
+}
+
+/* Decimal digits of v, written backwards ending at end; returns the start */
+static char *fmt_u64(char *end, uint64_t v)
+{
+    char *p = end;
+    do {
+        *--p = (char)('0' + v % 10);
+        v /= 10;
+    } while (v);
+    return p;
+}
+
+/* Signed decimal, padded like "%-*d" (left) or "%*d"; width 0 = no padding */
+void out_int(int64_t v, int width, bool left)
+{
+    char buf[24];
+    char *end = buf + sizeof(buf);
+    char *p = fmt_u64(end, v < 0 ? 0 - (uint64_t)v : (uint64_t)v);
+    if (v < 0) {
+        *--p = '-';
+    }
+    out_pad(p, (size_t)(end - p), width, left);
+}
+
+/* Unsigned decimal, padded like "%-*u" (left) or "%*u"; width 0 = no padding */
+void out_uint(uint64_t v, int width, bool left)
+{
+    char buf[24];
+    char *end = buf + sizeof(buf);
+    char *p = fmt_u64(end, v);
+    out_pad(p, (size_t)(end - p), width, left);
+}
@@ -17,6 +17,11 @@
 #define COL_REMOTE  40
 #define COL_PROCESS 30
 
+/* --group-by totals columns */
+#define COL_SOCKETS 8
+#define COL_QSUM    12
+#define COL_QMAX    10
+
 /* Convert TCP state to string */
 const char *tcp_state_to_string(ss_tcp_state_t state)
 {
@@ -38,7 +43,7 @@ const char *tcp_state_to_string(ss_tcp_state_t state)
 }
 
 /* Get protocol name string (Linux ss uses tcp/udp for both IPv4 and IPv6) */
-static const char *get_proto_name(const ss_sock_info_t *sock)
+const char *get_proto_name(const ss_sock_info_t *sock)
 {
     switch (sock->protocol) {
         case SS_PROTO_TCP:
@@ -54,81 +59,306 @@ static const char *get_proto_name(const ss_sock_info_t *sock)
     }
 }
 
+/* Start a listing in the selected format */
+void print_begin(const ss_options_t *opts)
+{
+    if (opts->format == SS_FORMAT_TABLE) {
+        if (!opts->no_header) {
+            print_header(opts);
+        }
+    } else {
+        serialize_begin(opts);
+    }
+}
+
+/* One socket in the selected format */
+void print_row(const ss_sock_table_t *table, const ss_sock_info_t *sock,
+               const ss_options_t *opts)
+{
+    if (opts->format == SS_FORMAT_TABLE) {
+        print_socket(table, sock, opts);
+    } else {
+        serialize_socket(table, sock, opts);
+    }
+}
+
+/* Finish a listing and write it out */
+void print_end(const ss_options_t *opts)
+{
+    if (opts->format != SS_FORMAT_TABLE) {
+        serialize_end(opts);
+    }
+    out_flush();
+}
+
 /* Print table header */
 void print_header(const ss_options_t *opts)
 {
-    printf("%-*s ", COL_NETID, "Netid");
-    printf("%-*s ", COL_STATE, "State");
-    printf("%*s ", COL_RECVQ, "Recv-Q");
-    printf("%*s ", COL_SENDQ, "Send-Q");
-    printf("%-*s ", COL_LOCAL, "Local Address:Port");
-    printf("%-*s", COL_REMOTE, "Peer Address:Port");
+    out_pad("Netid", 5, COL_NETID, true);
+    out_char(' ');
+    out_pad("State", 5, COL_STATE, true);
+    out_char(' ');
+    out_pad("Recv-Q", 6, COL_RECVQ, false);
+    out_char(' ');
+    out_pad("Send-Q", 6, COL_SENDQ, false);
+    out_char(' ');
+    out_pad("Local Address:Port", 18, COL_LOCAL, true);
+    out_char(' ');
+    out_pad("Peer Address:Port", 17, COL_REMOTE, true);
     
     if (opts->show_process) {
-        printf(" %-*s", COL_PROCESS, "Process");
+        out_char(' ');
+        out_pad("Process", 7, COL_PROCESS, true);
     }
     
     if (opts->extended) {
-        printf(" %-8s", "PID");
+        out_char(' ');
+        out_pad("PID", 3, 8, true);
     }
     
-    printf("\n");
+    out_char('\n');
+}
+
+/* A timer in Linux ss style: "400ms", "7.200ms", "59sec", "2min5sec", "120min" */
+static const char *format_ms_timer(uint32_t ms, char *buf, size_t buflen)
+{
+    uint32_t minutes = ms / 60000;
+    uint32_t secs = ms / 1000 % 60;
+    uint32_t msecs = ms % 1000;
+    size_t len = 0;
+
+    buf[0] = '\0';
+    if (minutes) {
+        msecs = 0;
+        len += (size_t)snprintf(buf, buflen, "%umin", minutes);
+        if (minutes > 9) {
+            secs = 0;
+        }
+    }
+    if (secs) {
+        if (secs > 9) {
+            msecs = 0;
+        }
+        len += (size_t)snprintf(buf + len, buflen - len, "%u%s", secs, msecs ? "." : "sec");
+    }
+    if (msecs || len == 0) {
+        snprintf(buf + len, buflen - len, "%03ums", msecs);
+    }
+    return buf;
+}
+
+/* -o: armed TCP timers, e.g. timer:(on,400ms) timer:(keepalive,120min) */
+static void print_timers(const ss_sock_ext_t *ext)
+{
+    static const char *const names[] = { "on", "persist", "keepalive", "timewait" };
+    char buf[32];
+
+    for (int t = 0; t < 4; t++) {
+        if (ext->timer[t] == 0) {
+            continue;
+        }
+        out_str(" timer:(");
+        out_str(names[t]);
+        out_char(',');
+        out_str(format_ms_timer(ext->timer[t], buf, sizeof(buf)));
+        out_char(')');
+    }
+}
+
+/* One socket buffer as queued/limit(fill%) */
+static void print_buffer(const char *name, uint32_t queued, uint32_t hiwat)
+{
+    out_char(' ');
+    out_str(name);
+    out_char(':');
+    out_uint(queued, 0, false);
+    out_char('/');
+    out_uint(hiwat, 0, false);
+    if (hiwat) {
+        out_char('(');
+        out_uint((uint64_t)queued * 100 / hiwat, 0, false);
+        out_str("%)");
+    }
 }
 
-/* Print a single socket entry */
-void print_socket(const ss_sock_info_t *sock, const ss_options_t *opts)
+/* -i: internals on a continuation line, as Linux ss prints them */
+static void print_internals(const ss_sock_info_t *sock, const ss_sock_ext_t *ext)
+{
+    out_char('\t');
+    if (ext->has_tcp) {
+        out_str(" mss:");
+        out_uint(ext->mss, 0, false);
+    }
+    /* A listener queues connections, not bytes */
+    if (sock->state != SS_TCP_LISTEN) {
+        print_buffer("rcvbuf", ext->rcv_used, ext->rcv_hiwat);
+        print_buffer("sndbuf", ext->snd_used, ext->snd_hiwat);
+    }
+    if (ext->flags) {
+        char buf[16];
+        snprintf(buf, sizeof(buf), "%#x", ext->flags);
+        out_str(" flags:");
+        out_str(buf);
+    }
+    out_char('\n');
+}
+
+/* Print a single socket entry (buffered; see out_flush()) */
+void print_socket(const ss_sock_table_t *table, const ss_sock_info_t *sock,
+                  const ss_options_t *opts)
 {
     const char *proto = get_proto_name(sock);
     const char *state = tcp_state_to_string(sock->state);
     
-    /* Format local address */
-    char local_str[MAX_ADDR_LEN];
-    if (sock->protocol == SS_PROTO_UNIX_STREAM || 
-        sock->protocol == SS_PROTO_UNIX_DGRAM) {
-        if (sock->unix_path[0] != '\0') {
-            snprintf(local_str, sizeof(local_str), "%s", sock->unix_path);
-        } else {
-            snprintf(local_str, sizeof(local_str), "%s", sock->local_addr);
-        }
-    } else {
-        snprintf(local_str, sizeof(local_str), "%s", sock->local_addr);
+    /* Format addresses (records keep them binary) */
+    char local_buf[MAX_ADDR_LEN];
+    char remote_buf[MAX_ADDR_LEN];
+    const char *local_str = local_buf;
+    const char *remote_str = remote_buf;
+    size_t local_len, remote_len;
+    switch (sock->family) {
+        case SS_FAMILY_INET:
+            local_len = format_addr_v4(&sock->local_ip.v4, sock->local_port,
+                                       local_buf, sizeof(local_buf));
+            remote_len = format_addr_v4(&sock->remote_ip.v4, sock->remote_port,
+                                        remote_buf, sizeof(remote_buf));
+            break;
+        case SS_FAMILY_INET6:
+            local_len = format_addr_v6(&sock->local_ip.v6, sock->local_port,
+                                       local_buf, sizeof(local_buf));
+            remote_len = format_addr_v6(&sock->remote_ip.v6, sock->remote_port,
+                                        remote_buf, sizeof(remote_buf));
+            break;
+        default:
+            if (sock->unix_path != 0) {
+                /* The column has always been cut at MAX_ADDR_LEN - 1 */
+                local_str = sock_table_str(table, sock->unix_path);
+                local_len = strnlen(local_str, MAX_ADDR_LEN - 1);
+            } else {
+                local_str = "*";
+                local_len = 1;
+            }
+            remote_str = sock->unix_connected ? "[connected]" : "*";
+            remote_len = strlen(remote_str);
+            break;
     }
     
-    /* Format remote address */
-    char remote_str[MAX_ADDR_LEN];
-    snprintf(remote_str, sizeof(remote_str), "%s", sock->remote_addr);
-    
     /* Print main columns */
-    printf("%-*s ", COL_NETID, proto);
-    printf("%-*s ", COL_STATE, state);
-    printf("%*u ", COL_RECVQ, sock->recv_queue);
-    printf("%*u ", COL_SENDQ, sock->send_queue);
-    printf("%-*s ", COL_LOCAL, local_str);
-    printf("%-*s", COL_REMOTE, remote_str);
+    out_pad(proto, strlen(proto), COL_NETID, true);
+    out_char(' ');
+    out_pad(state, strlen(state), COL_STATE, true);
+    out_char(' ');
+    out_uint(sock->recv_queue, COL_RECVQ, false);
+    out_char(' ');
+    out_uint(sock->send_queue, COL_SENDQ, false);
+    out_char(' ');
+    out_pad(local_str, local_len, COL_LOCAL, true);
+    out_char(' ');
+    out_pad(remote_str, remote_len, COL_REMOTE, true);
     
     /* Print process info if requested (Linux ss compatible format) */
     if (opts->show_process) {
-        if (sock->pid > 0 && sock->proc_name[0] != '\0') {
+        if (sock->pid > 0) {
             /* Linux ss format: users:(("name",pid=123,fd=4)) */
-            printf(" users:((\"%s\",pid=%d,fd=%d))", 
-                   sock->proc_name, sock->pid, sock->fd);
-        } else if (sock->pid > 0) {
-            printf(" users:((\"?\",pid=%d,fd=%d))", sock->pid, sock->fd);
+            out_str(" users:((\"");
+            out_str(sock->proc_name != 0 ? sock_table_str(table, sock->proc_name) : "?");
+            out_str("\",pid=");
+            out_int(sock->pid, 0, false);
+            out_str(",fd=");
+            out_int(sock->fd, 0, false);
+            out_str("))");
         } else {
-            printf(" ");
+            out_char(' ');
         }
     }
     
     /* Print extended info if requested */
     if (opts->extended) {
+        out_char(' ');
         if (sock->pid > 0) {
-            printf(" %-8d", sock->pid);
+            out_int(sock->pid, 8, true);
         } else {
-            printf(" %-8s", "-");
+            out_pad("-", 1, 8, true);
+        }
+        /* Linux ss -e style owner and inode */
+        out_str(" uid:");
+        out_uint(sock->uid, 0, false);
+        if (sock->inode != 0) {
+            out_str(" ino:");
+            out_uint(sock->inode, 0, false);
         }
     }
     
-    printf("\n");
+    /* Internals, if the collector stored them (live libproc walks) */
+    const ss_sock_ext_t *ext = (opts->timers || opts->tcp_info) ? sock_table_ext_of(table, sock) : NULL;
+    if (ext && opts->timers) {
+        print_timers(ext);
+    }
+    out_char('\n');
+    if (ext && opts->tcp_info) {
+        print_internals(sock, ext);
+    }
+}
+
+/* Start a --group-by listing; row gives the key columns */
+void print_group_begin(const ss_group_row_t *row, const ss_options_t *opts)
+{
+    if (opts->format != SS_FORMAT_TABLE) {
+        serialize_group_begin(row, opts);
+        return;
+    }
+    if (opts->no_header) {
+        return;
+    }
+    for (int k = 0; k < 2 && row->key[k]; k++) {
+        out_pad(row->title[k], strlen(row->title[k]), row->width[k], true);
+        out_char(' ');
+    }
+    out_pad("Sockets", 7, COL_SOCKETS, false);
+    out_char(' ');
+    out_pad("Recv-Q", 6, COL_QSUM, false);
+    out_char(' ');
+    out_pad("Max-Recv-Q", 10, COL_QMAX, false);
+    out_char(' ');
+    out_pad("Send-Q", 6, COL_QSUM, false);
+    out_char(' ');
+    out_pad("Max-Send-Q", 10, COL_QMAX, false);
+    out_char('\n');
+}
+
+/* One --group-by row in the selected format */
+void print_group(const ss_group_row_t *row, const ss_options_t *opts)
+{
+    if (opts->format != SS_FORMAT_TABLE) {
+        serialize_group(row, opts);
+        return;
+    }
+    for (int k = 0; k < 2 && row->key[k]; k++) {
+        const char *val = row->val[k] ? row->val[k] : "*";
+        out_pad(val, strlen(val), row->width[k], true);
+        out_char(' ');
+    }
+    out_uint(row->sockets, COL_SOCKETS, false);
+    out_char(' ');
+    out_uint(row->recv_q, COL_QSUM, false);
+    out_char(' ');
+    out_uint(row->recv_q_max, COL_QMAX, false);
+    out_char(' ');
+    out_uint(row->send_q, COL_QSUM, false);
+    out_char(' ');
+    out_uint(row->send_q_max, COL_QMAX, false);
+    out_char('\n');
+}
+
+/* -s totals in the selected format */
+void print_totals(const ss_stats_t *stats, const ss_options_t *opts)
+{
+    if (opts->format == SS_FORMAT_TABLE) {
+        print_summary(stats);
+    } else {
+        serialize_summary(stats, opts);
+    }
+    out_flush();
 }
 
 /* Print summary statistics */
@@ -175,7 +405,7 @@ void print_summary(const ss_stats_t *stats)
 /* Print help message */
 void print_help(const char *prog_name)
 {
-    printf("Usage: %s [OPTIONS]\n", prog_name);
+    printf("Usage: %s [OPTIONS] [ FILTER ]\n", prog_name);
     printf("\nSocket Statistics for Apple platforms (macOS/iOS)\n");
     printf("A Linux ss command clone for Darwin/XNU systems\n");
     printf("\nOptions:\n");
@@ -187,16 +417,57 @@ void print_help(const char *prog_name)
     printf("  -n, --numeric      Do not resolve service names\n");
     printf("  -p, --processes    Show process using socket\n");
     printf("  -e, --extended     Show extended socket information\n");
+    printf("  -i, --info         Show TCP MSS and socket buffer fill (cc/hiwat)\n");
+    printf("  -o, --options      Show TCP timers (retransmit, persist, keepalive, 2MSL)\n");
     printf("  -s, --summary      Show socket usage summary\n");
     printf("  -4, --ipv4         Display only IPv4 sockets\n");
     printf("  -6, --ipv6         Display only IPv6 sockets\n");
+    printf("  -H, --no-header    Suppress the header line (and the CSV header row)\n");
+    printf("  -j, --threads=N    Collect with N worker threads (0 = one per CPU)\n");
     printf("  -V, --version      Show version information\n");
     printf("  -h, --help         Show this help message\n");
+    printf("      --collector=NAME   Socket collector backend (libproc, netlink, synthetic)\n");
+    printf("      --synthetic=SPEC   Use a generated population, e.g. procs=1000,socks=200\n");
+    printf("      --json             Output a JSON array of sockets (with -s: totals object)\n");
+    printf("      --ndjson           Output one JSON object per socket per line\n");
+    printf("      --csv              Output CSV with a header row\n");
+    printf("      --interval=SECS    Redisplay every SECS seconds (fractions allowed)\n");
+    printf("      --count=N          Stop after N displays (0 = until interrupted)\n");
+    printf("      --uid=USER         Only sockets of processes owned by USER (name or uid)\n");
+    printf("      --pgrp=PGID        Only sockets of processes in process group PGID\n");
+    printf("      --pid=PID[,PID]    Only sockets of the given processes\n");
+    printf("      --src-file=FILE    Only sockets whose local address is in a CIDR list\n");
+    printf("      --dst-file=FILE    Only sockets whose peer address is in a CIDR list\n");
+    printf("      --self-stats[=N]   Report phase times, libproc calls, heap use and the\n");
+    printf("                         N most expensive PIDs (default 10) on stderr\n");
+    printf("      --trace=FILE       Write a Chrome trace-event JSON file of the run\n");
+    printf("      --save=FILE        Save every socket (all states, with processes) as a\n");
+    printf("                         binary snapshot instead of listing\n");
+    printf("      --load=FILE        List, filter or summarize a saved snapshot\n");
+    printf("      --daemon           Run as ssd: refresh every --interval seconds (default 2)\n");
+    printf("                         and publish to --shm, answering --query requests\n");
+    printf("      --shm[=NAME]       List from the snapshot ssd publishes (default /ssd)\n");
+    printf("      --query[=PATH]     Have ssd run this command (default /tmp/ssd.sock)\n");
+    printf("      --public           Let every user read ssd's snapshot and query it\n");
+    printf("                         (default: only ssd's own user)\n");
+    printf("      --sort=FIELD[,FIELD]  Order by recvq, sendq (largest first), sport, dport,\n");
+    printf("                         src, dst, state, pid, process; '-FIELD' reverses\n");
+    printf("      --top=N            Only the first N sockets in --sort order (default\n");
+    printf("                         recvq,sendq)\n");
+    printf("      --group-by=KEY     One row per process, remote[/V4[/V6]] (peer subnet),\n");
+    printf("                         lport or state: socket count and queue sums/maxima\n");
+    printf("\nFILTER := [ [ state ] STATE-FILTER ] [ EXPRESSION ]\n");
+    printf("  STATE-FILTER: established, syn-sent, syn-recv, fin-wait-1, fin-wait-2,\n");
+    printf("    time-wait, closed, close-wait, last-ack, listening, closing, or the\n");
+    printf("    groups all, connected, synchronized, bucket, big; 'exclude STATE' drops one\n");
+    printf("  EXPRESSION: sport/dport OP [:]PORT (OP: = != < > <= >=), src/dst [!=] ADDR[/LEN][:PORT],\n");
+    printf("    combined with and, or, not and ( )\n");
     printf("\nExamples:\n");
     printf("  %s -tuln           Show TCP/UDP listening sockets (numeric)\n", prog_name);
     printf("  %s -ta             Show all TCP sockets\n", prog_name);
     printf("  %s -s              Show summary statistics\n", prog_name);
     printf("  %s -tlp            Show listening TCP with process info\n", prog_name);
+    printf("  %s -t state established '( dport = :443 or dport = :80 )'\n", prog_name);
     printf("\nNote: Process information (-p) may require root privileges.\n");
 }
 
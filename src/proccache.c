@@ -0,0 +1,185 @@
+/*
+ * ss - Socket Statistics for Apple platforms (macOS/iOS)
+ * Process metadata cache: name and uid by (pid, start time)
+ *
+ * Resolving a process name goes through proc_pidpath(), one of the more
+ * expensive libproc calls. Entries are keyed by pid and validated against
+ * pbi_start_tvsec/usec from PROC_PIDTBSDINFO, so a lookup costs one cheap
+ * call and a PID that was reused by a new process is never served the old
+ * name. The cache lives for the whole run (watch mode keeps it across
+ * refreshes) and is shared by the -j workers under one lock; names of
+ * missing entries are resolved outside the lock.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "libproc_compat.h"
+#include "ss.h"
+
+/* Initial slot count (power of two) */
+#define PROC_CACHE_MIN_SLOTS 256
+
+typedef struct {
+    pid_t pid;              /* 0 = empty */
+    uid_t uid;
+    uint64_t start_sec;
+    uint64_t start_usec;
+    char *name;
+} proc_cache_entry_t;
+
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static proc_cache_entry_t *slots;
+static size_t slot_mask;
+static size_t num_entries;
+static ss_proc_cache_stats_t stats;
+
+/* Basename of the executable path, else proc_name(), else "?" */
+static void resolve_name(const ss_libproc_ops_t *ops, pid_t pid,
+                         char *name, size_t name_len)
+{
+    char pathbuf[PROC_PIDPATHINFO_MAXSIZE];
+
+    int ret = ops->pidpath(pid, pathbuf, sizeof(pathbuf));
+    if (ret > 0) {
+        char *slash = strrchr(pathbuf, '/');
+        const char *base = slash ? slash + 1 : pathbuf;
+        size_t len = strnlen(base, name_len - 1);
+        memcpy(name, base, len);
+        name[len] = '\0';
+    } else {
+        /* Fallback to proc_name */
+        ret = ops->procname(pid, name, (uint32_t)name_len);
+        if (ret <= 0) {
+            snprintf(name, name_len, "?");
+        }
+    }
+}
+
+static size_t pid_slot(pid_t pid)
+{
+    return ((uint32_t)pid * 2654435761u) & slot_mask;
+}
+
+static proc_cache_entry_t *find_slot(pid_t pid)
+{
+    size_t i = pid_slot(pid);
+    while (slots[i].pid != 0 && slots[i].pid != pid) {
+        i = (i + 1) & slot_mask;
+    }
+    return &slots[i];
+}
+
+/* Keep the table at most half full; caller holds cache_lock */
+static bool grow(void)
+{
+    size_t new_size = slots ? (slot_mask + 1) * 2 : PROC_CACHE_MIN_SLOTS;
+    proc_cache_entry_t *new_slots = calloc(new_size, sizeof(proc_cache_entry_t));
+    if (!new_slots) {
+        return false;
+    }
+
+    proc_cache_entry_t *old = slots;
+    size_t old_size = old ? slot_mask + 1 : 0;
+    slots = new_slots;
+    slot_mask = new_size - 1;
+    for (size_t i = 0; i < old_size; i++) {
+        if (old[i].pid != 0) {
+            *find_slot(old[i].pid) = old[i];
+        }
+    }
+    free(old);
+    return true;
+}
+
+/*
+ * Metadata of a process. The name is served from the cache when the pid
+ * and start time match an entry, else resolved and stored. Returns false
+ * if the start time could not be read; the name is then resolved uncached
+ * and the uid and start time are 0.
+ */
+bool proc_cache_get(const ss_libproc_ops_t *ops, pid_t pid, ss_proc_meta_t *out)
+{
+    struct proc_bsdinfo bi;
+
+    memset(out, 0, sizeof(*out));
+    if (ops->pidinfo(pid, PROC_PIDTBSDINFO, 0, &bi, sizeof(bi)) < (int)sizeof(bi)) {
+        /* No start time to key on (process gone or not ours): no caching */
+        pthread_mutex_lock(&cache_lock);
+        stats.lookups++;
+        stats.uncached++;
+        pthread_mutex_unlock(&cache_lock);
+        resolve_name(ops, pid, out->name, sizeof(out->name));
+        return false;
+    }
+    out->uid = bi.pbi_uid;
+    out->start_sec = bi.pbi_start_tvsec;
+    out->start_usec = bi.pbi_start_tvusec;
+
+    pthread_mutex_lock(&cache_lock);
+    stats.lookups++;
+    if (slots) {
+        proc_cache_entry_t *e = find_slot(pid);
+        if (e->pid == pid && e->start_sec == out->start_sec &&
+            e->start_usec == out->start_usec) {
+            stats.hits++;
+            strncpy(out->name, e->name, sizeof(out->name) - 1);
+            pthread_mutex_unlock(&cache_lock);
+            return true;
+        }
+        if (e->pid == pid) {
+            stats.reused++;
+        }
+    }
+    stats.misses++;
+    pthread_mutex_unlock(&cache_lock);
+
+    resolve_name(ops, pid, out->name, sizeof(out->name));
+
+    char *name = strdup(out->name);
+    if (!name) {
+        return true;
+    }
+    pthread_mutex_lock(&cache_lock);
+    if ((num_entries + 1) * 2 > (slots ? slot_mask + 1 : 0) && !grow()) {
+        pthread_mutex_unlock(&cache_lock);
+        free(name);
+        return true;
+    }
+    proc_cache_entry_t *e = find_slot(pid);
+    if (e->pid == 0) {
+        num_entries++;
+    }
+    free(e->name);
+    e->pid = pid;
+    e->uid = out->uid;
+    e->start_sec = out->start_sec;
+    e->start_usec = out->start_usec;
+    e->name = name;
+    pthread_mutex_unlock(&cache_lock);
+    return true;
+}
+
+/* Counters since the start of the run */
+void proc_cache_stats(ss_proc_cache_stats_t *out)
+{
+    pthread_mutex_lock(&cache_lock);
+    *out = stats;
+    pthread_mutex_unlock(&cache_lock);
+}
+
+void proc_cache_free(void)
+{
+    pthread_mutex_lock(&cache_lock);
+    if (slots) {
+        for (size_t i = 0; i <= slot_mask; i++) {
+            free(slots[i].name);
+        }
+    }
+    free(slots);
+    slots = NULL;
+    slot_mask = 0;
+    num_entries = 0;
+    pthread_mutex_unlock(&cache_lock);
+}
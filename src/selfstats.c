@@ -0,0 +1,567 @@
+/*
+ * ss - Socket Statistics for Apple platforms (macOS/iOS)
+ * Self-profiling: --self-stats report and --trace Chrome trace file
+ *
+ * Phases (listing PIDs, the fd walk, merge, grouping, output) are timed
+ * at their boundaries on the main thread: wall and process CPU time, and
+ * the change in heap bytes in use. libproc calls are counted and timed by
+ * a wrapper around the collector's ss_libproc_ops_t, so the walkers need
+ * no changes. The wrapper also cuts each thread's calls into per-PID
+ * spans (first call for a PID to the last one before the thread moves on),
+ * which give the per-PID scan cost and the events of the trace file.
+ *
+ * Counters are per thread, registered on a thread's first call, and are
+ * only read by selfstats_finish() after the -j workers were joined. The
+ * report also gives the process cache hit rates (proccache.c) and, in
+ * watch mode, how many processes each refresh had to rescan.
+ * Nothing is measured unless selfstats_start() was called.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#if defined(__APPLE__)
+#include <malloc/malloc.h>
+#define HAVE_HEAP_STATS 1
+#elif defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+#include <malloc.h>
+#define HAVE_HEAP_STATS 1
+#endif
+#include "libproc_compat.h"
+#include "ss.h"
+
+/* Timed call kinds */
+enum {
+    CALL_LISTPIDS,
+    CALL_LISTFDS,
+    CALL_PIDINFO,
+    CALL_FDINFO,
+    CALL_PIDPATH,
+    CALL_NAME,
+    CALL_DEDUP,
+    CALL_COUNT
+};
+
+static const char *const call_names[CALL_COUNT] = {
+    "proc_listpids",
+    "PROC_PIDLISTFDS",
+    "proc_pidinfo",
+    "proc_pidfdinfo",
+    "proc_pidpath",
+    "proc_name",
+    "dedup insert"
+};
+
+static const char *const phase_names[SS_PHASE_COUNT] = {
+    [SS_PHASE_PIDS]   = "list-pids",
+    [SS_PHASE_SCAN]   = "scan",
+    [SS_PHASE_MERGE]  = "merge",
+    [SS_PHASE_GROUP]  = "group",
+    [SS_PHASE_OUTPUT] = "output"
+};
+
+/* A thread's consecutive calls for one PID */
+typedef struct {
+    pid_t pid;
+    uint32_t calls;
+    uint32_t fdinfo;        /* proc_pidfdinfo calls among them */
+    uint64_t start;         /* ns since selfstats_start() */
+    uint64_t end;
+} pid_span_t;
+
+typedef struct thread_stats {
+    struct thread_stats *next;
+    int id;                 /* Trace tid, from 1 in registration order */
+    uint64_t calls[CALL_COUNT];
+    uint64_t ns[CALL_COUNT];
+    pid_span_t cur;         /* Open span (cur.calls == 0: none) */
+    pid_span_t *spans;
+    size_t num_spans, spans_cap;
+} thread_stats_t;
+
+/* One run of a phase, for the trace */
+typedef struct {
+    ss_phase_t phase;
+    uint64_t start;
+    uint64_t end;
+} phase_run_t;
+
+bool selfstats_on;
+
+static uint64_t t_start;
+static pthread_mutex_t threads_lock = PTHREAD_MUTEX_INITIALIZER;
+static thread_stats_t *threads;
+static int num_threads;
+static _Thread_local thread_stats_t *self;
+
+/* Phase totals; phases only begin and end on the main thread */
+static struct {
+    uint64_t runs;
+    uint64_t wall_ns;
+    uint64_t cpu_ns;
+    int64_t heap_delta;
+    uint64_t wall_begin, cpu_begin;
+    int64_t heap_begin;
+} phases[SS_PHASE_COUNT];
+static phase_run_t *runs;
+static size_t num_runs, runs_cap;
+
+/* Incremental watch refreshes (main thread) */
+static struct {
+    uint64_t ticks;
+    uint64_t procs;
+    uint64_t rescanned;
+} watch;
+
+/* The provider the wrapper forwards to */
+static const ss_libproc_ops_t *real_ops;
+
+static uint64_t clock_ns(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/* Monotonic ns since selfstats_start() */
+uint64_t selfstats_now(void)
+{
+    return clock_ns(CLOCK_MONOTONIC) - t_start;
+}
+
+/* Heap bytes in use (0 where the allocator does not say) */
+static int64_t heap_in_use(void)
+{
+#if defined(__APPLE__)
+    malloc_statistics_t st;
+    malloc_zone_statistics(NULL, &st);
+    return (int64_t)st.size_in_use;
+#elif defined(HAVE_HEAP_STATS)
+    struct mallinfo2 mi = mallinfo2();
+    return (int64_t)(mi.uordblks + mi.hblkhd);
+#else
+    return 0;
+#endif
+}
+
+void selfstats_start(void)
+{
+    t_start = clock_ns(CLOCK_MONOTONIC);
+    selfstats_on = true;
+}
+
+/* This thread's counters, registered on first use (NULL if out of memory) */
+static thread_stats_t *thread_self(void)
+{
+    if (!self) {
+        thread_stats_t *ts = calloc(1, sizeof(*ts));
+        if (!ts) {
+            return NULL;
+        }
+        pthread_mutex_lock(&threads_lock);
+        ts->id = ++num_threads;
+        ts->next = threads;
+        threads = ts;
+        pthread_mutex_unlock(&threads_lock);
+        self = ts;
+    }
+    return self;
+}
+
+static void close_span(thread_stats_t *ts)
+{
+    if (ts->cur.calls == 0) {
+        return;
+    }
+    if (ts->num_spans == ts->spans_cap) {
+        size_t new_cap = ts->spans_cap ? ts->spans_cap * 2 : 256;
+        pid_span_t *spans = realloc(ts->spans, new_cap * sizeof(*spans));
+        if (!spans) {
+            ts->cur.calls = 0;  /* Drop it: profiling must not fail the run */
+            return;
+        }
+        ts->spans = spans;
+        ts->spans_cap = new_cap;
+    }
+    ts->spans[ts->num_spans++] = ts->cur;
+    ts->cur.calls = 0;
+}
+
+/* Account one call that started at t0 (ns) and, if pid > 0, its PID span */
+static void count_call(int kind, pid_t pid, uint64_t t0)
+{
+    uint64_t t1 = selfstats_now();
+    thread_stats_t *ts = thread_self();
+    if (!ts) {
+        return;
+    }
+    ts->calls[kind]++;
+    ts->ns[kind] += t1 - t0;
+
+    if (pid <= 0) {
+        return;
+    }
+    if (ts->cur.calls == 0 || ts->cur.pid != pid) {
+        close_span(ts);
+        ts->cur.pid = pid;
+        ts->cur.fdinfo = 0;
+        ts->cur.start = t0;
+    }
+    ts->cur.calls++;
+    ts->cur.end = t1;
+    if (kind == CALL_FDINFO) {
+        ts->cur.fdinfo++;
+    }
+}
+
+void selfstats_dedup(uint64_t t0)
+{
+    count_call(CALL_DEDUP, 0, t0);
+}
+
+/* One incremental watch refresh: processes tracked and rescanned */
+void selfstats_watch(size_t procs, size_t rescanned)
+{
+    if (!selfstats_on) {
+        return;
+    }
+    watch.ticks++;
+    watch.procs += procs;
+    watch.rescanned += rescanned;
+}
+
+static int wrap_listpids(uint32_t type, uint32_t typeinfo, void *buffer, int buffersize)
+{
+    uint64_t t0 = selfstats_now();
+    int ret = real_ops->listpids(type, typeinfo, buffer, buffersize);
+    count_call(CALL_LISTPIDS, 0, t0);
+    return ret;
+}
+
+static int wrap_pidinfo(int pid, int flavor, uint64_t arg, void *buffer, int buffersize)
+{
+    uint64_t t0 = selfstats_now();
+    int ret = real_ops->pidinfo(pid, flavor, arg, buffer, buffersize);
+    count_call(flavor == PROC_PIDLISTFDS ? CALL_LISTFDS : CALL_PIDINFO, pid, t0);
+    return ret;
+}
+
+static int wrap_pidfdinfo(int pid, int fd, int flavor, void *buffer, int buffersize)
+{
+    uint64_t t0 = selfstats_now();
+    int ret = real_ops->pidfdinfo(pid, fd, flavor, buffer, buffersize);
+    count_call(CALL_FDINFO, pid, t0);
+    return ret;
+}
+
+static int wrap_pidpath(int pid, void *buffer, uint32_t buffersize)
+{
+    uint64_t t0 = selfstats_now();
+    int ret = real_ops->pidpath(pid, buffer, buffersize);
+    count_call(CALL_PIDPATH, pid, t0);
+    return ret;
+}
+
+static int wrap_procname(int pid, void *buffer, uint32_t buffersize)
+{
+    uint64_t t0 = selfstats_now();
+    int ret = real_ops->procname(pid, buffer, buffersize);
+    count_call(CALL_NAME, pid, t0);
+    return ret;
+}
+
+static const ss_libproc_ops_t counting_ops = {
+    "counting",
+    wrap_listpids,
+    wrap_pidinfo,
+    wrap_pidfdinfo,
+    wrap_pidpath,
+    wrap_procname
+};
+
+/* ops itself when profiling is off, else a counting wrapper around it */
+const ss_libproc_ops_t *selfstats_wrap_ops(const ss_libproc_ops_t *ops)
+{
+    if (!selfstats_on || !ops || ops == &counting_ops) {
+        return ops;
+    }
+    real_ops = ops;
+    return &counting_ops;
+}
+
+void selfstats_phase_begin(ss_phase_t phase)
+{
+    if (!selfstats_on) {
+        return;
+    }
+    phases[phase].heap_begin = heap_in_use();
+    phases[phase].cpu_begin = clock_ns(CLOCK_PROCESS_CPUTIME_ID);
+    phases[phase].wall_begin = selfstats_now();
+}
+
+void selfstats_phase_end(ss_phase_t phase)
+{
+    if (!selfstats_on) {
+        return;
+    }
+    uint64_t wall = selfstats_now();
+    uint64_t cpu = clock_ns(CLOCK_PROCESS_CPUTIME_ID);
+
+    phases[phase].runs++;
+    phases[phase].wall_ns += wall - phases[phase].wall_begin;
+    phases[phase].cpu_ns += cpu - phases[phase].cpu_begin;
+    phases[phase].heap_delta += heap_in_use() - phases[phase].heap_begin;
+
+    if (num_runs == runs_cap) {
+        size_t new_cap = runs_cap ? runs_cap * 2 : 64;
+        phase_run_t *grown = realloc(runs, new_cap * sizeof(*grown));
+        if (!grown) {
+            return;
+        }
+        runs = grown;
+        runs_cap = new_cap;
+    }
+    runs[num_runs++] = (phase_run_t){ phase, phases[phase].wall_begin, wall };
+}
+
+/* Per-PID totals, built from the spans of all threads */
+typedef struct {
+    pid_t pid;
+    uint32_t spans;
+    uint64_t calls;
+    uint64_t fdinfo;
+    uint64_t ns;
+} pid_cost_t;
+
+static int cmp_span_pid(const void *a, const void *b)
+{
+    pid_t x = ((const pid_span_t *)a)->pid, y = ((const pid_span_t *)b)->pid;
+    return (x > y) - (x < y);
+}
+
+static int cmp_cost(const void *a, const void *b)
+{
+    const pid_cost_t *x = a, *y = b;
+    if (x->ns != y->ns) {
+        return (x->ns < y->ns) - (x->ns > y->ns);
+    }
+    return (x->pid > y->pid) - (x->pid < y->pid);
+}
+
+/* Sum the spans per PID, most expensive first; *n is set to the PID count */
+static pid_cost_t *pid_costs(size_t *n)
+{
+    size_t total = 0;
+    for (thread_stats_t *ts = threads; ts; ts = ts->next) {
+        total += ts->num_spans;
+    }
+    *n = 0;
+    if (total == 0) {
+        return NULL;
+    }
+
+    pid_span_t *all = malloc(total * sizeof(*all));
+    pid_cost_t *costs = malloc(total * sizeof(*costs));
+    if (!all || !costs) {
+        free(all);
+        free(costs);
+        return NULL;
+    }
+    size_t k = 0;
+    for (thread_stats_t *ts = threads; ts; ts = ts->next) {
+        memcpy(all + k, ts->spans, ts->num_spans * sizeof(*all));
+        k += ts->num_spans;
+    }
+    qsort(all, total, sizeof(*all), cmp_span_pid);
+
+    size_t m = 0;
+    for (size_t i = 0; i < total; i++) {
+        if (m == 0 || costs[m - 1].pid != all[i].pid) {
+            costs[m++] = (pid_cost_t){ .pid = all[i].pid };
+        }
+        pid_cost_t *c = &costs[m - 1];
+        c->spans++;
+        c->calls += all[i].calls;
+        c->fdinfo += all[i].fdinfo;
+        c->ns += all[i].end - all[i].start;
+    }
+    free(all);
+    qsort(costs, m, sizeof(*costs), cmp_cost);
+    *n = m;
+    return costs;
+}
+
+static long peak_rss_kib(void)
+{
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) < 0) {
+        return 0;
+    }
+#ifdef __APPLE__
+    return ru.ru_maxrss / 1024;     /* Bytes on Darwin */
+#else
+    return ru.ru_maxrss;
+#endif
+}
+
+static void print_report(FILE *fp, int top)
+{
+    uint64_t wall = selfstats_now();
+
+    fprintf(fp, "Self stats: wall %.3f ms, cpu %.3f ms, peak RSS %ld KiB\n",
+            wall / 1e6, clock_ns(CLOCK_PROCESS_CPUTIME_ID) / 1e6, peak_rss_kib());
+
+    /* Heap column: change in bytes in use over the phase */
+#ifdef HAVE_HEAP_STATS
+    fprintf(fp, "\n%-16s %8s %12s %12s %12s\n", "phase", "runs", "wall ms", "cpu ms", "heap KiB");
+#else
+    fprintf(fp, "\n%-16s %8s %12s %12s\n", "phase", "runs", "wall ms", "cpu ms");
+#endif
+    for (int p = 0; p < SS_PHASE_COUNT; p++) {
+        if (phases[p].runs == 0) {
+            continue;
+        }
+        fprintf(fp, "%-16s %8llu %12.3f %12.3f", phase_names[p],
+                (unsigned long long)phases[p].runs,
+                phases[p].wall_ns / 1e6, phases[p].cpu_ns / 1e6);
+#ifdef HAVE_HEAP_STATS
+        fprintf(fp, " %+12lld", (long long)(phases[p].heap_delta / 1024));
+#endif
+        fputc('\n', fp);
+    }
+
+    uint64_t calls[CALL_COUNT] = {0}, ns[CALL_COUNT] = {0};
+    for (thread_stats_t *ts = threads; ts; ts = ts->next) {
+        for (int c = 0; c < CALL_COUNT; c++) {
+            calls[c] += ts->calls[c];
+            ns[c] += ts->ns[c];
+        }
+    }
+    fprintf(fp, "\n%-16s %8s %12s %12s\n", "call", "count", "total ms", "avg us");
+    for (int c = 0; c < CALL_COUNT; c++) {
+        if (calls[c] == 0) {
+            continue;
+        }
+        fprintf(fp, "%-16s %8llu %12.3f %12.3f\n", call_names[c],
+                (unsigned long long)calls[c], ns[c] / 1e6, ns[c] / 1e3 / (double)calls[c]);
+    }
+
+    /* Before the PID table below adds its own lookups */
+    ss_proc_cache_stats_t cache;
+    proc_cache_stats(&cache);
+    if (cache.lookups > 0) {
+        fprintf(fp, "\n%-16s %8s %12s\n", "proc cache", "count", "% lookups");
+        const struct {
+            const char *name;
+            uint64_t n;
+        } rows[] = {
+            { "lookups",   cache.lookups },
+            { "hits",      cache.hits },
+            { "misses",    cache.misses },
+            { "pid reuse", cache.reused },
+            { "uncached",  cache.uncached }
+        };
+        for (size_t r = 0; r < sizeof(rows) / sizeof(rows[0]); r++) {
+            fprintf(fp, "%-16s %8llu %12.1f\n", rows[r].name, (unsigned long long)rows[r].n,
+                    100.0 * (double)rows[r].n / (double)cache.lookups);
+        }
+    }
+
+    if (watch.ticks > 0) {
+        fprintf(fp, "\n%-16s %8s %12s %12s\n", "watch", "ticks", "processes", "rescanned");
+        fprintf(fp, "%-16s %8llu %12llu %12llu\n", "refresh", (unsigned long long)watch.ticks,
+                (unsigned long long)watch.procs, (unsigned long long)watch.rescanned);
+    }
+
+    size_t n;
+    pid_cost_t *costs = pid_costs(&n);
+    if (n == 0 || top <= 0) {
+        free(costs);
+        return;
+    }
+    fprintf(fp, "\nTop %d of %zu PIDs by scan time\n", top < (int)n ? top : (int)n, n);
+    fprintf(fp, "%8s %8s %8s %12s  %s\n", "pid", "calls", "fdinfo", "ms", "command");
+    for (size_t i = 0; i < n && i < (size_t)top; i++) {
+        ss_proc_meta_t meta = { .name = "?" };
+        if (real_ops) {
+            proc_cache_get(real_ops, costs[i].pid, &meta);
+        }
+        fprintf(fp, "%8d %8llu %8llu %12.3f  %s\n", (int)costs[i].pid,
+                (unsigned long long)costs[i].calls, (unsigned long long)costs[i].fdinfo,
+                costs[i].ns / 1e6, meta.name);
+    }
+    free(costs);
+}
+
+/* Chrome trace-event JSON: phases on tid 0, PID spans on their thread */
+static int write_trace(const char *path)
+{
+    FILE *fp = fopen(path, "w");
+    if (!fp) {
+        perror(path);
+        return -1;
+    }
+    int pid = (int)getpid();
+
+    fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(fp, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":0,"
+            "\"args\":{\"name\":\"ss\"}},\n", pid);
+    fprintf(fp, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":0,"
+            "\"args\":{\"name\":\"phases\"}}", pid);
+    for (thread_stats_t *ts = threads; ts; ts = ts->next) {
+        fprintf(fp, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+                "\"args\":{\"name\":\"thread %d\"}}", pid, ts->id, ts->id);
+    }
+    for (size_t i = 0; i < num_runs; i++) {
+        fprintf(fp, ",\n{\"name\":\"%s\",\"cat\":\"phase\",\"ph\":\"X\",\"ts\":%.3f,"
+                "\"dur\":%.3f,\"pid\":%d,\"tid\":0}",
+                phase_names[runs[i].phase], runs[i].start / 1e3,
+                (runs[i].end - runs[i].start) / 1e3, pid);
+    }
+    for (thread_stats_t *ts = threads; ts; ts = ts->next) {
+        for (size_t i = 0; i < ts->num_spans; i++) {
+            const pid_span_t *s = &ts->spans[i];
+            fprintf(fp, ",\n{\"name\":\"pid %d\",\"cat\":\"scan\",\"ph\":\"X\",\"ts\":%.3f,"
+                    "\"dur\":%.3f,\"pid\":%d,\"tid\":%d,"
+                    "\"args\":{\"pid\":%d,\"calls\":%u,\"fdinfo\":%u}}",
+                    (int)s->pid, s->start / 1e3, (s->end - s->start) / 1e3, pid, ts->id,
+                    (int)s->pid, s->calls, s->fdinfo);
+        }
+    }
+    fprintf(fp, "\n]}\n");
+
+    if (fclose(fp) != 0) {
+        perror(path);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Print the --self-stats report to stderr and write the --trace file.
+ * Returns -1 if the trace could not be written.
+ */
+int selfstats_finish(const ss_options_t *opts)
+{
+    if (!selfstats_on) {
+        return 0;
+    }
+    /* All other threads have been joined: close their last spans */
+    for (thread_stats_t *ts = threads; ts; ts = ts->next) {
+        close_span(ts);
+    }
+
+    int ret = 0;
+    if (opts->trace_file && write_trace(opts->trace_file) < 0) {
+        ret = -1;
+    }
+    if (opts->self_stats) {
+        print_report(stderr, opts->self_stats_top);
+    }
+    selfstats_on = false;
+    return ret;
+}
@@ -0,0 +1,427 @@
+/*
+ * ss - Socket Statistics for Apple platforms (macOS/iOS)
+ * Machine-readable output: --json, --ndjson, --csv
+ *
+ * Streaming serializers: each record is written field by field straight
+ * into the buffered writer (outbuf.c), so no document is built in memory.
+ * Every record carries the same fields; those that do not apply to a
+ * socket (ports of a UNIX socket, path of a TCP socket, ...) are null in
+ * JSON and empty in CSV.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include "ss.h"
+
+/* CSV header; must list the fields in the order emit_socket() writes them */
+static const char csv_header[] =
+    "netid,family,state,recv_q,send_q,local_addr,local_port,peer_addr,peer_port,"
+    "path,connected,pid,fd,uid,inode,process";
+
+/* Extra columns with -i and -o */
+static const char csv_info[] = ",mss,rcv_hiwat,snd_hiwat,rcv_used,snd_used";
+static const char csv_timers[] = ",timer_rexmt,timer_persist,timer_keepalive,timer_2msl";
+
+/* Serializer state for the current record */
+static ss_format_t fmt;
+static bool first_field;
+static size_t records;
+
+/* Length of the valid UTF-8 sequence starting at s, 0 if it is not one */
+static size_t utf8_len(const unsigned char *s)
+{
+    unsigned char c = s[0];
+    size_t len;
+    uint32_t cp;
+
+    if (c >= 0xc2 && c <= 0xdf) {
+        len = 2;
+        cp = c & 0x1f;
+    } else if (c >= 0xe0 && c <= 0xef) {
+        len = 3;
+        cp = c & 0x0f;
+    } else if (c >= 0xf0 && c <= 0xf4) {
+        len = 4;
+        cp = c & 0x07;
+    } else {
+        return 0;
+    }
+    for (size_t i = 1; i < len; i++) {
+        if ((s[i] & 0xc0) != 0x80) {
+            return 0;
+        }
+        cp = (cp << 6) | (s[i] & 0x3f);
+    }
+    /* Overlong forms, surrogates and code points past U+10FFFF */
+    if ((len == 3 && cp < 0x800) || (len == 4 && cp < 0x10000) ||
+        (cp >= 0xd800 && cp <= 0xdfff) || cp > 0x10ffff) {
+        return 0;
+    }
+    return len;
+}
+
+/*
+ * Write a JSON string literal. Process names and UNIX paths are raw
+ * bytes; a byte that is not part of valid UTF-8 is written as \u00XX so
+ * the document stays valid.
+ */
+static void json_string(const char *s)
+{
+    static const char hex[] = "0123456789abcdef";
+    const char *run = s;
+
+    out_char('"');
+    while (*s) {
+        unsigned char c = (unsigned char)*s;
+        if (c >= 0x20 && c < 0x80 && c != '"' && c != '\\') {
+            s++;
+            continue;
+        }
+        if (c >= 0x80) {
+            size_t len = utf8_len((const unsigned char *)s);
+            if (len > 0) {
+                s += len;
+                continue;
+            }
+        }
+        out_write(run, (size_t)(s - run));
+        run = ++s;
+        switch (c) {
+            case '"':  out_str("\\\""); break;
+            case '\\': out_str("\\\\"); break;
+            case '\n': out_str("\\n"); break;
+            case '\r': out_str("\\r"); break;
+            case '\t': out_str("\\t"); break;
+            default: {
+                char esc[6] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf] };
+                out_write(esc, sizeof(esc));
+                break;
+            }
+        }
+    }
+    out_write(run, (size_t)(s - run));
+    out_char('"');
+}
+
+/* Write a CSV field, quoted only if it needs to be */
+static void csv_string(const char *s)
+{
+    if (strpbrk(s, ",\"\r\n") == NULL) {
+        out_str(s);
+        return;
+    }
+    out_char('"');
+    for (const char *q; (q = strchr(s, '"')) != NULL; s = q + 1) {
+        out_write(s, (size_t)(q - s + 1));
+        out_char('"');
+    }
+    out_str(s);
+    out_char('"');
+}
+
+/* Separator and key before a field */
+static void field_start(const char *key)
+{
+    if (!first_field) {
+        out_char(',');
+    }
+    first_field = false;
+    if (fmt != SS_FORMAT_CSV) {
+        out_char('"');
+        out_str(key);
+        out_str("\":");
+    }
+}
+
+static void field_null(const char *key)
+{
+    field_start(key);
+    if (fmt != SS_FORMAT_CSV) {
+        out_str("null");
+    }
+}
+
+/* String field; NULL writes null */
+static void field_str(const char *key, const char *val)
+{
+    if (val == NULL) {
+        field_null(key);
+        return;
+    }
+    field_start(key);
+    if (fmt == SS_FORMAT_CSV) {
+        csv_string(val);
+    } else {
+        json_string(val);
+    }
+}
+
+static void field_uint(const char *key, uint64_t val)
+{
+    field_start(key);
+    out_uint(val, 0, false);
+}
+
+static void field_int(const char *key, int64_t val)
+{
+    field_start(key);
+    out_int(val, 0, false);
+}
+
+static void field_bool(const char *key, bool val)
+{
+    field_start(key);
+    out_str(val ? "true" : "false");
+}
+
+static const char *family_name(const ss_sock_info_t *sock)
+{
+    switch (sock->family) {
+        case SS_FAMILY_INET:  return "inet";
+        case SS_FAMILY_INET6: return "inet6";
+        case SS_FAMILY_UNIX:  return "unix";
+        default:              return "unknown";
+    }
+}
+
+/* All fields of one record, in csv_header order */
+static void emit_socket(const ss_sock_table_t *table, const ss_sock_info_t *sock,
+                        const ss_options_t *opts)
+{
+    bool inet = (sock->family == SS_FAMILY_INET || sock->family == SS_FAMILY_INET6);
+
+    first_field = true;
+    field_str("netid", get_proto_name(sock));
+    field_str("family", family_name(sock));
+    field_str("state", tcp_state_to_string(sock->state));
+    field_uint("recv_q", sock->recv_queue);
+    field_uint("send_q", sock->send_queue);
+
+    if (inet) {
+        char local[INET6_ADDRSTRLEN];
+        char remote[INET6_ADDRSTRLEN];
+        int af = (sock->family == SS_FAMILY_INET) ? AF_INET : AF_INET6;
+        inet_ntop(af, &sock->local_ip, local, sizeof(local));
+        inet_ntop(af, &sock->remote_ip, remote, sizeof(remote));
+        field_str("local_addr", local);
+        field_uint("local_port", sock->local_port);
+        field_str("peer_addr", remote);
+        field_uint("peer_port", sock->remote_port);
+        field_null("path");
+        field_null("connected");
+    } else {
+        field_null("local_addr");
+        field_null("local_port");
+        field_null("peer_addr");
+        field_null("peer_port");
+        field_str("path", sock->unix_path ? sock_table_str(table, sock->unix_path) : NULL);
+        field_bool("connected", sock->unix_connected);
+    }
+
+    if (sock->pid > 0) {
+        field_int("pid", sock->pid);
+        field_int("fd", sock->fd);
+    } else {
+        field_null("pid");
+        field_null("fd");
+    }
+    field_uint("uid", sock->uid);
+    field_uint("inode", sock->inode);
+    /* A loaded snapshot always has names: show them only with -p, as live */
+    field_str("process", sock->proc_name && opts->show_process ?
+                         sock_table_str(table, sock->proc_name) : NULL);
+
+    /* Internals: null where the collector stored none (snapshots, netlink) */
+    const ss_sock_ext_t *ext = (opts->tcp_info || opts->timers) ? sock_table_ext_of(table, sock) : NULL;
+    bool tcp = ext && ext->has_tcp;
+    if (opts->tcp_info) {
+        if (tcp) {
+            field_uint("mss", ext->mss);
+        } else {
+            field_null("mss");
+        }
+        if (ext) {
+            field_uint("rcv_hiwat", ext->rcv_hiwat);
+            field_uint("snd_hiwat", ext->snd_hiwat);
+            field_uint("rcv_used", ext->rcv_used);
+            field_uint("snd_used", ext->snd_used);
+        } else {
+            field_null("rcv_hiwat");
+            field_null("snd_hiwat");
+            field_null("rcv_used");
+            field_null("snd_used");
+        }
+    }
+    if (opts->timers) {
+        static const char *const keys[] = {
+            "timer_rexmt", "timer_persist", "timer_keepalive", "timer_2msl"
+        };
+        for (int t = 0; t < 4; t++) {
+            if (tcp) {
+                field_uint(keys[t], ext->timer[t]);
+            } else {
+                field_null(keys[t]);
+            }
+        }
+    }
+}
+
+/* Start of the socket list */
+void serialize_begin(const ss_options_t *opts)
+{
+    fmt = opts->format;
+    records = 0;
+    if (fmt == SS_FORMAT_JSON) {
+        out_char('[');
+    } else if (fmt == SS_FORMAT_CSV && !opts->no_header) {
+        out_str(csv_header);
+        if (opts->tcp_info) {
+            out_str(csv_info);
+        }
+        if (opts->timers) {
+            out_str(csv_timers);
+        }
+        out_char('\n');
+    }
+}
+
+void serialize_socket(const ss_sock_table_t *table, const ss_sock_info_t *sock,
+                      const ss_options_t *opts)
+{
+    switch (fmt) {
+        case SS_FORMAT_JSON:
+            out_str(records ? ",\n{" : "\n{");
+            emit_socket(table, sock, opts);
+            out_char('}');
+            break;
+        case SS_FORMAT_NDJSON:
+            out_char('{');
+            emit_socket(table, sock, opts);
+            out_str("}\n");
+            break;
+        default:
+            emit_socket(table, sock, opts);
+            out_char('\n');
+            break;
+    }
+    records++;
+}
+
+/* End of the socket list */
+void serialize_end(const ss_options_t *opts)
+{
+    (void)opts;
+
+    if (fmt == SS_FORMAT_JSON) {
+        out_str(records ? "\n]\n" : "]\n");
+    }
+}
+
+/* Start of a --group-by list; row gives the key fields */
+void serialize_group_begin(const ss_group_row_t *row, const ss_options_t *opts)
+{
+    fmt = opts->format;
+    records = 0;
+    if (fmt == SS_FORMAT_JSON) {
+        out_char('[');
+    } else if (fmt == SS_FORMAT_CSV && !opts->no_header) {
+        for (int k = 0; k < 2 && row->key[k]; k++) {
+            out_str(row->key[k]);
+            out_char(',');
+        }
+        out_str("sockets,recv_q,recv_q_max,send_q,send_q_max\n");
+    }
+}
+
+/* Key fields, then the totals */
+static void emit_group(const ss_group_row_t *row)
+{
+    first_field = true;
+    for (int k = 0; k < 2 && row->key[k]; k++) {
+        if (row->numeric[k] && row->val[k]) {
+            field_start(row->key[k]);
+            out_str(row->val[k]);
+        } else {
+            field_str(row->key[k], row->val[k]);
+        }
+    }
+    field_uint("sockets", row->sockets);
+    field_uint("recv_q", row->recv_q);
+    field_uint("recv_q_max", row->recv_q_max);
+    field_uint("send_q", row->send_q);
+    field_uint("send_q_max", row->send_q_max);
+}
+
+void serialize_group(const ss_group_row_t *row, const ss_options_t *opts)
+{
+    (void)opts;
+
+    switch (fmt) {
+        case SS_FORMAT_JSON:
+            out_str(records ? ",\n{" : "\n{");
+            emit_group(row);
+            out_char('}');
+            break;
+        case SS_FORMAT_NDJSON:
+            out_char('{');
+            emit_group(row);
+            out_str("}\n");
+            break;
+        default:
+            emit_group(row);
+            out_char('\n');
+            break;
+    }
+    records++;
+}
+
+/* -s totals as one object (JSON, NDJSON) or a header and one row (CSV) */
+void serialize_summary(const ss_stats_t *stats, const ss_options_t *opts)
+{
+    static const struct {
+        const char *key;
+        size_t off;
+    } counters[] = {
+        { "tcp",         offsetof(ss_stats_t, tcp_total) },
+        { "estab",       offsetof(ss_stats_t, tcp_established) },
+        { "syn_sent",    offsetof(ss_stats_t, tcp_syn_sent) },
+        { "syn_recv",    offsetof(ss_stats_t, tcp_syn_recv) },
+        { "fin_wait1",   offsetof(ss_stats_t, tcp_fin_wait1) },
+        { "fin_wait2",   offsetof(ss_stats_t, tcp_fin_wait2) },
+        { "time_wait",   offsetof(ss_stats_t, tcp_time_wait) },
+        { "close_wait",  offsetof(ss_stats_t, tcp_close_wait) },
+        { "last_ack",    offsetof(ss_stats_t, tcp_last_ack) },
+        { "listen",      offsetof(ss_stats_t, tcp_listen) },
+        { "closing",     offsetof(ss_stats_t, tcp_closing) },
+        { "closed",      offsetof(ss_stats_t, tcp_closed) },
+        { "udp",         offsetof(ss_stats_t, udp_total) },
+        { "unix_stream", offsetof(ss_stats_t, unix_stream_total) },
+        { "unix_dgram",  offsetof(ss_stats_t, unix_dgram_total) },
+    };
+    size_t n = sizeof(counters) / sizeof(counters[0]);
+    uint32_t total = stats->tcp_total + stats->udp_total +
+                     stats->unix_stream_total + stats->unix_dgram_total;
+
+    fmt = opts->format;
+    if (fmt != SS_FORMAT_CSV) {
+        out_char('{');
+    } else if (!opts->no_header) {
+        out_str("total");
+        for (size_t i = 0; i < n; i++) {
+            out_char(',');
+            out_str(counters[i].key);
+        }
+        out_char('\n');
+    }
+
+    first_field = true;
+    field_uint("total", total);
+    for (size_t i = 0; i < n; i++) {
+        uint32_t v;
+        memcpy(&v, (const char *)stats + counters[i].off, sizeof(v));
+        field_uint(counters[i].key, v);
+    }
+    out_str(fmt == SS_FORMAT_CSV ? "\n" : "}\n");
+}
@@ -0,0 +1,341 @@
+/*
+ * ss - Socket Statistics for Apple platforms (macOS/iOS)
+ * Binary socket table snapshots (--save / --load)
+ *
+ * A snapshot is the finalized socket table written out as it sits in
+ * memory: a header, the fixed-width records grouped into the UDP, TCP and
+ * UNIX sections (the header holds each section's range), and the string
+ * pool the records' offsets point into. --load maps the file and hands
+ * the mapping to the output code as a table, so nothing is copied and no
+ * libproc call is made; the filters run over the records while printing.
+ *
+ * Records are stored in host byte order. The header records the byte
+ * order and record size it was written with, and a file from a host that
+ * differs in either is rejected rather than converted. ss_sock_info_t has
+ * the same layout on macOS, iOS and Linux, pinned by the asserts below.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "ss.h"
+
+#define SNAPSHOT_MAGIC "ss-snap"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_BYTE_ORDER 0x01020304u
+
+/* Records start at this alignment in the file */
+#define SNAPSHOT_ALIGN 64
+
+/* File header; all offsets are from the start of the file */
+typedef struct {
+    char magic[8];              /* SNAPSHOT_MAGIC, NUL-padded */
+    uint32_t version;
+    uint32_t byte_order;        /* SNAPSHOT_BYTE_ORDER as written */
+    uint32_t header_size;
+    uint32_t record_size;       /* sizeof(ss_sock_info_t) */
+    uint64_t count;
+    uint64_t records_off;
+    uint64_t strings_off;
+    uint64_t strings_len;       /* Pool bytes, offset 0 is "" */
+    uint64_t group_start[SS_GROUP_COUNT + 1];   /* Section index, in records */
+} snapshot_header_t;
+
+_Static_assert(sizeof(ss_sock_info_t) == 80, "snapshot record layout changed");
+_Static_assert(offsetof(ss_sock_info_t, seq) == 32, "snapshot record layout changed");
+_Static_assert(offsetof(ss_sock_info_t, recv_queue) == 48, "snapshot record layout changed");
+_Static_assert(offsetof(ss_sock_info_t, proc_name) == 76, "snapshot record layout changed");
+
+static uint64_t align_up(uint64_t v)
+{
+    return (v + SNAPSHOT_ALIGN - 1) & ~(uint64_t)(SNAPSHOT_ALIGN - 1);
+}
+
+static bool write_all(FILE *fp, const void *data, size_t len)
+{
+    return len == 0 || fwrite(data, 1, len, fp) == len;
+}
+
+static void build_header(const ss_sock_table_t *table, snapshot_header_t *hdr)
+{
+    memset(hdr, 0, sizeof(*hdr));
+    memcpy(hdr->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    hdr->version = SNAPSHOT_VERSION;
+    hdr->byte_order = SNAPSHOT_BYTE_ORDER;
+    hdr->header_size = sizeof(*hdr);
+    hdr->record_size = sizeof(ss_sock_info_t);
+    hdr->count = table->count;
+    hdr->records_off = align_up(sizeof(*hdr));
+    hdr->strings_off = hdr->records_off + hdr->count * sizeof(ss_sock_info_t);
+    /* An empty pool is still written as its "" */
+    hdr->strings_len = table->strings_len ? table->strings_len : 1;
+    for (int g = 0; g <= SS_GROUP_COUNT; g++) {
+        hdr->group_start[g] = table->group_start[g];
+    }
+}
+
+/* Bytes of the snapshot image of a finalized table */
+size_t snapshot_size(const ss_sock_table_t *table)
+{
+    snapshot_header_t hdr;
+    build_header(table, &hdr);
+    return (size_t)(hdr.strings_off + hdr.strings_len);
+}
+
+/* Write the image of a finalized table to buf (snapshot_size() bytes) */
+void snapshot_encode(const ss_sock_table_t *table, void *buf)
+{
+    snapshot_header_t hdr;
+    char *p = buf;
+
+    build_header(table, &hdr);
+    memset(p, 0, hdr.records_off);
+    memcpy(p, &hdr, sizeof(hdr));
+    if (table->count) {
+        memcpy(p + hdr.records_off, table->recs, table->count * sizeof(ss_sock_info_t));
+    }
+    if (table->strings_len) {
+        memcpy(p + hdr.strings_off, table->strings, table->strings_len);
+    } else {
+        p[hdr.strings_off] = '\0';
+    }
+}
+
+/* Write a finalized table to path (through a temporary file renamed into place) */
+static int write_snapshot(const ss_sock_table_t *table, const char *path)
+{
+    static const char zeros[SNAPSHOT_ALIGN];
+    snapshot_header_t hdr;
+
+    build_header(table, &hdr);
+
+    char tmp[MAX_PATH_LEN];
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp)) {
+        fprintf(stderr, "%s: path too long\n", path);
+        return -1;
+    }
+    FILE *fp = fopen(tmp, "wb");
+    if (!fp) {
+        perror(tmp);
+        return -1;
+    }
+    bool ok = write_all(fp, &hdr, sizeof(hdr)) &&
+              write_all(fp, zeros, hdr.records_off - sizeof(hdr)) &&
+              write_all(fp, table->recs, table->count * sizeof(ss_sock_info_t)) &&
+              (table->strings_len ? write_all(fp, table->strings, table->strings_len)
+                                  : write_all(fp, zeros, 1));
+    if (fclose(fp) != 0) {
+        ok = false;
+    }
+    if (!ok || rename(tmp, path) != 0) {
+        perror(path);
+        remove(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+/* Options that make a collection see every socket, with process information */
+void snapshot_options(const ss_options_t *opts, ss_options_t *out)
+{
+    *out = *opts;
+    out->show_tcp = true;
+    out->show_udp = true;
+    out->show_unix = true;
+    out->show_all = true;
+    out->show_listening = false;
+    out->show_process = true;
+    out->extended = true;
+    out->summary = false;
+    out->ipv4_only = false;
+    out->ipv6_only = false;
+    memset(&out->filter, 0, sizeof(out->filter));
+    out->src_cidrs = NULL;
+    out->dst_cidrs = NULL;
+}
+
+/*
+ * Collect every socket the collector sees, in all states and with process
+ * information, and write it to path. Only the process filters (--pid,
+ * --uid, --pgrp) narrow what is saved, since they decide which processes
+ * are walked.
+ */
+int snapshot_save(const ss_options_t *opts, const char *path)
+{
+    ss_options_t save_opts;
+    snapshot_options(opts, &save_opts);
+
+    ss_sock_table_t table = {0};
+    if (collect_all_sockets(&save_opts, &table) < 0) {
+        sock_table_free(&table);
+        return -1;
+    }
+
+    selfstats_phase_begin(SS_PHASE_OUTPUT);
+    int ret = write_snapshot(&table, path);
+    selfstats_phase_end(SS_PHASE_OUTPUT);
+
+    sock_table_free(&table);
+    return ret;
+}
+
+/* Header checks; the section index must cover the records exactly */
+static const char *check_header(const snapshot_header_t *hdr, size_t file_len)
+{
+    if (memcmp(hdr->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) {
+        return "not an ss snapshot";
+    }
+    if (hdr->version != SNAPSHOT_VERSION) {
+        return "unsupported snapshot version";
+    }
+    if (hdr->byte_order != SNAPSHOT_BYTE_ORDER) {
+        return "snapshot written on a host of other byte order";
+    }
+    if (hdr->header_size != sizeof(*hdr) || hdr->record_size != sizeof(ss_sock_info_t)) {
+        return "snapshot written with another record layout";
+    }
+    if (hdr->records_off < sizeof(*hdr) || hdr->records_off % SNAPSHOT_ALIGN != 0 ||
+        hdr->records_off > file_len ||
+        hdr->count > (file_len - hdr->records_off) / sizeof(ss_sock_info_t) ||
+        hdr->strings_off != hdr->records_off + hdr->count * sizeof(ss_sock_info_t) ||
+        hdr->strings_len == 0 || hdr->strings_len > UINT32_MAX ||
+        hdr->strings_len > file_len - hdr->strings_off) {
+        return "snapshot is truncated";
+    }
+    if (hdr->group_start[0] != 0 || hdr->group_start[SS_GROUP_COUNT] != hdr->count) {
+        return "snapshot section index is corrupt";
+    }
+    for (int g = 0; g < SS_GROUP_COUNT; g++) {
+        if (hdr->group_start[g] > hdr->group_start[g + 1]) {
+            return "snapshot section index is corrupt";
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Every record must belong to its section and have string offsets inside
+ * the pool (whose last byte is a NUL), so printing can trust it.
+ */
+static const char *check_records(const ss_sock_table_t *table)
+{
+    if (table->strings[0] != '\0' || table->strings[table->strings_len - 1] != '\0') {
+        return "snapshot string pool is corrupt";
+    }
+    for (int g = 0; g < SS_GROUP_COUNT; g++) {
+        for (size_t i = table->group_start[g]; i < table->group_start[g + 1]; i++) {
+            const ss_sock_info_t *sock = &table->recs[i];
+            if (sock->family >= SS_FAMILY_UNKNOWN || sock->protocol >= SS_PROTO_UNKNOWN ||
+                sock->state > SS_TCP_TIME_WAIT || sock_group(sock) != (ss_group_t)g ||
+                sock->unix_path >= table->strings_len ||
+                sock->proc_name >= table->strings_len) {
+                return "snapshot record is corrupt";
+            }
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Use a snapshot image in a mapping of len bytes as a read-only table:
+ * recs and strings point into it, and sock_table_free() unmaps it. On
+ * error (reported with name) the mapping is unmapped. The table must not
+ * be grown.
+ */
+int snapshot_attach(void *map, size_t len, const char *name, ss_sock_table_t *table)
+{
+    const snapshot_header_t *hdr = map;
+    const char *err = len < sizeof(*hdr) ? "not an ss snapshot" : check_header(hdr, len);
+    if (!err) {
+        memset(table, 0, sizeof(*table));
+        table->recs = (ss_sock_info_t *)((char *)map + hdr->records_off);
+        table->count = hdr->count;
+        table->cap = hdr->count;
+        table->strings = (char *)map + hdr->strings_off;
+        table->strings_len = hdr->strings_len;
+        table->strings_cap = hdr->strings_len;
+        for (int g = 0; g <= SS_GROUP_COUNT; g++) {
+            table->group_start[g] = hdr->group_start[g];
+        }
+        table->map = map;
+        table->map_len = len;
+        err = check_records(table);
+    }
+    if (err) {
+        fprintf(stderr, "%s: %s\n", name, err);
+        munmap(map, len);
+        memset(table, 0, sizeof(*table));
+        return -1;
+    }
+    return 0;
+}
+
+/* Map a snapshot file as a read-only table (see snapshot_attach()) */
+int snapshot_load(const char *path, ss_sock_table_t *table)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+    if ((size_t)st.st_size < sizeof(snapshot_header_t)) {
+        fprintf(stderr, "%s: not an ss snapshot\n", path);
+        close(fd);
+        return -1;
+    }
+
+    size_t len = (size_t)st.st_size;
+    void *map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror(path);
+        return -1;
+    }
+    return snapshot_attach(map, len, path, table);
+}
+
+/*
+ * Filter for a loaded snapshot: the listing rules plus the process filters
+ * a live collection applies while walking processes. Process groups are
+ * not recorded, so main() rejects --pgrp with --load.
+ */
+bool snapshot_include(const ss_sock_info_t *sock, const ss_options_t *opts)
+{
+    if (!should_include(sock, opts)) {
+        return false;
+    }
+    if (opts->filter_uid && sock->uid != opts->uid) {
+        return false;
+    }
+    if (opts->num_pids > 0) {
+        for (int i = 0; i < opts->num_pids; i++) {
+            if (opts->pids[i] == sock->pid) {
+                return true;
+            }
+        }
+        return false;
+    }
+    return true;
+}
+
+/* Whether a section holds any protocol the options show */
+bool snapshot_group_shown(ss_group_t group, const ss_options_t *opts)
+{
+    switch (group) {
+        case SS_GROUP_UDP:
+            return opts->show_udp;
+        case SS_GROUP_TCP:
+            return opts->show_tcp;
+        default:
+            return opts->show_unix;
+    }
+}
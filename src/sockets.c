@@ -1,6 +1,10 @@
 /*
  * ss - Socket Statistics for Apple platforms (macOS/iOS)
  * Socket collection using libproc API
+ * (the shared filter/format helpers are also used by sockets_netlink.c)
+ *
+ * The PID/fd walker goes through a libproc provider (ss_libproc_ops_t), and
+ * collect_all_sockets() dispatches to a collector backend (ss_collector_t).
  */
 
 #include <stdio.h>
@@ -16,108 +20,92 @@
 #include "libproc_compat.h"
 #include "ss.h"
 
-/* Maximum number of PIDs to enumerate */
-#define MAX_PIDS 65536
-
-/* Darwin TCP states from tcp_fsm.h */
-#define TCPS_CLOSED         0
-#define TCPS_LISTEN         1
-#define TCPS_SYN_SENT       2
-#define TCPS_SYN_RECEIVED   3
-#define TCPS_ESTABLISHED    4
-#define TCPS_CLOSE_WAIT     5
-#define TCPS_FIN_WAIT_1     6
-#define TCPS_CLOSING        7
-#define TCPS_LAST_ACK       8
-#define TCPS_FIN_WAIT_2     9
-#define TCPS_TIME_WAIT      10
-
-/* Convert Darwin TCP state to our state enum */
-static ss_tcp_state_t darwin_to_ss_state(int state)
-{
-    switch (state) {
-        case TCPS_CLOSED:       return SS_TCP_CLOSED;
-        case TCPS_LISTEN:       return SS_TCP_LISTEN;
-        case TCPS_SYN_SENT:     return SS_TCP_SYN_SENT;
-        case TCPS_SYN_RECEIVED: return SS_TCP_SYN_RECV;
-        case TCPS_ESTABLISHED:  return SS_TCP_ESTABLISHED;
-        case TCPS_CLOSE_WAIT:   return SS_TCP_CLOSE_WAIT;
-        case TCPS_FIN_WAIT_1:   return SS_TCP_FIN_WAIT1;
-        case TCPS_CLOSING:      return SS_TCP_CLOSING;
-        case TCPS_LAST_ACK:     return SS_TCP_LAST_ACK;
-        case TCPS_FIN_WAIT_2:   return SS_TCP_FIN_WAIT2;
-        case TCPS_TIME_WAIT:    return SS_TCP_TIME_WAIT;
-        default:                return SS_TCP_UNKNOWN;
-    }
-}
+#ifdef IOS_BUILD
+#include <pthread.h>
+#include "fdinfo_layout.h"
+#endif
 
-/* Format IPv4 address with port (Linux ss compatible: 0.0.0.0 instead of *) */
-static void format_addr_v4(struct in_addr *addr, uint16_t port, char *buf, size_t buflen)
+/* Append ":port", or ":*" for port 0; p must have room for 7 bytes */
+static char *append_port(char *p, uint16_t port)
 {
-    char ip_str[INET_ADDRSTRLEN];
-    
-    if (addr->s_addr == INADDR_ANY) {
-        strcpy(ip_str, "0.0.0.0");
-    } else {
-        inet_ntop(AF_INET, addr, ip_str, sizeof(ip_str));
-    }
-    
+    *p++ = ':';
     if (port == 0) {
-        snprintf(buf, buflen, "%s:*", ip_str);
+        *p++ = '*';
     } else {
-        snprintf(buf, buflen, "%s:%u", ip_str, port);
+        char digits[5];
+        int n = 0;
+        do {
+            digits[n++] = (char)('0' + port % 10);
+            port /= 10;
+        } while (port);
+        while (n > 0) {
+            *p++ = digits[--n];
+        }
     }
+    *p = '\0';
+    return p;
 }
 
-/* Format IPv6 address with port (Linux ss compatible: [::] instead of *) */
-static void format_addr_v6(struct in6_addr *addr, uint16_t port, char *buf, size_t buflen)
+/* Copy a formatted address out, truncating like snprintf; returns its length */
+static size_t copy_addr(char *buf, size_t buflen, const char *src, size_t len)
 {
-    char ip_str[INET6_ADDRSTRLEN];
-    
-    if (IN6_IS_ADDR_UNSPECIFIED(addr)) {
-        strcpy(ip_str, "::");
-    } else {
-        inet_ntop(AF_INET6, addr, ip_str, sizeof(ip_str));
+    if (buflen == 0) {
+        return 0;
     }
-    
-    if (port == 0) {
-        snprintf(buf, buflen, "[%s]:*", ip_str);
-    } else {
-        snprintf(buf, buflen, "[%s]:%u", ip_str, port);
+    if (len >= buflen) {
+        len = buflen - 1;
     }
+    memcpy(buf, src, len);
+    buf[len] = '\0';
+    return len;
 }
 
-/* Add socket to list */
-static ss_sock_info_t *add_to_list(ss_sock_info_t *list, ss_sock_info_t *sock)
+/* Format IPv4 address with port (Linux ss compatible: 0.0.0.0 instead of *) */
+size_t format_addr_v4(const struct in_addr *addr, uint16_t port, char *buf, size_t buflen)
 {
-    ss_sock_info_t *new_sock = malloc(sizeof(ss_sock_info_t));
-    if (!new_sock) {
-        return list;
-    }
+    /* "255.255.255.255:65535" */
+    char tmp[INET_ADDRSTRLEN + 7];
+    const uint8_t *b = (const uint8_t *)&addr->s_addr;
+    char *p = tmp;
     
-    memcpy(new_sock, sock, sizeof(ss_sock_info_t));
-    new_sock->next = list;
-    return new_sock;
+    for (int i = 0; i < 4; i++) {
+        unsigned v = b[i];
+        if (v >= 100) {
+            *p++ = (char)('0' + v / 100);
+        }
+        if (v >= 10) {
+            *p++ = (char)('0' + v / 10 % 10);
+        }
+        *p++ = (char)('0' + v % 10);
+        if (i < 3) {
+            *p++ = '.';
+        }
+    }
+    p = append_port(p, port);
+    return copy_addr(buf, buflen, tmp, (size_t)(p - tmp));
 }
 
-/* Check if socket already exists in list (avoid duplicates) */
-static bool socket_exists(ss_sock_info_t *list, ss_sock_info_t *sock)
+/* Format IPv6 address with port (Linux ss compatible: [::] instead of *) */
+size_t format_addr_v6(const struct in6_addr *addr, uint16_t port, char *buf, size_t buflen)
 {
-    for (ss_sock_info_t *s = list; s != NULL; s = s->next) {
-        if (s->protocol == sock->protocol &&
-            s->family == sock->family &&
-            s->local_port == sock->local_port &&
-            s->remote_port == sock->remote_port &&
-            strcmp(s->local_addr, sock->local_addr) == 0 &&
-            strcmp(s->remote_addr, sock->remote_addr) == 0) {
-            return true;
-        }
+    /* "[" address "]:65535" */
+    char tmp[INET6_ADDRSTRLEN + 9];
+    char *p = tmp;
+    
+    *p++ = '[';
+    if (IN6_IS_ADDR_UNSPECIFIED(addr)) {
+        strcpy(p, "::");
+    } else {
+        inet_ntop(AF_INET6, addr, p, INET6_ADDRSTRLEN);
     }
-    return false;
+    p += strlen(p);
+    *p++ = ']';
+    p = append_port(p, port);
+    return copy_addr(buf, buflen, tmp, (size_t)(p - tmp));
 }
 
 /* Check if socket should be included based on options */
-static bool should_include(const ss_sock_info_t *sock, const ss_options_t *opts)
+bool should_include(const ss_sock_info_t *sock, const ss_options_t *opts)
 {
     /* Filter by protocol */
     if (sock->protocol == SS_PROTO_TCP && !opts->show_tcp) {
@@ -131,8 +119,12 @@ static bool should_include(const ss_sock_info_t *sock, const ss_options_t *opts)
         return false;
     }
     
-    /* Filter by listening state */
-    if (opts->show_listening) {
+    /* A state filter replaces the -l / -a rules */
+    if (opts->filter.has_states) {
+        if (!filter_state_match(&opts->filter, sock)) {
+            return false;
+        }
+    } else if (opts->show_listening) {
         if (sock->protocol == SS_PROTO_TCP && sock->state != SS_TCP_LISTEN) {
             return false;
         }
@@ -143,7 +135,8 @@ static bool should_include(const ss_sock_info_t *sock, const ss_options_t *opts)
     }
     
     /* If not showing all, filter to established/listening only */
-    if (!opts->show_all && !opts->show_listening && sock->protocol == SS_PROTO_TCP) {
+    if (!opts->filter.has_states && !opts->show_all && !opts->show_listening &&
+        sock->protocol == SS_PROTO_TCP) {
         if (sock->state != SS_TCP_ESTABLISHED && sock->state != SS_TCP_LISTEN) {
             return false;
         }
@@ -157,62 +150,243 @@ static bool should_include(const ss_sock_info_t *sock, const ss_options_t *opts)
         return false;
     }
     
+    /* Filter expression */
+    if (opts->filter.len > 0 && !filter_match(&opts->filter, sock)) {
+        return false;
+    }
+    
+    /* --src-file / --dst-file prefix lists */
+    if (opts->src_cidrs && !cidr_trie_match(opts->src_cidrs, sock, &sock->local_ip)) {
+        return false;
+    }
+    if (opts->dst_cidrs && !cidr_trie_match(opts->dst_cidrs, sock, &sock->remote_ip)) {
+        return false;
+    }
+    
     return true;
 }
 
-/* Get process name by PID */
-static void get_proc_name(pid_t pid, char *name, size_t name_len)
+/* Maximum number of PIDs to enumerate */
+#define MAX_PIDS 65536
+
+/* Darwin TCP states from tcp_fsm.h */
+#define TCPS_CLOSED         0
+#define TCPS_LISTEN         1
+#define TCPS_SYN_SENT       2
+#define TCPS_SYN_RECEIVED   3
+#define TCPS_ESTABLISHED    4
+#define TCPS_CLOSE_WAIT     5
+#define TCPS_FIN_WAIT_1     6
+#define TCPS_CLOSING        7
+#define TCPS_LAST_ACK       8
+#define TCPS_FIN_WAIT_2     9
+#define TCPS_TIME_WAIT      10
+
+/* Convert Darwin TCP state to our state enum */
+ss_tcp_state_t darwin_to_ss_state(int state)
+{
+    switch (state) {
+        case TCPS_CLOSED:       return SS_TCP_CLOSED;
+        case TCPS_LISTEN:       return SS_TCP_LISTEN;
+        case TCPS_SYN_SENT:     return SS_TCP_SYN_SENT;
+        case TCPS_SYN_RECEIVED: return SS_TCP_SYN_RECV;
+        case TCPS_ESTABLISHED:  return SS_TCP_ESTABLISHED;
+        case TCPS_CLOSE_WAIT:   return SS_TCP_CLOSE_WAIT;
+        case TCPS_FIN_WAIT_1:   return SS_TCP_FIN_WAIT1;
+        case TCPS_CLOSING:      return SS_TCP_CLOSING;
+        case TCPS_LAST_ACK:     return SS_TCP_LAST_ACK;
+        case TCPS_FIN_WAIT_2:   return SS_TCP_FIN_WAIT2;
+        case TCPS_TIME_WAIT:    return SS_TCP_TIME_WAIT;
+        default:                return SS_TCP_UNKNOWN;
+    }
+}
+
+/* Any of --uid, --pgrp, --pid given */
+bool proc_filter_active(const ss_options_t *opts)
+{
+    return opts->filter_uid || opts->filter_pgrp || opts->num_pids > 0;
+}
+
+/* Whether pid passes the --uid / --pgrp filters selected by the flags */
+static bool proc_matches(const ss_libproc_ops_t *ops, pid_t pid, const ss_options_t *opts,
+                         bool check_uid, bool check_pgrp)
+{
+    struct proc_bsdinfo bi;
+
+    if (ops->pidinfo(pid, PROC_PIDTBSDINFO, 0, &bi, sizeof(bi)) < (int)sizeof(bi)) {
+        return false;
+    }
+    if (check_uid && bi.pbi_uid != opts->uid) {
+        return false;
+    }
+    if (check_pgrp && (pid_t)bi.pbi_pgid != opts->pgrp) {
+        return false;
+    }
+    return true;
+}
+
+/*
+ * PIDs to walk: the --pid list as given (no enumeration), else the
+ * kernel's list narrowed by --pgrp (PROC_PGRP_ONLY) or --uid
+ * (PROC_UID_ONLY), else all PIDs. A filter the list type does not cover
+ * is checked per PID. *buf (*cap entries) is grown as needed and can be
+ * reused across calls. Returns the number of PIDs, or -1.
+ */
+static int list_pids(const ss_libproc_ops_t *ops, const ss_options_t *opts,
+                     pid_t **buf, int *cap)
 {
-    char pathbuf[PROC_PIDPATHINFO_MAXSIZE];
+    uint32_t type = PROC_ALL_PIDS;
+    uint32_t typeinfo = 0;
+    int want, n;
     
-    int ret = proc_pidpath(pid, pathbuf, sizeof(pathbuf));
-    if (ret > 0) {
-        char *slash = strrchr(pathbuf, '/');
-        if (slash) {
-            strncpy(name, slash + 1, name_len - 1);
-        } else {
-            strncpy(name, pathbuf, name_len - 1);
+    if (opts->num_pids > 0) {
+        want = opts->num_pids;
+    } else {
+        if (opts->filter_pgrp) {
+            type = PROC_PGRP_ONLY;
+            typeinfo = (uint32_t)opts->pgrp;
+        } else if (opts->filter_uid) {
+            type = PROC_UID_ONLY;
+            typeinfo = (uint32_t)opts->uid;
+        }
+        int bufsize = ops->listpids(type, typeinfo, NULL, 0);
+        if (bufsize <= 0) {
+            if (type != PROC_ALL_PIDS) {
+                return 0;
+            }
+            perror("proc_listpids");
+            return -1;
         }
-        name[name_len - 1] = '\0';
+        want = bufsize / (int)sizeof(pid_t);
+    }
+    
+    if (want > *cap) {
+        pid_t *pids = realloc(*buf, (size_t)want * sizeof(pid_t));
+        if (!pids) {
+            perror("realloc");
+            return -1;
+        }
+        *buf = pids;
+        *cap = want;
+    }
+    
+    if (opts->num_pids > 0) {
+        memcpy(*buf, opts->pids, (size_t)opts->num_pids * sizeof(pid_t));
+        n = opts->num_pids;
     } else {
-        /* Fallback to proc_name */
-        ret = proc_name(pid, name, (uint32_t)name_len);
-        if (ret <= 0) {
-            strncpy(name, "?", name_len);
+        n = ops->listpids(type, typeinfo, *buf, *cap * (int)sizeof(pid_t));
+        if (n <= 0) {
+            if (type != PROC_ALL_PIDS) {
+                return 0;
+            }
+            perror("proc_listpids");
+            return -1;
+        }
+        n /= (int)sizeof(pid_t);
+    }
+    
+    /* Filters the list type did not apply */
+    bool check_uid = opts->filter_uid && type != PROC_UID_ONLY;
+    bool check_pgrp = opts->filter_pgrp && type != PROC_PGRP_ONLY;
+    if (check_uid || check_pgrp) {
+        int kept = 0;
+        for (int i = 0; i < n; i++) {
+            if ((*buf)[i] != 0 && proc_matches(ops, (*buf)[i], opts, check_uid, check_pgrp)) {
+                (*buf)[kept++] = (*buf)[i];
+            }
         }
+        n = kept;
     }
+    return n;
 }
 
-/* Collect sockets from a single process */
-static ss_sock_info_t *collect_process_sockets(pid_t pid, ss_sock_info_t *list, 
-                                                const ss_options_t *opts)
+int list_target_pids(const ss_libproc_ops_t *ops, const ss_options_t *opts,
+                     pid_t **buf, int *cap)
+{
+    selfstats_phase_begin(SS_PHASE_PIDS);
+    int n = list_pids(ops, opts, buf, cap);
+    selfstats_phase_end(SS_PHASE_PIDS);
+    return n;
+}
+
+/* Get the fd table of a process; returns the number of entries (0 on failure) */
+int list_process_fds(const ss_libproc_ops_t *ops, pid_t pid, struct proc_fdinfo **out)
 {
     struct proc_fdinfo *fdinfo = NULL;
     int fd_bufsize, num_fds;
-    char proc_name[MAX_PROC_NAME] = {0};
-    bool got_proc_name = false;
+    
+    *out = NULL;
     
     /* Get number of file descriptors */
-    fd_bufsize = proc_pidinfo(pid, PROC_PIDLISTFDS, 0, NULL, 0);
+    fd_bufsize = ops->pidinfo(pid, PROC_PIDLISTFDS, 0, NULL, 0);
     if (fd_bufsize <= 0) {
-        return list;
+        return 0;
     }
     
     fdinfo = malloc(fd_bufsize);
     if (!fdinfo) {
-        return list;
+        return 0;
     }
     
-    num_fds = proc_pidinfo(pid, PROC_PIDLISTFDS, 0, fdinfo, fd_bufsize);
+    num_fds = ops->pidinfo(pid, PROC_PIDLISTFDS, 0, fdinfo, fd_bufsize);
     if (num_fds <= 0) {
         free(fdinfo);
-        return list;
+        return 0;
     }
     
-    num_fds /= sizeof(struct proc_fdinfo);
+    *out = fdinfo;
+    return num_fds / (int)sizeof(struct proc_fdinfo);
+}
+
+/*
+ * Buffer limits and fill and, for TCP, MSS, flags and timers. libproc reports the
+ * timers in kernel TCP ticks, which are milliseconds (TCP_RETRANSHZ).
+ */
+static void fill_sock_ext(ss_sock_ext_t *ext, const ss_sock_info_t *sock,
+                          const struct socket_fdinfo *si)
+{
+    ext->rcv_hiwat = si->psi.soi_rcv.sbi_hiwat;
+    ext->snd_hiwat = si->psi.soi_snd.sbi_hiwat;
+    ext->rcv_used = si->psi.soi_rcv.sbi_cc;
+    ext->snd_used = si->psi.soi_snd.sbi_cc;
+    if (sock->protocol != SS_PROTO_TCP) {
+        return;
+    }
+    const struct tcp_sockinfo *tcp = &si->psi.soi_proto.pri_tcp;
+    ext->has_tcp = true;
+    ext->mss = tcp->tcpsi_mss;
+    ext->flags = tcp->tcpsi_flags;
+    for (int t = 0; t < TSI_T_NTIMERS; t++) {
+        ext->timer[t] = tcp->tcpsi_timer[t] > 0 ? (uint32_t)tcp->tcpsi_timer[t] : 0;
+    }
+}
+
+/*
+ * Whether records need their owner uid: only -e and the serialized
+ * formats show it (--save and the daemon collect with -e set).
+ */
+static bool needs_uid(const ss_options_t *opts)
+{
+    return opts->extended || opts->format != SS_FORMAT_TABLE;
+}
+
+/*
+ * Collect sockets from fd table entries [lo, hi) of a process into table.
+ * Records are tagged with seq = (pid_idx, fd index) so that parallel
+ * collection can restore the serial discovery order. Duplicates are
+ * dropped via the seen set, or kept for the caller when seen is NULL.
+ */
+void collect_fd_range(const ss_libproc_ops_t *ops, pid_t pid, uint32_t pid_idx,
+                      const struct proc_fdinfo *fdinfo, int lo, int hi,
+                      ss_sock_table_t *table, const ss_options_t *opts,
+                      ss_sockset_t *seen)
+{
+    uint32_t proc_name = 0;
+    uid_t uid = 0;
+    bool got_proc_info = false;
     
     /* Iterate through file descriptors */
-    for (int i = 0; i < num_fds; i++) {
+    for (int i = lo; i < hi; i++) {
         if (fdinfo[i].proc_fdtype != PROX_FDTYPE_SOCKET) {
             continue;
         }
@@ -221,15 +395,20 @@ static ss_sock_info_t *collect_process_sockets(pid_t pid, ss_sock_info_t *list,
         char si_buf[1024];  /* Large enough buffer */
         struct socket_fdinfo *si = (struct socket_fdinfo *)si_buf;
         
-        /* Try PROC_PIDFDSOCKETINFO (value 3) */
-        int ret = proc_pidfdinfo(pid, fdinfo[i].proc_fd, 3, si_buf, sizeof(si_buf));
+        int ret = ops->pidfdinfo(pid, fdinfo[i].proc_fd, PROC_PIDFDSOCKETINFO,
+                                 si_buf, sizeof(si_buf));
         if (ret <= 0) {
             continue;
         }
         
-        ss_sock_info_t sock = {0};
-        sock.pid = pid;
-        sock.fd = fdinfo[i].proc_fd;
+        /* Build the record in place in the next free table slot */
+        ss_sock_info_t *sock = sock_table_next(table);
+        if (!sock) {
+            break;
+        }
+        sock->pid = pid;
+        sock->fd = fdinfo[i].proc_fd;
+        sock->seq = ((uint64_t)pid_idx << 32) | (uint32_t)i;
         
         /* Determine socket type */
         int family = si->psi.soi_family;
@@ -237,152 +416,331 @@ static ss_sock_info_t *collect_process_sockets(pid_t pid, ss_sock_info_t *list,
         int proto = si->psi.soi_protocol;
         
         if (family == AF_INET || family == AF_INET6) {
-            sock.family = (family == AF_INET) ? SS_FAMILY_INET : SS_FAMILY_INET6;
+            sock->family = (family == AF_INET) ? SS_FAMILY_INET : SS_FAMILY_INET6;
             
             if (proto == IPPROTO_TCP) {
-                sock.protocol = SS_PROTO_TCP;
-                sock.state = darwin_to_ss_state(si->psi.soi_proto.pri_tcp.tcpsi_state);
+                sock->protocol = SS_PROTO_TCP;
+                sock->state = darwin_to_ss_state(si->psi.soi_proto.pri_tcp.tcpsi_state);
             } else if (proto == IPPROTO_UDP) {
-                sock.protocol = SS_PROTO_UDP;
-                sock.state = SS_TCP_UNKNOWN;
+                sock->protocol = SS_PROTO_UDP;
+                sock->state = SS_TCP_UNKNOWN;
             } else {
                 continue;  /* Skip other protocols */
             }
             
-            /* Get addresses */
+            /* Get addresses (kept binary; formatted when printed) */
             if (family == AF_INET) {
-                struct in_addr laddr, faddr;
-                laddr.s_addr = si->psi.soi_proto.pri_in.insi_laddr.ina_46.i46a_addr4.s_addr;
-                faddr.s_addr = si->psi.soi_proto.pri_in.insi_faddr.ina_46.i46a_addr4.s_addr;
-                uint16_t lport = ntohs(si->psi.soi_proto.pri_in.insi_lport);
-                uint16_t fport = ntohs(si->psi.soi_proto.pri_in.insi_fport);
-                
-                format_addr_v4(&laddr, lport, sock.local_addr, sizeof(sock.local_addr));
-                format_addr_v4(&faddr, fport, sock.remote_addr, sizeof(sock.remote_addr));
-                sock.local_port = lport;
-                sock.remote_port = fport;
+                sock->local_ip.v4 = si->psi.soi_proto.pri_in.insi_laddr.ina_46.i46a_addr4;
+                sock->remote_ip.v4 = si->psi.soi_proto.pri_in.insi_faddr.ina_46.i46a_addr4;
             } else {
-#ifdef IOS_BUILD
-                struct in6_addr *laddr6 = &si->psi.soi_proto.pri_in.insi_laddr.ina_46.i46a_addr6;
-                struct in6_addr *faddr6 = &si->psi.soi_proto.pri_in.insi_faddr.ina_46.i46a_addr6;
-#else
-                struct in6_addr *laddr6 = &si->psi.soi_proto.pri_in.insi_laddr.ina_6;
-                struct in6_addr *faddr6 = &si->psi.soi_proto.pri_in.insi_faddr.ina_6;
-#endif
-                uint16_t lport = ntohs(si->psi.soi_proto.pri_in.insi_lport);
-                uint16_t fport = ntohs(si->psi.soi_proto.pri_in.insi_fport);
-                
-                format_addr_v6(laddr6, lport, sock.local_addr, sizeof(sock.local_addr));
-                format_addr_v6(faddr6, fport, sock.remote_addr, sizeof(sock.remote_addr));
-                sock.local_port = lport;
-                sock.remote_port = fport;
+                sock->local_ip.v6 = INSI_ADDR6(si->psi.soi_proto.pri_in.insi_laddr);
+                sock->remote_ip.v6 = INSI_ADDR6(si->psi.soi_proto.pri_in.insi_faddr);
             }
+            sock->local_port = ntohs(si->psi.soi_proto.pri_in.insi_lport);
+            sock->remote_port = ntohs(si->psi.soi_proto.pri_in.insi_fport);
             
             /* Queue sizes */
-            sock.recv_queue = si->psi.soi_rcv.sbi_cc;
-            sock.send_queue = si->psi.soi_snd.sbi_cc;
+            sock->recv_queue = si->psi.soi_rcv.sbi_cc;
+            sock->send_queue = si->psi.soi_snd.sbi_cc;
             
         } else if (family == AF_UNIX) {
-            sock.family = SS_FAMILY_UNIX;
-            sock.protocol = (type == SOCK_STREAM) ? SS_PROTO_UNIX_STREAM : SS_PROTO_UNIX_DGRAM;
-            sock.state = SS_TCP_UNKNOWN;
+            sock->family = SS_FAMILY_UNIX;
+            sock->protocol = (type == SOCK_STREAM) ? SS_PROTO_UNIX_STREAM : SS_PROTO_UNIX_DGRAM;
+            sock->state = SS_TCP_UNKNOWN;
             
             /* Get UNIX socket path */
-            char *sun_path = si->psi.soi_proto.pri_un.unsi_addr.ua_sun.sun_path;
-            if (sun_path[0] != '\0') {
-                strncpy(sock.unix_path, sun_path, MAX_PATH_LEN - 1);
-                strncpy(sock.local_addr, sun_path, MAX_ADDR_LEN - 1);
-            } else {
-                strcpy(sock.local_addr, "*");
-            }
+            const char *sun_path = si->psi.soi_proto.pri_un.unsi_addr.ua_sun.sun_path;
+            size_t sun_max = sizeof(si->psi.soi_proto.pri_un.unsi_addr.ua_sun.sun_path);
+            sock->unix_path = sock_table_intern(table, sun_path,
+                                                strnlen(sun_path, sun_max < MAX_PATH_LEN
+                                                                  ? sun_max : MAX_PATH_LEN - 1));
             
             /* Check connection state */
-            if (si->psi.soi_proto.pri_un.unsi_conn_so != 0) {
-                strcpy(sock.remote_addr, "[connected]");
-            } else {
-                strcpy(sock.remote_addr, "*");
-            }
+            sock->unix_connected = (si->psi.soi_proto.pri_un.unsi_conn_so != 0);
             
-            sock.recv_queue = si->psi.soi_rcv.sbi_cc;
-            sock.send_queue = si->psi.soi_snd.sbi_cc;
+            sock->recv_queue = si->psi.soi_rcv.sbi_cc;
+            sock->send_queue = si->psi.soi_snd.sbi_cc;
         } else {
             continue;  /* Skip other families */
         }
         
         /* Check if should include this socket */
-        if (!should_include(&sock, opts)) {
+        if (!should_include(sock, opts)) {
             continue;
         }
         
         /* Check for duplicates */
-        if (socket_exists(list, &sock)) {
+        if (seen && !sockset_insert(seen, table, sock)) {
             continue;
         }
         
-        /* Get process name if needed */
-        if (opts->show_process && !got_proc_name) {
-            get_proc_name(pid, proc_name, sizeof(proc_name));
-            got_proc_name = true;
+        /* Owner uid, and the name if needed (interned once for all its sockets) */
+        if (!got_proc_info && !table->counts) {
+            if (opts->show_process) {
+                ss_proc_meta_t meta;
+                proc_cache_get(ops, pid, &meta);
+                proc_name = sock_table_intern(table, meta.name, strlen(meta.name));
+                uid = meta.uid;
+            } else if (opts->filter_uid) {
+                /* The process list was already narrowed to this uid */
+                uid = opts->uid;
+            } else if (needs_uid(opts)) {
+                struct proc_bsdinfo bi;
+                if (ops->pidinfo(pid, PROC_PIDTBSDINFO, 0, &bi, sizeof(bi)) >= (int)sizeof(bi)) {
+                    uid = bi.pbi_uid;
+                }
+            }
+            got_proc_info = true;
         }
+        sock->proc_name = proc_name;
+        sock->uid = uid;
         
-        if (opts->show_process) {
-            strncpy(sock.proc_name, proc_name, MAX_PROC_NAME - 1);
+        /* Internals for -i / -o (not needed to count or aggregate) */
+        if ((opts->tcp_info || opts->timers) && !table->counts && !table->agg) {
+            ss_sock_ext_t *ext = sock_table_ext(table);
+            if (ext) {
+                fill_sock_ext(ext, sock, si);
+            }
         }
         
-        /* Add to list */
-        list = add_to_list(list, &sock);
+        /* Keep the record; under --top, reclaim strings of dropped ones */
+        sock_table_commit(table);
+        proc_name = sock_table_compact(table, proc_name);
+    }
+}
+
+/* Collect sockets from a single process */
+static void collect_process_sockets(const ss_libproc_ops_t *ops, pid_t pid,
+                                    uint32_t pid_idx, ss_sock_table_t *table,
+                                    const ss_options_t *opts, ss_sockset_t *seen)
+{
+    struct proc_fdinfo *fdinfo;
+    int num_fds = list_process_fds(ops, pid, &fdinfo);
+    
+    if (num_fds > 0) {
+        collect_fd_range(ops, pid, pid_idx, fdinfo, 0, num_fds, table, opts, seen);
     }
     
     free(fdinfo);
-    return list;
 }
 
-/* Collect all sockets from all processes */
-ss_sock_info_t *collect_all_sockets(const ss_options_t *opts)
+/* Collect all sockets from all processes through a libproc provider */
+int collect_libproc_sockets(const ss_libproc_ops_t *ops, const ss_options_t *opts,
+                            ss_sock_table_t *table)
 {
-    ss_sock_info_t *list = NULL;
     pid_t *pids = NULL;
-    int num_pids;
+    int cap = 0;
     
-    /* Get list of all PIDs */
-    int bufsize = proc_listpids(PROC_ALL_PIDS, 0, NULL, 0);
-    if (bufsize <= 0) {
-        perror("proc_listpids");
-        return NULL;
-    }
+    /* Count and time the libproc calls for --self-stats / --trace */
+    ops = selfstats_wrap_ops(ops);
     
-    pids = malloc(bufsize);
-    if (!pids) {
-        perror("malloc");
-        return NULL;
+    /* PIDs to walk (all, or narrowed by --uid/--pgrp/--pid) */
+    int num_pids = list_target_pids(ops, opts, &pids, &cap);
+    if (num_pids <= 0) {
+        free(pids);
+        return num_pids;
     }
     
-    num_pids = proc_listpids(PROC_ALL_PIDS, 0, pids, bufsize);
-    if (num_pids <= 0) {
-        perror("proc_listpids");
+    /*
+     * Shard the PIDs across a worker pool if requested. Not when counting,
+     * aggregating or keeping a --top heap: workers keep every record until
+     * the merge drops sockets seen in several processes, so their tables
+     * would hold all sockets, and a per-worker heap could be filled with
+     * copies the merge then drops.
+     */
+    if (opts->threads > 1 && !table->counts && !table->agg && !table->top) {
+        int ret = collect_parallel(ops, pids, num_pids, opts, table);
         free(pids);
-        return NULL;
+        return ret;
     }
     
-    num_pids /= sizeof(pid_t);
+    ss_sockset_t seen;
+    if (!sockset_init(&seen, 0)) {
+        perror("malloc");
+        free(pids);
+        return -1;
+    }
     
     /* Collect sockets from each process */
+    selfstats_phase_begin(SS_PHASE_SCAN);
     for (int i = 0; i < num_pids; i++) {
         if (pids[i] == 0) continue;
-        list = collect_process_sockets(pids[i], list, opts);
+        collect_process_sockets(ops, pids[i], (uint32_t)i, table, opts, &seen);
     }
+    selfstats_phase_end(SS_PHASE_SCAN);
     
+    sockset_free(&seen);
     free(pids);
-    return list;
+    return 0;
 }
 
-/* Free socket list */
-void free_socket_list(ss_sock_info_t *list)
+#ifndef SS_NETLINK_BACKEND
+
+#ifdef IOS_BUILD
+/* socket_fdinfo layout of this OS build, set up on the first socket lookup */
+static fdinfo_layout_t ios_layout;
+static bool ios_layout_ok;
+static pthread_once_t ios_layout_once = PTHREAD_ONCE_INIT;
+
+static void ios_layout_init(void)
 {
-    ss_sock_info_t *next;
-    while (list) {
-        next = list->next;
-        free(list);
-        list = next;
+    ios_layout_ok = fdinfo_layout_get(&ios_layout, false, false);
+}
+
+/*
+ * proc_pidfdinfo() for iOS: socket_fdinfo moves between releases, so the
+ * blob is read through the layout calibrated on this OS build rather than
+ * cast to the libproc_compat.h struct. Without a layout no socket is
+ * reported (the calibration has printed why).
+ */
+static int ios_pidfdinfo(int pid, int fd, int flavor, void *buffer, int buffersize)
+{
+    uint8_t blob[FDINFO_BUF_SIZE];
+
+    if (flavor != PROC_PIDFDSOCKETINFO) {
+        return proc_pidfdinfo(pid, fd, flavor, buffer, buffersize);
+    }
+    pthread_once(&ios_layout_once, ios_layout_init);
+    if (!ios_layout_ok || buffersize < (int)sizeof(struct socket_fdinfo)) {
+        return 0;
     }
+    int len = proc_pidfdinfo(pid, fd, flavor, blob, sizeof(blob));
+    if (len <= 0 || !fdinfo_read_socket(&ios_layout, blob, len, buffer)) {
+        return 0;
+    }
+    return (int)sizeof(struct socket_fdinfo);
+}
+#define SYSTEM_PIDFDINFO ios_pidfdinfo
+#else
+#define SYSTEM_PIDFDINFO proc_pidfdinfo
+#endif
+
+/* System provider: the real libproc */
+static const ss_libproc_ops_t system_libproc = {
+    "libproc",
+    proc_listpids,
+    proc_pidinfo,
+    SYSTEM_PIDFDINFO,
+    proc_pidpath,
+    proc_name
+};
+
+static int collect_system_sockets(const ss_options_t *opts, ss_sock_table_t *table)
+{
+    return collect_libproc_sockets(&system_libproc, opts, table);
+}
+
+#ifdef __APPLE__
+#define SYSTEM_SUMMARIZE summarize_pcblist
+#else
+#define SYSTEM_SUMMARIZE NULL
+#endif
+
+#endif /* !SS_NETLINK_BACKEND */
+
+static int collect_synthetic_sockets(const ss_options_t *opts, ss_sock_table_t *table)
+{
+    return collect_libproc_sockets(&synthetic_libproc, opts, table);
+}
+
+/* Collector backends; the first entry is the platform default */
+static const ss_collector_t collectors[] = {
+#ifdef SS_NETLINK_BACKEND
+    { "netlink",   collect_netlink_sockets,   NULL,             NULL },
+#else
+    { "libproc",   collect_system_sockets,    SYSTEM_SUMMARIZE, &system_libproc },
+#endif
+    { "synthetic", collect_synthetic_sockets, NULL,             &synthetic_libproc },
+    { NULL, NULL, NULL, NULL }
+};
+
+/* Look up a collector by name (NULL selects the platform default) */
+const ss_collector_t *find_collector(const char *name)
+{
+    if (name == NULL) {
+        return &collectors[0];
+    }
+    for (const ss_collector_t *c = collectors; c->name != NULL; c++) {
+        if (strcmp(c->name, name) == 0) {
+            return c;
+        }
+    }
+    return NULL;
+}
+
+/* Run a collector; libproc walks time their own phases */
+static int run_collector(const ss_collector_t *collector, const ss_options_t *opts,
+                         ss_sock_table_t *table)
+{
+    if (collector->libproc) {
+        return collector->collect(opts, table);
+    }
+    selfstats_phase_begin(SS_PHASE_SCAN);
+    int ret = collector->collect(opts, table);
+    selfstats_phase_end(SS_PHASE_SCAN);
+    return ret;
+}
+
+/*
+ * Collect all sockets into table using the selected collector, then
+ * group the records by output section. Returns 0 on success.
+ */
+int collect_all_sockets(const ss_options_t *opts, ss_sock_table_t *table)
+{
+    const ss_collector_t *collector = find_collector(opts->collector);
+    if (!collector) {
+        return -1;
+    }
+    int ret = run_collector(collector, opts, table);
+    selfstats_phase_begin(SS_PHASE_GROUP);
+    bool ok = sock_table_finalize(table);
+    selfstats_phase_end(SS_PHASE_GROUP);
+    if (!ok) {
+        perror("malloc");
+        return -1;
+    }
+    return ret;
+}
+
+/* Kernel counters for -s, timed as the scan phase */
+static int run_summarize(const ss_collector_t *collector, const ss_options_t *opts,
+                         ss_stats_t *stats)
+{
+    selfstats_phase_begin(SS_PHASE_SCAN);
+    int ret = collector->summarize(opts, stats);
+    selfstats_phase_end(SS_PHASE_SCAN);
+    return ret;
+}
+
+/*
+ * Fill stats for -s without building socket records: kernel counters if
+ * the collector has them, else a counting-only collection pass.
+ */
+int collect_summary(const ss_options_t *opts, ss_stats_t *stats)
+{
+    const ss_collector_t *collector = find_collector(opts->collector);
+    if (!collector) {
+        return -1;
+    }
+    /*
+     * Kernel counters cannot be narrowed to processes, and the pcblist
+     * walk does not decode the fields a filter expression may test
+     */
+    if (collector->summarize && !proc_filter_active(opts) &&
+        !opts->filter.has_states && opts->filter.len == 0 &&
+        !opts->src_cidrs && !opts->dst_cidrs &&
+        run_summarize(collector, opts, stats) == 0) {
+        return 0;
+    }
+    memset(stats, 0, sizeof(*stats));
+    
+    /* Process names are never shown in a summary */
+    ss_options_t count_opts = *opts;
+    count_opts.show_process = false;
+    count_opts.extended = false;
+    
+    ss_sock_table_t table = { .counts = stats };
+    int ret = run_collector(collector, &count_opts, &table);
+    sock_table_free(&table);
+    return ret;
 }
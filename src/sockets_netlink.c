@@ -0,0 +1,653 @@
+/*
+ * ss - Socket Statistics for Apple platforms (macOS/iOS)
+ * Socket collection on Linux using NETLINK_SOCK_DIAG bulk dumps
+ *
+ * One inet_diag dump per (family, protocol) and one unix_diag dump replace
+ * the per-PID/per-fd libproc walk. Socket ownership (-p/-e, --pid/--pgrp)
+ * is recovered by mapping socket inodes found under /proc/<pid>/fd; with
+ * --pid only the listed processes are scanned. --uid matches the socket
+ * owner reported by the kernel.
+ *
+ * With -i / -o the dumps also ask for tcp_info (MSS) and skmeminfo (buffer
+ * limits); TCP timers come from the pending timer in every inet reply.
+ */
+
+#include "libproc_compat.h"
+
+#ifdef SS_NETLINK_BACKEND
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <linux/netlink.h>
+#include <linux/sock_diag.h>
+#include <linux/inet_diag.h>
+#include <linux/unix_diag.h>
+#include <linux/rtnetlink.h>
+#include <linux/tcp.h>
+#include "ss.h"
+
+/* Receive buffer for dump replies (kernel sends up to a page-sized batch) */
+#define NL_RECV_BUFSIZE 65536
+
+/* Linux TCP states from include/net/tcp_states.h */
+#define LINUX_TCP_ESTABLISHED   1
+#define LINUX_TCP_SYN_SENT      2
+#define LINUX_TCP_SYN_RECV      3
+#define LINUX_TCP_FIN_WAIT1     4
+#define LINUX_TCP_FIN_WAIT2     5
+#define LINUX_TCP_TIME_WAIT     6
+#define LINUX_TCP_CLOSE         7
+#define LINUX_TCP_CLOSE_WAIT    8
+#define LINUX_TCP_LAST_ACK      9
+#define LINUX_TCP_LISTEN        10
+#define LINUX_TCP_CLOSING       11
+
+/* Owner of a socket inode, found in /proc/<pid>/fd */
+typedef struct {
+    uint32_t inode;     /* 0 = empty slot */
+    pid_t pid;
+    int fd;
+    uint32_t name;      /* Process name in the socket table's string pool, 0 if none */
+} inode_owner_t;
+
+/* Open-addressing inode -> owner table */
+typedef struct {
+    inode_owner_t *slots;
+    size_t mask;
+    size_t count;
+} owner_map_t;
+
+/* Collector state shared by all dumps of one run */
+typedef struct {
+    const ss_options_t *opts;
+    owner_map_t *owners;
+    ss_sock_table_t *table;
+    bool want_ext;          /* Store internals for -i / -o */
+    bool oom;
+} nl_ctx_t;
+
+/* Convert Linux TCP state to our state enum */
+static ss_tcp_state_t linux_to_ss_state(int state)
+{
+    switch (state) {
+        case LINUX_TCP_ESTABLISHED: return SS_TCP_ESTABLISHED;
+        case LINUX_TCP_SYN_SENT:    return SS_TCP_SYN_SENT;
+        case LINUX_TCP_SYN_RECV:    return SS_TCP_SYN_RECV;
+        case LINUX_TCP_FIN_WAIT1:   return SS_TCP_FIN_WAIT1;
+        case LINUX_TCP_FIN_WAIT2:   return SS_TCP_FIN_WAIT2;
+        case LINUX_TCP_TIME_WAIT:   return SS_TCP_TIME_WAIT;
+        case LINUX_TCP_CLOSE:       return SS_TCP_CLOSED;
+        case LINUX_TCP_CLOSE_WAIT:  return SS_TCP_CLOSE_WAIT;
+        case LINUX_TCP_LAST_ACK:    return SS_TCP_LAST_ACK;
+        case LINUX_TCP_LISTEN:      return SS_TCP_LISTEN;
+        case LINUX_TCP_CLOSING:     return SS_TCP_CLOSING;
+        default:                    return SS_TCP_UNKNOWN;
+    }
+}
+
+/* Kernel-side TCP state mask matching the state filter or -l / -a */
+static uint32_t tcp_state_mask(const ss_options_t *opts)
+{
+    if (opts->filter.has_states) {
+        uint32_t mask = 0;
+        ss_sock_info_t probe = { .protocol = SS_PROTO_TCP };
+        for (int state = LINUX_TCP_ESTABLISHED; state <= LINUX_TCP_CLOSING; state++) {
+            probe.state = (uint8_t)linux_to_ss_state(state);
+            if (filter_state_match(&opts->filter, &probe)) {
+                mask |= 1u << state;
+            }
+        }
+        return mask;
+    }
+    if (opts->show_listening) {
+        return 1u << LINUX_TCP_LISTEN;
+    }
+    if (!opts->show_all) {
+        return (1u << LINUX_TCP_ESTABLISHED) | (1u << LINUX_TCP_LISTEN);
+    }
+    return 0xffffffffu;
+}
+
+static size_t hash_inode(uint32_t inode)
+{
+    return (size_t)(inode * 2654435761u);
+}
+
+static void owner_map_insert(owner_map_t *map, uint32_t inode, pid_t pid, int fd, uint32_t name)
+{
+    if ((map->count + 1) * 2 > map->mask + 1) {
+        size_t new_size = (map->mask + 1) * 2;
+        inode_owner_t *slots = calloc(new_size, sizeof(inode_owner_t));
+        if (!slots) {
+            return;
+        }
+        for (size_t i = 0; i <= map->mask; i++) {
+            if (map->slots[i].inode == 0) continue;
+            size_t j = hash_inode(map->slots[i].inode) & (new_size - 1);
+            while (slots[j].inode != 0) {
+                j = (j + 1) & (new_size - 1);
+            }
+            slots[j] = map->slots[i];
+        }
+        free(map->slots);
+        map->slots = slots;
+        map->mask = new_size - 1;
+    }
+
+    size_t i = hash_inode(inode) & map->mask;
+    while (map->slots[i].inode != 0) {
+        if (map->slots[i].inode == inode) {
+            return;  /* Shared socket: first owner wins, like libproc dedup */
+        }
+        i = (i + 1) & map->mask;
+    }
+    map->slots[i].inode = inode;
+    map->slots[i].pid = pid;
+    map->slots[i].fd = fd;
+    map->slots[i].name = name;
+    map->count++;
+}
+
+static const inode_owner_t *owner_map_find(const owner_map_t *map, uint32_t inode)
+{
+    if (!map || inode == 0) {
+        return NULL;
+    }
+    size_t i = hash_inode(inode) & map->mask;
+    while (map->slots[i].inode != 0) {
+        if (map->slots[i].inode == inode) {
+            return &map->slots[i];
+        }
+        i = (i + 1) & map->mask;
+    }
+    return NULL;
+}
+
+/* Get process name by PID (executable basename, falling back to comm) */
+static void get_proc_name(pid_t pid, char *name, size_t name_len)
+{
+    char path[64];
+    char pathbuf[4096];
+
+    snprintf(path, sizeof(path), "/proc/%d/exe", pid);
+    ssize_t ret = readlink(path, pathbuf, sizeof(pathbuf) - 1);
+    if (ret > 0) {
+        pathbuf[ret] = '\0';
+        char *slash = strrchr(pathbuf, '/');
+        const char *base = slash ? slash + 1 : pathbuf;
+        size_t len = strnlen(base, name_len - 1);
+        memcpy(name, base, len);
+        name[len] = '\0';
+        return;
+    }
+
+    /* Fallback to comm */
+    snprintf(path, sizeof(path), "/proc/%d/comm", pid);
+    FILE *fp = fopen(path, "r");
+    if (fp && fgets(name, (int)name_len, fp)) {
+        name[strcspn(name, "\n")] = '\0';
+    } else {
+        snprintf(name, name_len, "?");
+    }
+    if (fp) {
+        fclose(fp);
+    }
+}
+
+/* Intern the name of a PID once in the table's string pool */
+static uint32_t intern_proc_name(ss_sock_table_t *table, pid_t pid)
+{
+    char name[MAX_PROC_NAME] = {0};
+    get_proc_name(pid, name, sizeof(name));
+    return sock_table_intern(table, name, strlen(name));
+}
+
+/* Process group of a PID from /proc/<pid>/stat, -1 if unknown */
+static pid_t proc_pgrp(pid_t pid)
+{
+    char path[64];
+    char buf[512];
+
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    ssize_t len = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (len <= 0) {
+        return -1;
+    }
+    buf[len] = '\0';
+
+    /* "pid (comm) state ppid pgrp ...": comm may contain spaces and ')' */
+    char *p = strrchr(buf, ')');
+    int pgrp;
+    if (!p || sscanf(p + 1, " %*c %*d %d", &pgrp) != 1) {
+        return -1;
+    }
+    return (pid_t)pgrp;
+}
+
+/* Add the sockets found in /proc/<pid>/fd to the owner map */
+static void scan_proc_fds(owner_map_t *map, const ss_options_t *opts,
+                          ss_sock_table_t *table, pid_t pid)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/fd", pid);
+    int dfd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dfd < 0) return;
+    DIR *fds = fdopendir(dfd);
+    if (!fds) {
+        close(dfd);
+        return;
+    }
+
+    uint32_t name = 0;
+    bool got_name = false;
+    struct dirent *fe;
+    while ((fe = readdir(fds)) != NULL) {
+        if (fe->d_name[0] == '.') continue;
+
+        char link[64];
+        ssize_t len = readlinkat(dfd, fe->d_name, link, sizeof(link) - 1);
+        if (len <= 0) continue;
+        link[len] = '\0';
+
+        unsigned int inode;
+        if (sscanf(link, "socket:[%u]", &inode) != 1) continue;
+
+        if (opts->show_process && !got_name) {
+            name = intern_proc_name(table, pid);
+            got_name = true;
+        }
+        owner_map_insert(map, inode, pid, atoi(fe->d_name), name);
+    }
+    closedir(fds);
+}
+
+/* Build the inode -> owner map from /proc/<pid>/fd symlinks */
+static owner_map_t *build_owner_map(const ss_options_t *opts, ss_sock_table_t *table)
+{
+    owner_map_t *map = calloc(1, sizeof(owner_map_t));
+    if (!map) {
+        return NULL;
+    }
+    map->mask = 1023;
+    map->slots = calloc(map->mask + 1, sizeof(inode_owner_t));
+    if (!map->slots) {
+        free(map);
+        return NULL;
+    }
+
+    /* --pid: no enumeration, just the listed processes */
+    if (opts->num_pids > 0) {
+        for (int i = 0; i < opts->num_pids; i++) {
+            if (!opts->filter_pgrp || proc_pgrp(opts->pids[i]) == opts->pgrp) {
+                scan_proc_fds(map, opts, table, opts->pids[i]);
+            }
+        }
+        return map;
+    }
+
+    DIR *proc = opendir("/proc");
+    if (!proc) {
+        return map;
+    }
+
+    struct dirent *de;
+    while ((de = readdir(proc)) != NULL) {
+        char *end;
+        long pid = strtol(de->d_name, &end, 10);
+        if (*end != '\0' || pid <= 0) continue;
+        if (opts->filter_pgrp && proc_pgrp((pid_t)pid) != opts->pgrp) continue;
+        scan_proc_fds(map, opts, table, (pid_t)pid);
+    }
+    closedir(proc);
+
+    return map;
+}
+
+static void free_owner_map(owner_map_t *map)
+{
+    if (map) {
+        free(map->slots);
+        free(map);
+    }
+}
+
+/*
+ * Filter and keep one socket built in the table's next slot. A dump lists
+ * every kernel socket exactly once, so nothing is deduplicated here:
+ * SO_REUSEPORT listeners and unnamed UNIX sockets share an address tuple
+ * but are distinct sockets.
+ */
+static void add_socket(nl_ctx_t *ctx, ss_sock_info_t *sock)
+{
+    const ss_options_t *opts = ctx->opts;
+
+    if (!should_include(sock, opts)) {
+        return;
+    }
+    if (opts->filter_uid && sock->uid != opts->uid) {
+        return;
+    }
+
+    /* --pid/--pgrp: the map only holds sockets of matching processes */
+    const inode_owner_t *owner = owner_map_find(ctx->owners, sock->inode);
+    if (!owner && (opts->num_pids > 0 || opts->filter_pgrp)) {
+        return;
+    }
+
+    if (owner) {
+        sock->pid = owner->pid;
+        sock->fd = owner->fd;
+        if (opts->show_process) {
+            sock->proc_name = owner->name;
+        }
+    }
+
+    sock_table_commit(ctx->table);
+    sock_table_compact(ctx->table, 0);
+}
+
+/* Send a dump request and feed every reply message to cb */
+static int nl_dump(int nl, void *req, size_t req_len,
+                   void (*cb)(nl_ctx_t *, const struct nlmsghdr *), nl_ctx_t *ctx)
+{
+    struct sockaddr_nl sa = { .nl_family = AF_NETLINK };
+
+    if (sendto(nl, req, req_len, 0, (struct sockaddr *)&sa, sizeof(sa)) < 0) {
+        return -1;
+    }
+
+    char *buf = malloc(NL_RECV_BUFSIZE);
+    if (!buf) {
+        return -1;
+    }
+
+    for (;;) {
+        ssize_t len = recv(nl, buf, NL_RECV_BUFSIZE, 0);
+        if (len < 0) {
+            if (errno == EINTR) continue;
+            free(buf);
+            return -1;
+        }
+
+        for (struct nlmsghdr *h = (struct nlmsghdr *)buf; NLMSG_OK(h, (size_t)len);
+             h = NLMSG_NEXT(h, len)) {
+            if (h->nlmsg_type == NLMSG_DONE) {
+                free(buf);
+                return 0;
+            }
+            if (h->nlmsg_type == NLMSG_ERROR) {
+                struct nlmsgerr *err = NLMSG_DATA(h);
+                errno = -err->error;
+                free(buf);
+                return -1;
+            }
+            cb(ctx, h);
+        }
+    }
+}
+
+/*
+ * Buffer limits and fill from an INET_DIAG_SKMEMINFO / UNIX_DIAG_MEMINFO
+ * attribute. The fill is memory the kernel charges to the socket, not the
+ * queue columns, which for a listener are the accept queue and backlog.
+ */
+static void fill_meminfo(ss_sock_ext_t *ext, const struct rtattr *a)
+{
+    if (RTA_PAYLOAD(a) >= (SK_MEMINFO_WMEM_QUEUED + 1) * sizeof(uint32_t)) {
+        const uint32_t *mem = RTA_DATA(a);
+        ext->rcv_hiwat = mem[SK_MEMINFO_RCVBUF];
+        ext->snd_hiwat = mem[SK_MEMINFO_SNDBUF];
+        ext->rcv_used = mem[SK_MEMINFO_RMEM_ALLOC];
+        ext->snd_used = mem[SK_MEMINFO_WMEM_QUEUED];
+    }
+}
+
+/*
+ * Internals of an inet socket: buffer limits, and for TCP the MSS and the
+ * pending timer (idiag_timer: 1 retransmit, 2 keepalive, 3 TIME-WAIT,
+ * 4 zero-window probe) with its remaining milliseconds.
+ */
+static void fill_inet_ext(ss_sock_ext_t *ext, const ss_sock_info_t *sock,
+                          const struct inet_diag_msg *msg, int attr_len)
+{
+    for (const struct rtattr *a = (const struct rtattr *)(msg + 1); RTA_OK(a, attr_len);
+         a = RTA_NEXT(a, attr_len)) {
+        if (a->rta_type == INET_DIAG_SKMEMINFO) {
+            fill_meminfo(ext, a);
+        } else if (a->rta_type == INET_DIAG_INFO && sock->protocol == SS_PROTO_TCP &&
+                   RTA_PAYLOAD(a) >= offsetof(struct tcp_info, tcpi_snd_mss) + sizeof(uint32_t)) {
+            const struct tcp_info *ti = RTA_DATA(a);
+            ext->mss = ti->tcpi_snd_mss;
+        }
+    }
+    if (sock->protocol != SS_PROTO_TCP) {
+        return;
+    }
+
+    static const int timer_slot[] = { -1, 0, 2, 3, 1 };
+    ext->has_tcp = true;
+    if (msg->idiag_timer >= 1 && msg->idiag_timer <= 4) {
+        /* An expired timer still pending reports 0: show it as due now */
+        ext->timer[timer_slot[msg->idiag_timer]] = msg->idiag_expires ? msg->idiag_expires : 1;
+    }
+}
+
+/* Parse one inet_diag reply */
+static void parse_inet_msg(nl_ctx_t *ctx, const struct nlmsghdr *h)
+{
+    const struct inet_diag_msg *msg = NLMSG_DATA(h);
+    ss_sock_info_t *sock = sock_table_next(ctx->table);
+    uint16_t lport = ntohs(msg->id.idiag_sport);
+    uint16_t fport = ntohs(msg->id.idiag_dport);
+
+    if (!sock) {
+        ctx->oom = true;
+        return;
+    }
+
+    /* Protocol is not in the reply; the request stashed it in nlmsg_seq */
+    if (h->nlmsg_seq == IPPROTO_TCP) {
+        sock->protocol = SS_PROTO_TCP;
+        sock->state = linux_to_ss_state(msg->idiag_state);
+    } else {
+        sock->protocol = SS_PROTO_UDP;
+        sock->state = SS_TCP_UNKNOWN;
+    }
+
+    if (msg->idiag_family == AF_INET) {
+        sock->family = SS_FAMILY_INET;
+        memcpy(&sock->local_ip.v4, msg->id.idiag_src, sizeof(struct in_addr));
+        memcpy(&sock->remote_ip.v4, msg->id.idiag_dst, sizeof(struct in_addr));
+    } else {
+        sock->family = SS_FAMILY_INET6;
+        memcpy(&sock->local_ip.v6, msg->id.idiag_src, sizeof(struct in6_addr));
+        memcpy(&sock->remote_ip.v6, msg->id.idiag_dst, sizeof(struct in6_addr));
+    }
+    sock->local_port = lport;
+    sock->remote_port = fport;
+
+    sock->recv_queue = msg->idiag_rqueue;
+    sock->send_queue = msg->idiag_wqueue;
+    sock->uid = msg->idiag_uid;
+    sock->inode = msg->idiag_inode;
+
+    if (ctx->want_ext) {
+        ss_sock_ext_t *ext = sock_table_ext(ctx->table);
+        if (ext) {
+            fill_inet_ext(ext, sock, msg, (int)h->nlmsg_len - NLMSG_LENGTH(sizeof(*msg)));
+        }
+    }
+
+    add_socket(ctx, sock);
+}
+
+/* Parse one unix_diag reply */
+static void parse_unix_msg(nl_ctx_t *ctx, const struct nlmsghdr *h)
+{
+    const struct unix_diag_msg *msg = NLMSG_DATA(h);
+    ss_sock_info_t *sock = sock_table_next(ctx->table);
+
+    if (!sock) {
+        ctx->oom = true;
+        return;
+    }
+
+    sock->family = SS_FAMILY_UNIX;
+    sock->protocol = (msg->udiag_type == SOCK_DGRAM) ? SS_PROTO_UNIX_DGRAM
+                                                     : SS_PROTO_UNIX_STREAM;
+    sock->state = SS_TCP_UNKNOWN;
+    sock->inode = msg->udiag_ino;
+
+    int attr_len = (int)h->nlmsg_len - NLMSG_LENGTH(sizeof(*msg));
+    for (struct rtattr *a = (struct rtattr *)(msg + 1); RTA_OK(a, attr_len);
+         a = RTA_NEXT(a, attr_len)) {
+        switch (a->rta_type) {
+            case UNIX_DIAG_NAME: {
+                char path[MAX_PATH_LEN];
+                size_t len = RTA_PAYLOAD(a);
+                if (len >= MAX_PATH_LEN) {
+                    len = MAX_PATH_LEN - 1;
+                }
+                memcpy(path, RTA_DATA(a), len);
+                path[len] = '\0';
+                /* Abstract namespace: shown as @name, like Linux ss */
+                if (len > 0 && path[0] == '\0') {
+                    path[0] = '@';
+                }
+                sock->unix_path = sock_table_intern(ctx->table, path, strlen(path));
+                break;
+            }
+            case UNIX_DIAG_PEER:
+                sock->unix_connected = *(uint32_t *)RTA_DATA(a) != 0;
+                break;
+            case UNIX_DIAG_MEMINFO:
+                if (ctx->want_ext) {
+                    ss_sock_ext_t *ext = sock_table_ext(ctx->table);
+                    if (ext) {
+                        fill_meminfo(ext, a);
+                    }
+                }
+                break;
+            case UNIX_DIAG_RQLEN: {
+                const struct unix_diag_rqlen *rq = RTA_DATA(a);
+                sock->recv_queue = rq->udiag_rqueue;
+                sock->send_queue = rq->udiag_wqueue;
+                break;
+            }
+#ifdef UDIAG_SHOW_UID
+            case UNIX_DIAG_UID:
+                sock->uid = *(uint32_t *)RTA_DATA(a);
+                break;
+#endif
+            default:
+                break;
+        }
+    }
+
+    add_socket(ctx, sock);
+}
+
+static int dump_inet(int nl, nl_ctx_t *ctx, uint8_t family, uint8_t protocol)
+{
+    struct {
+        struct nlmsghdr nlh;
+        struct inet_diag_req_v2 req;
+    } msg = {0};
+
+    msg.nlh.nlmsg_len = sizeof(msg);
+    msg.nlh.nlmsg_type = SOCK_DIAG_BY_FAMILY;
+    msg.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    msg.nlh.nlmsg_seq = protocol;
+    msg.req.sdiag_family = family;
+    msg.req.sdiag_protocol = protocol;
+    msg.req.idiag_states = (protocol == IPPROTO_TCP) ? tcp_state_mask(ctx->opts)
+                                                     : 0xffffffffu;
+    if (ctx->want_ext) {
+        msg.req.idiag_ext = (1 << (INET_DIAG_INFO - 1)) | (1 << (INET_DIAG_SKMEMINFO - 1));
+    }
+
+    return nl_dump(nl, &msg, sizeof(msg), parse_inet_msg, ctx);
+}
+
+static int dump_unix(int nl, nl_ctx_t *ctx)
+{
+    struct {
+        struct nlmsghdr nlh;
+        struct unix_diag_req req;
+    } msg = {0};
+
+    msg.nlh.nlmsg_len = sizeof(msg);
+    msg.nlh.nlmsg_type = SOCK_DIAG_BY_FAMILY;
+    msg.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    msg.req.sdiag_family = AF_UNIX;
+    msg.req.udiag_states = 0xffffffffu;
+    msg.req.udiag_show = UDIAG_SHOW_NAME | UDIAG_SHOW_PEER | UDIAG_SHOW_RQLEN;
+    if (ctx->want_ext) {
+        msg.req.udiag_show |= UDIAG_SHOW_MEMINFO;
+    }
+#ifdef UDIAG_SHOW_UID
+    msg.req.udiag_show |= UDIAG_SHOW_UID;   /* Linux 5.3+; ignored before */
+#endif
+
+    return nl_dump(nl, &msg, sizeof(msg), parse_unix_msg, ctx);
+}
+
+/* Collect all sockets from sock_diag dumps */
+int collect_netlink_sockets(const ss_options_t *opts, ss_sock_table_t *table)
+{
+    nl_ctx_t ctx = { .opts = opts, .table = table };
+    ctx.want_ext = (opts->tcp_info || opts->timers) && !table->counts && !table->agg;
+    int ret = 0;
+
+    int nl = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_SOCK_DIAG);
+    if (nl < 0) {
+        perror("socket(NETLINK_SOCK_DIAG)");
+        return -1;
+    }
+
+    /* Socket ownership is only needed for -p / -e output and --pid/--pgrp */
+    if (opts->show_process || opts->extended || opts->num_pids > 0 || opts->filter_pgrp) {
+        ctx.owners = build_owner_map(opts, table);
+    }
+    /* The owner map holds offsets of the names interned so far */
+    table->strings_floor = table->strings_len;
+
+    /* Same order as a PID walk would discover them: UDP, TCP, UNIX */
+    if (opts->show_udp) {
+        if (!opts->ipv6_only && ret == 0) ret = dump_inet(nl, &ctx, AF_INET, IPPROTO_UDP);
+        if (!opts->ipv4_only && ret == 0) ret = dump_inet(nl, &ctx, AF_INET6, IPPROTO_UDP);
+    }
+    if (opts->show_tcp) {
+        if (!opts->ipv6_only && ret == 0) ret = dump_inet(nl, &ctx, AF_INET, IPPROTO_TCP);
+        if (!opts->ipv4_only && ret == 0) ret = dump_inet(nl, &ctx, AF_INET6, IPPROTO_TCP);
+    }
+    if (opts->show_unix && ret == 0) {
+        ret = dump_unix(nl, &ctx);
+    }
+
+    if (ret < 0) {
+        perror("sock_diag");
+    } else if (ctx.oom) {
+        perror("realloc");
+        ret = -1;
+    }
+
+    free_owner_map(ctx.owners);
+    close(nl);
+    return ret;
+}
+
+#endif /* SS_NETLINK_BACKEND */
@@ -0,0 +1,175 @@
+/*
+ * ss - Socket Statistics for Apple platforms (macOS/iOS)
+ * Socket dedup set: open addressing over binary 5-tuple keys
+ *
+ * The same socket is seen once per process that holds it (inherited or
+ * passed fds). Keys are (protocol, family, local addr/port, remote
+ * addr/port) in binary form, so a lookup is one hash plus usually one
+ * 40-byte compare instead of a list walk with string compares.
+ *
+ * Only the libproc walk needs this. A sock_diag dump already lists each
+ * kernel socket once, and distinct sockets may share a tuple
+ * (SO_REUSEPORT listeners, unnamed UNIX sockets).
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "ss.h"
+
+/* Initial slot count (power of two) */
+#define SOCKSET_MIN_SLOTS 1024
+
+struct ss_sockset_slot {
+    uint64_t hash;          /* 0 = empty */
+    ss_sock_key_t key;
+};
+
+/* 64-bit FNV-1a, used to fold a UNIX path into the address bytes */
+static uint64_t fnv1a(const char *s)
+{
+    uint64_t h = 0xcbf29ce484222325ull;
+    while (*s) {
+        h ^= (uint8_t)*s++;
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+static uint64_t hash_key(const ss_sock_key_t *key)
+{
+    uint64_t w[sizeof(ss_sock_key_t) / sizeof(uint64_t)];
+    uint64_t h = 0x9e3779b97f4a7c15ull;
+
+    memcpy(w, key, sizeof(w));
+    for (size_t i = 0; i < sizeof(w) / sizeof(w[0]); i++) {
+        h = (h ^ w[i]) * 0xbf58476d1ce4e5b9ull;
+        h ^= h >> 29;
+    }
+    h ^= h >> 32;
+    return h ? h : 1;
+}
+
+/* Build the binary dedup key of a socket held in table */
+void sock_key_from_info(const ss_sock_table_t *table, const ss_sock_info_t *sock,
+                        ss_sock_key_t *key)
+{
+    memset(key, 0, sizeof(*key));
+    key->protocol = (uint8_t)sock->protocol;
+    key->family = (uint8_t)sock->family;
+
+    switch (sock->family) {
+        case SS_FAMILY_INET:
+            memcpy(key->local_addr, &sock->local_ip.v4, sizeof(struct in_addr));
+            memcpy(key->remote_addr, &sock->remote_ip.v4, sizeof(struct in_addr));
+            key->local_port = sock->local_port;
+            key->remote_port = sock->remote_port;
+            break;
+        case SS_FAMILY_INET6:
+            memcpy(key->local_addr, &sock->local_ip.v6, sizeof(struct in6_addr));
+            memcpy(key->remote_addr, &sock->remote_ip.v6, sizeof(struct in6_addr));
+            key->local_port = sock->local_port;
+            key->remote_port = sock->remote_port;
+            break;
+        case SS_FAMILY_UNIX: {
+            /* UNIX sockets are keyed on (path, connected) */
+            uint64_t h = fnv1a(sock_table_str(table, sock->unix_path));
+            memcpy(key->local_addr, &h, sizeof(h));
+            key->remote_addr[0] = (uint8_t)sock->unix_connected;
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+bool sockset_init(ss_sockset_t *set, size_t expected)
+{
+    size_t slots = SOCKSET_MIN_SLOTS;
+    while (slots < expected * 2) {
+        slots *= 2;
+    }
+
+    set->slots = calloc(slots, sizeof(ss_sockset_slot_t));
+    set->mask = set->slots ? slots - 1 : 0;
+    set->count = 0;
+    return set->slots != NULL;
+}
+
+static bool sockset_grow(ss_sockset_t *set)
+{
+    size_t new_size = (set->mask + 1) * 2;
+    ss_sockset_slot_t *slots = calloc(new_size, sizeof(ss_sockset_slot_t));
+    if (!slots) {
+        return false;
+    }
+
+    for (size_t i = 0; i <= set->mask; i++) {
+        if (set->slots[i].hash == 0) continue;
+        size_t j = set->slots[i].hash & (new_size - 1);
+        while (slots[j].hash != 0) {
+            j = (j + 1) & (new_size - 1);
+        }
+        slots[j] = set->slots[i];
+    }
+
+    free(set->slots);
+    set->slots = slots;
+    set->mask = new_size - 1;
+    return true;
+}
+
+/* Insert a key; returns false if it was already present */
+bool sockset_insert_key(ss_sockset_t *set, const ss_sock_key_t *key)
+{
+    /* Keep the load factor at or below 1/2 */
+    if ((set->count + 1) * 2 > set->mask + 1 && !sockset_grow(set)) {
+        return true;  /* Out of memory: keep the socket rather than drop it */
+    }
+
+    uint64_t h = hash_key(key);
+    size_t i = h & set->mask;
+    while (set->slots[i].hash != 0) {
+        if (set->slots[i].hash == h &&
+            memcmp(&set->slots[i].key, key, sizeof(*key)) == 0) {
+            return false;
+        }
+        i = (i + 1) & set->mask;
+    }
+
+    set->slots[i].hash = h;
+    set->slots[i].key = *key;
+    set->count++;
+    return true;
+}
+
+/* Insert a socket's key; returns false if it is a duplicate */
+bool sockset_insert(ss_sockset_t *set, const ss_sock_table_t *table,
+                    const ss_sock_info_t *sock)
+{
+    ss_sock_key_t key;
+    sock_key_from_info(table, sock, &key);
+    if (selfstats_on) {
+        uint64_t t0 = selfstats_now();
+        bool inserted = sockset_insert_key(set, &key);
+        selfstats_dedup(t0);
+        return inserted;
+    }
+    return sockset_insert_key(set, &key);
+}
+
+/* Remove all keys, keeping the slot array */
+void sockset_clear(ss_sockset_t *set)
+{
+    if (set->slots) {
+        memset(set->slots, 0, (set->mask + 1) * sizeof(ss_sockset_slot_t));
+    }
+    set->count = 0;
+}
+
+void sockset_free(ss_sockset_t *set)
+{
+    free(set->slots);
+    set->slots = NULL;
+    set->mask = 0;
+    set->count = 0;
+}
@@ -0,0 +1,442 @@
+/*
+ * ss - Socket Statistics for Apple platforms (macOS/iOS)
+ * Contiguous socket record store
+ *
+ * Collectors build records in place in a single growable block: taking a
+ * slot is a pointer bump, and a slot that is filtered out is simply reused.
+ * sock_table_finalize() then groups the records by output section (UDP,
+ * TCP, UNIX) so printing is a straight scan of each index range, and
+ * teardown is a single free() per block.
+ *
+ * Strings (UNIX paths, process names) are appended to a separate pool and
+ * referenced from records by 32-bit offset. Strings added for a slot that
+ * is never committed are dropped when the slot is reused.
+ *
+ * With a top limit (--top) the table holds at most that many records, as
+ * a heap whose root is the kept record that sorts last: a new record
+ * either replaces the root or is dropped, so collecting 200k sockets to
+ * show 20 never stores more than 21. Strings of the records the heap
+ * drops are reclaimed by sock_table_compact(), so the pool too stays
+ * proportional to the kept records.
+ *
+ * Socket internals for -i / -o live in a second array indexed like the
+ * records, so listings without them pay nothing. It is allocated when a
+ * collector first stores internals and then moves with the records.
+ *
+ * In aggregation mode (--group-by) commit only adds the record to its
+ * group's totals (aggregate.c) and the slot is reused, as when counting.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "ss.h"
+
+/* Initial record capacity */
+#define SOCK_TABLE_MIN_CAP 1024
+
+/* Initial string pool size */
+#define SOCK_TABLE_MIN_STRINGS 4096
+
+/* Output section of a record (Linux ss order) */
+ss_group_t sock_group(const ss_sock_info_t *sock)
+{
+    switch (sock->protocol) {
+        case SS_PROTO_UDP:
+            return SS_GROUP_UDP;
+        case SS_PROTO_TCP:
+            return SS_GROUP_TCP;
+        default:
+            return SS_GROUP_UNIX;
+    }
+}
+
+/* Get a zeroed slot at the end of the table; not kept until committed */
+ss_sock_info_t *sock_table_next(ss_sock_table_t *table)
+{
+    if (table->count == table->cap) {
+        size_t new_cap = table->cap ? table->cap * 2 : SOCK_TABLE_MIN_CAP;
+        ss_sock_info_t *recs = realloc(table->recs, new_cap * sizeof(ss_sock_info_t));
+        if (!recs) {
+            return NULL;
+        }
+        table->recs = recs;
+        if (table->ext) {
+            ss_sock_ext_t *ext = realloc(table->ext, new_cap * sizeof(ss_sock_ext_t));
+            if (!ext) {
+                return NULL;
+            }
+            table->ext = ext;
+        }
+        table->cap = new_cap;
+    }
+
+    /* Reusing an uncommitted slot: drop the strings added for it */
+    if (table->pending) {
+        table->strings_len = table->strings_mark;
+    }
+    table->strings_mark = table->strings_len;
+    table->pending = true;
+
+    ss_sock_info_t *sock = &table->recs[table->count];
+    memset(sock, 0, sizeof(*sock));
+    if (table->ext) {
+        memset(&table->ext[table->count], 0, sizeof(ss_sock_ext_t));
+    }
+    return sock;
+}
+
+/* Internals of the pending slot, allocating the array on first use; NULL if out of memory */
+ss_sock_ext_t *sock_table_ext(ss_sock_table_t *table)
+{
+    if (!table->ext) {
+        table->ext = calloc(table->cap, sizeof(ss_sock_ext_t));
+        if (!table->ext) {
+            return NULL;
+        }
+    }
+    return &table->ext[table->count];
+}
+
+/* Internals stored for a record of table, or NULL */
+const ss_sock_ext_t *sock_table_ext_of(const ss_sock_table_t *table, const ss_sock_info_t *sock)
+{
+    return table->ext ? &table->ext[sock - table->recs] : NULL;
+}
+
+/* Whether record a sorts after record b (heap order: the root sorts last) */
+static bool sorts_after(const ss_sock_table_t *table, size_t a, size_t b)
+{
+    return sort_compare(table->top_sort, table, &table->recs[a], &table->recs[b]) > 0;
+}
+
+static void swap_recs(ss_sock_table_t *table, size_t a, size_t b)
+{
+    ss_sock_info_t tmp = table->recs[a];
+    table->recs[a] = table->recs[b];
+    table->recs[b] = tmp;
+    if (table->ext) {
+        ss_sock_ext_t ext = table->ext[a];
+        table->ext[a] = table->ext[b];
+        table->ext[b] = ext;
+    }
+}
+
+/*
+ * Whether the pending record interned its process name: collectors intern
+ * a name once and share the offset with the process's later records, so
+ * the string must stay even if the record itself is not kept.
+ */
+static bool owns_proc_name(const ss_sock_table_t *table, const ss_sock_info_t *sock)
+{
+    return sock->proc_name && sock->proc_name >= table->strings_mark;
+}
+
+/* Keep the pending record if it is among the first table->top so far */
+static void top_commit(ss_sock_table_t *table)
+{
+    ss_sock_info_t *recs = table->recs;
+    size_t i = table->count;
+
+    if (i < table->top) {
+        while (i > 0 && sorts_after(table, i, (i - 1) / 2)) {
+            swap_recs(table, i, (i - 1) / 2);
+            i = (i - 1) / 2;
+        }
+        table->count++;
+        table->pending = false;
+        return;
+    }
+
+    if (sorts_after(table, 0, i)) {
+        recs[0] = recs[i];
+        if (table->ext) {
+            table->ext[0] = table->ext[i];
+        }
+        table->pending = false;
+        for (i = 0; ; ) {
+            size_t last = i, l = 2 * i + 1, r = l + 1;
+            if (l < table->count && sorts_after(table, l, last)) last = l;
+            if (r < table->count && sorts_after(table, r, last)) last = r;
+            if (last == i) break;
+            swap_recs(table, i, last);
+            i = last;
+        }
+    } else if (owns_proc_name(table, &recs[i])) {
+        table->pending = false;
+    }
+}
+
+/*
+ * Keep the slot returned by the last sock_table_next(). In counting mode
+ * the record is only added to the totals and its slot is reused, and in
+ * aggregation mode to its group; in top mode it is kept only if it sorts
+ * before the last record kept so far.
+ */
+void sock_table_commit(ss_sock_table_t *table)
+{
+    if (table->counts) {
+        stats_add(table->counts, &table->recs[table->count]);
+        return;
+    }
+    if (table->agg) {
+        const ss_sock_info_t *sock = &table->recs[table->count];
+        agg_add(table->agg, sock);
+        if (owns_proc_name(table, sock)) {
+            table->pending = false;
+        }
+        return;
+    }
+    if (table->top) {
+        top_commit(table);
+        return;
+    }
+    table->count++;
+    table->pending = false;
+}
+
+/*
+ * Copy len bytes of str (plus a NUL) into the string pool and return its
+ * offset. Empty strings, and strings that do not fit, map to offset 0.
+ */
+uint32_t sock_table_intern(ss_sock_table_t *table, const char *str, size_t len)
+{
+    if (len == 0) {
+        return 0;
+    }
+    if (table->strings_len == 0) {
+        /* Reserve offset 0 for "" */
+        table->strings_len = 1;
+    }
+    if (table->strings_len + len + 1 > table->strings_cap) {
+        size_t new_cap = table->strings_cap ? table->strings_cap : SOCK_TABLE_MIN_STRINGS;
+        while (new_cap < table->strings_len + len + 1) {
+            new_cap *= 2;
+        }
+        if (new_cap > UINT32_MAX) {
+            return 0;
+        }
+        char *strings = realloc(table->strings, new_cap);
+        if (!strings) {
+            return 0;
+        }
+        strings[0] = '\0';
+        table->strings = strings;
+        table->strings_cap = new_cap;
+    }
+
+    uint32_t off = (uint32_t)table->strings_len;
+    memcpy(table->strings + off, str, len);
+    table->strings[off + len] = '\0';
+    table->strings_len += len + 1;
+    return off;
+}
+
+/* Where compaction moved pool strings: old offset -> new offset */
+typedef struct {
+    uint32_t *slots;    /* Pairs (old, new); old 0 is an empty slot */
+    size_t mask;
+} moved_map_t;
+
+/*
+ * Copy the pool string at *off, if it is at or above floor, to buf + *len
+ * and point *off at its new place. A string several records share (a
+ * process name) is copied once.
+ */
+static void move_string(const ss_sock_table_t *table, moved_map_t *moved, uint32_t *off,
+                        size_t floor, char *buf, size_t *len)
+{
+    if (*off < floor) {
+        return;
+    }
+
+    size_t i = ((size_t)*off * 2654435761u) & moved->mask;
+    while (moved->slots[2 * i] && moved->slots[2 * i] != *off) {
+        i = (i + 1) & moved->mask;
+    }
+    if (!moved->slots[2 * i]) {
+        size_t n = strlen(table->strings + *off) + 1;
+        memcpy(buf + *len, table->strings + *off, n);
+        moved->slots[2 * i] = *off;
+        moved->slots[2 * i + 1] = (uint32_t)(floor + *len);
+        *len += n;
+    }
+    *off = moved->slots[2 * i + 1];
+}
+
+/*
+ * Top mode: once enough strings of dropped records have piled up, repack
+ * the pool with only the strings kept records reference. Strings below
+ * strings_floor stay where they are, for collectors that hold their
+ * offsets across records; keep is one more offset the caller holds (0 if
+ * none), and its new value is returned. Call only between records.
+ */
+uint32_t sock_table_compact(ss_sock_table_t *table, uint32_t keep)
+{
+    size_t floor = table->strings_floor ? table->strings_floor : 1;
+
+    if (!table->top) {
+        return keep;
+    }
+    if (table->pending) {
+        table->strings_len = table->strings_mark;
+        table->pending = false;
+    }
+
+    /* Amortize: repack after the pool has grown by its live size and a page per 512 records */
+    size_t used = table->strings_len > floor ? table->strings_len - floor : 0;
+    if (used <= 2 * table->strings_kept + SOCK_TABLE_MIN_STRINGS + table->count * 8) {
+        return keep;
+    }
+
+    /* Each record references at most two strings */
+    moved_map_t moved = { NULL, 1 };
+    while (moved.mask + 1 < 4 * (table->count + 1)) {
+        moved.mask = 2 * moved.mask + 1;
+    }
+    moved.slots = calloc(2 * (moved.mask + 1), sizeof(uint32_t));
+    char *buf = malloc(used);
+    /* Best effort: without memory the pool just stays as it is */
+    if (!moved.slots || !buf) {
+        free(moved.slots);
+        free(buf);
+        return keep;
+    }
+
+    size_t len = 0;
+    move_string(table, &moved, &keep, floor, buf, &len);
+    for (size_t i = 0; i < table->count; i++) {
+        move_string(table, &moved, &table->recs[i].unix_path, floor, buf, &len);
+        move_string(table, &moved, &table->recs[i].proc_name, floor, buf, &len);
+    }
+    memcpy(table->strings + floor, buf, len);
+    free(moved.slots);
+    free(buf);
+
+    table->strings_len = floor + len;
+    table->strings_mark = table->strings_len;
+    table->strings_kept = len;
+    return keep;
+}
+
+/* String at a pool offset; offset 0 is always "" */
+const char *sock_table_str(const ss_sock_table_t *table, uint32_t off)
+{
+    return off ? table->strings + off : "";
+}
+
+/*
+ * Group records by section with a counting sort. Within a section the
+ * newest record comes first, which is the order ss has always printed in.
+ * The records are scattered into a second array: moving them in place by
+ * following the permutation's cycles saves that copy at the peak, but the
+ * dependent random accesses make the phase 2-2.5x slower at 1M sockets,
+ * and keeping the growth block alive leaves the freed collection memory
+ * below it resident.
+ */
+bool sock_table_finalize(ss_sock_table_t *table)
+{
+    size_t cursor[SS_GROUP_COUNT] = {0};
+
+    /* Drop strings of an uncommitted slot (and in top mode, of dropped records) */
+    if (table->pending) {
+        table->strings_len = table->strings_mark;
+        table->pending = false;
+    }
+    sock_table_compact(table, 0);
+
+    memset(table->group_start, 0, sizeof(table->group_start));
+    for (size_t i = 0; i < table->count; i++) {
+        table->group_start[sock_group(&table->recs[i]) + 1]++;
+    }
+    for (int g = 0; g < SS_GROUP_COUNT; g++) {
+        table->group_start[g + 1] += table->group_start[g];
+        cursor[g] = table->group_start[g];
+    }
+
+    if (table->count == 0) {
+        return true;
+    }
+
+    ss_sock_info_t *sorted = malloc(table->count * sizeof(ss_sock_info_t));
+    ss_sock_ext_t *sorted_ext = table->ext ? malloc(table->count * sizeof(ss_sock_ext_t)) : NULL;
+    if (!sorted || (table->ext && !sorted_ext)) {
+        free(sorted);
+        memset(table->group_start, 0, sizeof(table->group_start));
+        return false;
+    }
+    for (size_t i = table->count; i-- > 0; ) {
+        const ss_sock_info_t *sock = &table->recs[i];
+        size_t pos = cursor[sock_group(sock)]++;
+        sorted[pos] = *sock;
+        if (sorted_ext) {
+            sorted_ext[pos] = table->ext[i];
+        }
+    }
+
+    free(table->recs);
+    free(table->ext);
+    table->recs = sorted;
+    table->ext = sorted_ext;
+    table->cap = table->count;
+    return true;
+}
+
+/* Empty the table but keep its buffers for the next collection */
+void sock_table_reset(ss_sock_table_t *table)
+{
+    table->count = 0;
+    table->strings_len = 0;
+    table->strings_mark = 0;
+    table->pending = false;
+    memset(table->group_start, 0, sizeof(table->group_start));
+}
+
+/* Release unused capacity of a table that is kept around but rarely grows */
+void sock_table_trim(ss_sock_table_t *table)
+{
+    /* Drop strings of an uncommitted slot */
+    if (table->pending) {
+        table->strings_len = table->strings_mark;
+        table->pending = false;
+    }
+
+    size_t keep = table->count ? table->count : 1;
+    if (table->cap > keep) {
+        ss_sock_info_t *recs = realloc(table->recs, keep * sizeof(ss_sock_info_t));
+        ss_sock_ext_t *ext = table->ext ? realloc(table->ext, keep * sizeof(ss_sock_ext_t)) : NULL;
+        /* An array that could not shrink is just larger than cap */
+        if (recs) {
+            table->recs = recs;
+        }
+        if (ext) {
+            table->ext = ext;
+        }
+        table->cap = keep;
+    }
+
+    if (table->strings_len <= 1) {
+        free(table->strings);
+        table->strings = NULL;
+        table->strings_len = 0;
+        table->strings_cap = 0;
+    } else if (table->strings_cap > table->strings_len) {
+        char *strings = realloc(table->strings, table->strings_len);
+        if (strings) {
+            table->strings = strings;
+            table->strings_cap = table->strings_len;
+        }
+    }
+}
+
+void sock_table_free(ss_sock_table_t *table)
+{
+    if (table->map) {
+        munmap(table->map, table->map_len);
+    } else {
+        free(table->recs);
+        free(table->ext);
+        free(table->strings);
+    }
+    memset(table, 0, sizeof(*table));
+}
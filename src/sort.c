@@ -0,0 +1,297 @@
+/*
+ * ss - Socket Statistics for Apple platforms (macOS/iOS)
+ * Output order for --sort / --top
+ *
+ * A sort is a list of fields. Queue sizes sort largest first and the
+ * other fields ascending; a '-' before a field reverses it. Records that
+ * tie on every field keep discovery order.
+ *
+ * Full sorts are LSD radix sorts of fixed-width binary keys: each field
+ * is written big-endian (inverted when descending), so comparing keys
+ * bytewise is the sort order, and the record's discovery sequence number
+ * is appended as the final tie-break. Key bytes that are the same in
+ * every record (the high bytes of small queue sizes, say) are skipped.
+ * Process names are replaced by their rank among the distinct names,
+ * which are few: names are interned once per process.
+ *
+ * --top keeps a bounded heap in the table during collection instead
+ * (see socktable.c), which compares records with sort_compare().
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ss.h"
+
+/* Key bytes of an address field: family, address, port */
+#define ADDR_KEY_LEN (1 + 16 + 2)
+
+static const struct {
+    const char *name;
+    uint8_t width;          /* Key bytes */
+    bool desc;              /* Natural order is largest first */
+} sort_fields[SS_SORT_COUNT] = {
+    [SS_SORT_RECVQ]   = { "recvq",   4, true },
+    [SS_SORT_SENDQ]   = { "sendq",   4, true },
+    [SS_SORT_SPORT]   = { "sport",   2, false },
+    [SS_SORT_DPORT]   = { "dport",   2, false },
+    [SS_SORT_SRC]     = { "src",     ADDR_KEY_LEN, false },
+    [SS_SORT_DST]     = { "dst",     ADDR_KEY_LEN, false },
+    [SS_SORT_STATE]   = { "state",   1, false },
+    [SS_SORT_PID]     = { "pid",     4, false },
+    [SS_SORT_PROCESS] = { "process", 4, false },
+};
+
+/* "field[,field...]", each optionally prefixed with '-' */
+bool sort_parse(const char *spec, ss_sort_t *sort)
+{
+    memset(sort, 0, sizeof(*sort));
+    for (const char *p = spec; ; ) {
+        bool reverse = (*p == '-');
+        if (reverse) {
+            p++;
+        }
+        size_t len = strcspn(p, ",");
+        int field = -1;
+        for (int f = 0; f < SS_SORT_COUNT; f++) {
+            if (strlen(sort_fields[f].name) == len && strncmp(p, sort_fields[f].name, len) == 0) {
+                field = f;
+            }
+        }
+        if (field < 0 || sort->num_keys == SS_SORT_MAX_KEYS) {
+            return false;
+        }
+        sort->field[sort->num_keys] = (uint8_t)field;
+        sort->desc[sort->num_keys] = sort_fields[field].desc != reverse;
+        sort->num_keys++;
+        if (p[len] == '\0') {
+            return true;
+        }
+        p += len + 1;
+    }
+}
+
+static int cmp_u64(uint64_t a, uint64_t b)
+{
+    return (a > b) - (a < b);
+}
+
+static int cmp_addr(const ss_sock_info_t *a, const ss_addr_t *aa, uint16_t ap,
+                    const ss_sock_info_t *b, const ss_addr_t *ba, uint16_t bp)
+{
+    if (a->family != b->family) {
+        return cmp_u64(a->family, b->family);
+    }
+    int c = memcmp(aa, ba, sizeof(ss_addr_t));
+    return c ? c : cmp_u64(ap, bp);
+}
+
+/* Order of two records: < 0 if a comes first */
+int sort_compare(const ss_sort_t *sort, const ss_sock_table_t *table,
+                 const ss_sock_info_t *a, const ss_sock_info_t *b)
+{
+    for (int k = 0; k < sort->num_keys; k++) {
+        int c;
+        switch (sort->field[k]) {
+            case SS_SORT_RECVQ:
+                c = cmp_u64(a->recv_queue, b->recv_queue);
+                break;
+            case SS_SORT_SENDQ:
+                c = cmp_u64(a->send_queue, b->send_queue);
+                break;
+            case SS_SORT_SPORT:
+                c = cmp_u64(a->local_port, b->local_port);
+                break;
+            case SS_SORT_DPORT:
+                c = cmp_u64(a->remote_port, b->remote_port);
+                break;
+            case SS_SORT_SRC:
+                c = cmp_addr(a, &a->local_ip, a->local_port, b, &b->local_ip, b->local_port);
+                break;
+            case SS_SORT_DST:
+                c = cmp_addr(a, &a->remote_ip, a->remote_port, b, &b->remote_ip, b->remote_port);
+                break;
+            case SS_SORT_STATE:
+                c = cmp_u64(a->state, b->state);
+                break;
+            case SS_SORT_PID:
+                c = cmp_u64((uint32_t)a->pid, (uint32_t)b->pid);
+                break;
+            default:
+                c = a->proc_name == b->proc_name ? 0 :
+                    strcmp(sock_table_str(table, a->proc_name), sock_table_str(table, b->proc_name));
+                break;
+        }
+        if (c) {
+            return sort->desc[k] ? -c : c;
+        }
+    }
+    return cmp_u64(a->seq, b->seq);
+}
+
+/* Process name ranks: offset -> position of the name in strcmp order */
+typedef struct {
+    uint32_t off;
+    uint32_t rank;
+    const char *name;
+} name_rank_t;
+
+static int cmp_rank_off(const void *a, const void *b)
+{
+    return cmp_u64(((const name_rank_t *)a)->off, ((const name_rank_t *)b)->off);
+}
+
+static int cmp_rank_name(const void *a, const void *b)
+{
+    return strcmp(((const name_rank_t *)a)->name, ((const name_rank_t *)b)->name);
+}
+
+/* Distinct names of the records, ranked and sorted by offset; NULL on error */
+static name_rank_t *rank_names(const ss_sock_table_t *table, const uint32_t *idx, size_t n,
+                               size_t *count)
+{
+    name_rank_t *ranks = malloc((n ? n : 1) * sizeof(*ranks));
+    if (!ranks) {
+        return NULL;
+    }
+    for (size_t i = 0; i < n; i++) {
+        ranks[i].off = table->recs[idx[i]].proc_name;
+    }
+    qsort(ranks, n, sizeof(*ranks), cmp_rank_off);
+    size_t m = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (m == 0 || ranks[m - 1].off != ranks[i].off) {
+            ranks[m].off = ranks[i].off;
+            ranks[m].name = sock_table_str(table, ranks[i].off);
+            m++;
+        }
+    }
+
+    qsort(ranks, m, sizeof(*ranks), cmp_rank_name);
+    for (size_t i = 0; i < m; i++) {
+        bool same = i > 0 && strcmp(ranks[i - 1].name, ranks[i].name) == 0;
+        ranks[i].rank = same ? ranks[i - 1].rank : (uint32_t)i;
+    }
+    qsort(ranks, m, sizeof(*ranks), cmp_rank_off);
+    *count = m;
+    return ranks;
+}
+
+static uint32_t name_rank(const name_rank_t *ranks, size_t m, uint32_t off)
+{
+    name_rank_t want = { .off = off };
+    const name_rank_t *r = bsearch(&want, ranks, m, sizeof(*ranks), cmp_rank_off);
+    return r ? r->rank : 0;
+}
+
+static uint8_t *put_be(uint8_t *p, uint64_t v, int width)
+{
+    for (int i = width - 1; i >= 0; i--) {
+        p[i] = (uint8_t)v;
+        v >>= 8;
+    }
+    return p + width;
+}
+
+static uint8_t *put_addr(uint8_t *p, const ss_sock_info_t *sock, const ss_addr_t *addr,
+                         uint16_t port)
+{
+    *p++ = sock->family;
+    memcpy(p, addr, sizeof(*addr));
+    return put_be(p + sizeof(*addr), port, 2);
+}
+
+/*
+ * Reorder idx[0..n) (record indices into the table) into sort order.
+ * Returns false if out of memory.
+ */
+bool sort_indices(const ss_sort_t *sort, const ss_sock_table_t *table, uint32_t *idx, size_t n)
+{
+    if (n < 2) {
+        return true;
+    }
+
+    size_t width = sizeof(uint64_t);        /* Discovery sequence number */
+    bool need_names = false;
+    for (int k = 0; k < sort->num_keys; k++) {
+        width += sort_fields[sort->field[k]].width;
+        need_names |= (sort->field[k] == SS_SORT_PROCESS);
+    }
+    size_t stride = width + sizeof(uint32_t);
+
+    name_rank_t *ranks = NULL;
+    size_t num_ranks = 0;
+    if (need_names && !(ranks = rank_names(table, idx, n, &num_ranks))) {
+        return false;
+    }
+    uint8_t *keys = malloc(n * stride);
+    uint8_t *tmp = malloc(n * stride);
+    if (!keys || !tmp) {
+        free(ranks);
+        free(keys);
+        free(tmp);
+        return false;
+    }
+
+    /* Keys, each followed by its record index */
+    for (size_t i = 0; i < n; i++) {
+        const ss_sock_info_t *sock = &table->recs[idx[i]];
+        uint8_t *key = keys + i * stride;
+        uint8_t *p = key;
+        for (int k = 0; k < sort->num_keys; k++) {
+            uint8_t *field = p;
+            switch (sort->field[k]) {
+                case SS_SORT_RECVQ:   p = put_be(p, sock->recv_queue, 4); break;
+                case SS_SORT_SENDQ:   p = put_be(p, sock->send_queue, 4); break;
+                case SS_SORT_SPORT:   p = put_be(p, sock->local_port, 2); break;
+                case SS_SORT_DPORT:   p = put_be(p, sock->remote_port, 2); break;
+                case SS_SORT_SRC:     p = put_addr(p, sock, &sock->local_ip, sock->local_port); break;
+                case SS_SORT_DST:     p = put_addr(p, sock, &sock->remote_ip, sock->remote_port); break;
+                case SS_SORT_STATE:   p = put_be(p, sock->state, 1); break;
+                case SS_SORT_PID:     p = put_be(p, (uint32_t)sock->pid, 4); break;
+                default:
+                    p = put_be(p, name_rank(ranks, num_ranks, sock->proc_name), 4);
+                    break;
+            }
+            if (sort->desc[k]) {
+                for (uint8_t *b = field; b < p; b++) {
+                    *b = (uint8_t)~*b;
+                }
+            }
+        }
+        p = put_be(p, sock->seq, 8);
+        memcpy(p, &idx[i], sizeof(uint32_t));
+    }
+    free(ranks);
+
+    /* One stable counting pass per key byte, least significant first */
+    for (size_t b = width; b-- > 0; ) {
+        size_t count[256] = {0};
+        for (size_t i = 0; i < n; i++) {
+            count[keys[i * stride + b]]++;
+        }
+        if (count[keys[b]] == n) {
+            continue;
+        }
+        size_t pos = 0;
+        for (int v = 0; v < 256; v++) {
+            size_t c = count[v];
+            count[v] = pos;
+            pos += c;
+        }
+        for (size_t i = 0; i < n; i++) {
+            const uint8_t *key = keys + i * stride;
+            memcpy(tmp + count[key[b]]++ * stride, key, stride);
+        }
+        uint8_t *swap = keys;
+        keys = tmp;
+        tmp = swap;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        memcpy(&idx[i], keys + i * stride + width, sizeof(uint32_t));
+    }
+    free(keys);
+    free(tmp);
+    return true;
+}
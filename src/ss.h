@@ -8,7 +8,9 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <sys/types.h>
+#include <netinet/in.h>
 
 /* Version */
 #define SS_VERSION "1.0.1"
@@ -52,20 +54,31 @@ typedef enum {
     SS_TCP_TIME_WAIT
 } ss_tcp_state_t;
 
-/* Socket information structure */
+/* Binary IPv4/IPv6 address */
+typedef union {
+    struct in_addr  v4;
+    struct in6_addr v6;
+} ss_addr_t;
+
+/*
+ * Socket information structure. Kept small (80 bytes): strings live in
+ * the owning table's string pool and are referenced by offset, with 0
+ * meaning "none" (see sock_table_str()).
+ */
 typedef struct ss_sock_info {
-    ss_family_t family;
-    ss_proto_t protocol;
-    ss_tcp_state_t state;
+    /* Addresses, binary; text is produced only when printing */
+    ss_addr_t local_ip;           /* INET/INET6 only */
+    ss_addr_t remote_ip;
     
-    /* Addresses */
-    char local_addr[MAX_ADDR_LEN];
-    uint16_t local_port;
-    char remote_addr[MAX_ADDR_LEN];
-    uint16_t remote_port;
+    /* Discovery order: (PID index << 32) | fd table index */
+    uint64_t seq;
     
-    /* UNIX socket path */
-    char unix_path[MAX_PATH_LEN];
+    uint16_t local_port;          /* Host byte order */
+    uint16_t remote_port;
+    uint8_t family;               /* ss_family_t */
+    uint8_t protocol;             /* ss_proto_t */
+    uint8_t state;                /* ss_tcp_state_t */
+    bool unix_connected;          /* UNIX: socket has a peer */
     
     /* Queue sizes */
     uint32_t recv_queue;
@@ -74,16 +87,149 @@ typedef struct ss_sock_info {
     /* Process info (if available) */
     pid_t pid;
     int fd;                       /* File descriptor number */
-    char proc_name[MAX_PROC_NAME];
     uid_t uid;
     
     /* Extended info */
     uint32_t inode;
     
-    /* Linked list */
-    struct ss_sock_info *next;
+    /* String pool offsets */
+    uint32_t unix_path;           /* UNIX socket path */
+    uint32_t proc_name;           /* Interned once per process */
 } ss_sock_info_t;
 
+/*
+ * Socket internals for -i / -o. Kept in an array beside the records
+ * (see sock_table_ext()), which exists only when a collector stores them.
+ */
+typedef struct {
+    uint32_t rcv_hiwat;           /* Buffer limits */
+    uint32_t snd_hiwat;
+    uint32_t rcv_used;            /* Bytes held against them */
+    uint32_t snd_used;
+    uint32_t mss;                 /* TCP only (has_tcp) */
+    uint32_t flags;               /* tcpsi_flags */
+    uint32_t timer[4];            /* ms; retransmit, persist, keepalive, 2MSL; 0 = off */
+    bool has_tcp;
+} ss_sock_ext_t;
+
+/* Output sections, in Linux ss print order */
+typedef enum {
+    SS_GROUP_UDP,
+    SS_GROUP_TCP,
+    SS_GROUP_UNIX,
+    SS_GROUP_COUNT
+} ss_group_t;
+
+/*
+ * Contiguous socket store (socktable.c). After sock_table_finalize(),
+ * section g occupies recs[group_start[g] .. group_start[g + 1]).
+ */
+typedef struct {
+    ss_sock_info_t *recs;
+    size_t count;
+    size_t cap;
+    size_t group_start[SS_GROUP_COUNT + 1];
+    
+    /* String pool: NUL-terminated strings; offset 0 is "" */
+    char *strings;
+    size_t strings_len;
+    size_t strings_cap;
+    size_t strings_mark;          /* Pool length when the pending slot was taken */
+    size_t strings_floor;         /* Top mode: compaction leaves strings below this alone */
+    size_t strings_kept;          /* Top mode: pool bytes above the floor after compaction */
+    bool pending;                 /* sock_table_next() slot not yet committed */
+    
+    /* Counting mode (-s): commit adds the slot to these totals and reuses it */
+    struct ss_stats *counts;
+    
+    /* Top mode (--top): only the first top records in top_sort order are kept */
+    size_t top;
+    const struct ss_sort *top_sort;
+    
+    /* Aggregation mode (--group-by): commit folds the slot into agg and reuses it */
+    struct ss_agg *agg;
+    
+    /* -i / -o internals: ext[i] belongs to recs[i], same capacity; NULL if none */
+    ss_sock_ext_t *ext;
+    
+    /* Loaded snapshot (--load): recs and strings point into this mapping */
+    void *map;
+    size_t map_len;
+} ss_sock_table_t;
+
+/* Output format */
+typedef enum {
+    SS_FORMAT_TABLE,        /* Linux ss columns */
+    SS_FORMAT_JSON,         /* --json: one array of objects */
+    SS_FORMAT_NDJSON,       /* --ndjson: one object per line */
+    SS_FORMAT_CSV           /* --csv: RFC 4180, header row first */
+} ss_format_t;
+
+/* One instruction of a compiled filter expression (filter.c) */
+typedef struct {
+    uint8_t op;             /* Term, or and/or/not over earlier results */
+    uint8_t cmp;            /* sport/dport: comparison */
+    uint8_t family;         /* src/dst: SS_FAMILY_INET/INET6, UNKNOWN = any address */
+    uint8_t prefix;         /* src/dst: prefix length in bits */
+    uint16_t port;          /* Port (src/dst: 0 = any) */
+    uint8_t addr[16];
+} ss_filter_insn_t;
+
+/* Filter given as non-option arguments: STATE-FILTER [EXPRESSION] */
+typedef struct {
+    bool has_states;        /* state/exclude given: replaces the -l/-a rules */
+    uint16_t states;        /* Bit per ss_tcp_state_t */
+    ss_filter_insn_t *prog; /* Expression in postfix order (len = 0: none) */
+    int len;
+} ss_filter_t;
+
+/* Sort fields for --sort (sort.c) */
+typedef enum {
+    SS_SORT_RECVQ,
+    SS_SORT_SENDQ,
+    SS_SORT_SPORT,
+    SS_SORT_DPORT,
+    SS_SORT_SRC,
+    SS_SORT_DST,
+    SS_SORT_STATE,
+    SS_SORT_PID,
+    SS_SORT_PROCESS,
+    SS_SORT_COUNT
+} ss_sort_field_t;
+
+#define SS_SORT_MAX_KEYS 8
+
+/* Output order: fields in priority order (num_keys = 0: collection order) */
+typedef struct ss_sort {
+    int num_keys;
+    uint8_t field[SS_SORT_MAX_KEYS];    /* ss_sort_field_t */
+    bool desc[SS_SORT_MAX_KEYS];        /* Largest first */
+} ss_sort_t;
+
+/* Aggregation keys for --group-by (aggregate.c) */
+typedef enum {
+    SS_GROUP_BY_NONE,
+    SS_GROUP_BY_PROCESS,    /* Owning PID */
+    SS_GROUP_BY_REMOTE,     /* Peer address, or its subnet */
+    SS_GROUP_BY_LPORT,      /* Protocol and local port */
+    SS_GROUP_BY_STATE       /* Protocol and state */
+} ss_group_by_t;
+
+typedef struct {
+    uint8_t by;             /* ss_group_by_t */
+    uint8_t prefix4;        /* remote: IPv4 prefix length kept */
+    uint8_t prefix6;        /* remote: IPv6 prefix length kept */
+} ss_group_spec_t;
+
+/* Longest-prefix-match trie of allowed/denied CIDR blocks (cidr.c) */
+typedef struct ss_cidr_node ss_cidr_node_t;
+typedef struct {
+    ss_cidr_node_t *nodes;  /* Node 0: IPv4 root, node 1: IPv6 root */
+    uint32_t count;
+    uint32_t cap;
+    size_t prefixes;        /* Distinct prefixes loaded */
+} ss_cidr_trie_t;
+
 /* Command line options */
 typedef struct {
     bool show_tcp;          /* -t: show TCP sockets */
@@ -94,15 +240,62 @@ typedef struct {
     bool numeric;           /* -n: don't resolve names */
     bool show_process;      /* -p: show process info */
     bool extended;          /* -e: show extended info */
+    bool tcp_info;          /* -i: show MSS and buffer fill */
+    bool timers;            /* -o: show TCP timers */
     bool summary;           /* -s: show summary statistics */
     bool ipv4_only;         /* -4: IPv4 only */
     bool ipv6_only;         /* -6: IPv6 only */
+    bool no_header;         /* -H: no header line / CSV header row */
     bool version;           /* -V: show version */
     bool help;              /* -h: show help */
+    const char *collector;  /* --collector: backend name (NULL = default) */
+    int threads;            /* -j: collection worker threads */
+    ss_format_t format;     /* --json/--ndjson/--csv */
+    bool watch;             /* --interval: redisplay until --count ticks */
+    double interval;        /* --interval: seconds between ticks */
+    long count;             /* --count: number of ticks (0 = forever) */
+    
+    /* Process filters: only sockets of matching processes */
+    bool filter_uid;        /* --uid */
+    uid_t uid;
+    bool filter_pgrp;       /* --pgrp */
+    pid_t pgrp;
+    const pid_t *pids;      /* --pid: explicit PIDs (num_pids entries) */
+    int num_pids;
+
+    ss_filter_t filter;     /* Filter expression arguments */
+    const ss_cidr_trie_t *src_cidrs;    /* --src-file: local address must match */
+    const ss_cidr_trie_t *dst_cidrs;    /* --dst-file: remote address must match */
+
+    bool self_stats;        /* --self-stats: profile report on stderr */
+    int self_stats_top;     /* --self-stats=N: most expensive PIDs listed */
+    const char *trace_file; /* --trace: Chrome trace-event JSON */
+
+    const char *save_file;  /* --save: write a snapshot instead of listing */
+    const char *load_file;  /* --load: list from a snapshot, not the host */
+
+    bool daemon;            /* --daemon (or run as ssd): publish snapshots */
+    const char *shm_name;   /* --shm: daemon segment to publish / list from */
+    const char *query_path; /* --query: daemon socket to serve / query */
+    bool daemon_public;     /* --public: segment and socket open to every user */
+
+    ss_sort_t sort;         /* --sort: output order */
+    size_t top;             /* --top: print only the first N in --sort order */
+    ss_group_spec_t group_by;   /* --group-by: one row per group, no socket rows */
 } ss_options_t;
 
+/* Socket collector backend (selected with --collector) */
+typedef struct ss_collector {
+    const char *name;
+    int (*collect)(const ss_options_t *opts, ss_sock_table_t *table);
+    /* -s totals from kernel counters; NULL or -1 = use a counting pass */
+    int (*summarize)(const ss_options_t *opts, struct ss_stats *stats);
+    /* Provider of a PID/fd-walk collector (enables incremental watch) */
+    const struct ss_libproc_ops *libproc;
+} ss_collector_t;
+
 /* Statistics summary */
-typedef struct {
+typedef struct ss_stats {
     uint32_t tcp_total;
     uint32_t tcp_established;
     uint32_t tcp_syn_sent;
@@ -121,18 +314,236 @@ typedef struct {
     uint32_t unix_dgram_total;
 } ss_stats_t;
 
+/* Binary dedup key: (protocol, family, local addr/port, remote addr/port) */
+typedef struct {
+    uint8_t protocol;
+    uint8_t family;
+    uint16_t local_port;
+    uint16_t remote_port;
+    uint8_t pad[2];
+    uint8_t local_addr[16];
+    uint8_t remote_addr[16];
+} ss_sock_key_t;
+
+/* Open-addressing set of socket keys (sockset.c) */
+typedef struct ss_sockset_slot ss_sockset_slot_t;
+typedef struct {
+    ss_sockset_slot_t *slots;
+    size_t mask;
+    size_t count;
+} ss_sockset_t;
+
 /* Function declarations - Socket collection */
-ss_sock_info_t *collect_all_sockets(const ss_options_t *opts);
-void free_socket_list(ss_sock_info_t *list);
+int collect_all_sockets(const ss_options_t *opts, ss_sock_table_t *table);
+int collect_summary(const ss_options_t *opts, struct ss_stats *stats);
+const ss_collector_t *find_collector(const char *name);
+
+/* Socket store (socktable.c) */
+ss_group_t sock_group(const ss_sock_info_t *sock);
+ss_sock_info_t *sock_table_next(ss_sock_table_t *table);
+void sock_table_commit(ss_sock_table_t *table);
+bool sock_table_finalize(ss_sock_table_t *table);
+void sock_table_reset(ss_sock_table_t *table);
+void sock_table_trim(ss_sock_table_t *table);
+void sock_table_free(ss_sock_table_t *table);
+uint32_t sock_table_intern(ss_sock_table_t *table, const char *str, size_t len);
+uint32_t sock_table_compact(ss_sock_table_t *table, uint32_t keep);
+const char *sock_table_str(const ss_sock_table_t *table, uint32_t off);
+ss_sock_ext_t *sock_table_ext(ss_sock_table_t *table);
+const ss_sock_ext_t *sock_table_ext_of(const ss_sock_table_t *table, const ss_sock_info_t *sock);
+
+/* Collector backends */
+struct ss_libproc_ops;
+int collect_libproc_sockets(const struct ss_libproc_ops *ops, const ss_options_t *opts,
+                            ss_sock_table_t *table);
+int collect_netlink_sockets(const ss_options_t *opts, ss_sock_table_t *table);
+
+/* libproc walker internals (sockets.c, used by collect_mt.c and watch.c) */
+struct proc_fdinfo;
+bool proc_filter_active(const ss_options_t *opts);
+int list_target_pids(const struct ss_libproc_ops *ops, const ss_options_t *opts,
+                     pid_t **buf, int *cap);
+int list_process_fds(const struct ss_libproc_ops *ops, pid_t pid, struct proc_fdinfo **out);
+void collect_fd_range(const struct ss_libproc_ops *ops, pid_t pid, uint32_t pid_idx,
+                      const struct proc_fdinfo *fdinfo, int lo, int hi,
+                      ss_sock_table_t *table, const ss_options_t *opts,
+                      ss_sockset_t *seen);
+int collect_parallel(const struct ss_libproc_ops *ops, const pid_t *pids,
+                     int num_pids, const ss_options_t *opts, ss_sock_table_t *table);
+
+/* Socket dedup set for the libproc walk (sockset.c) */
+void sock_key_from_info(const ss_sock_table_t *table, const ss_sock_info_t *sock,
+                        ss_sock_key_t *key);
+bool sockset_init(ss_sockset_t *set, size_t expected);
+bool sockset_insert(ss_sockset_t *set, const ss_sock_table_t *table,
+                    const ss_sock_info_t *sock);
+bool sockset_insert_key(ss_sockset_t *set, const ss_sock_key_t *key);
+void sockset_clear(ss_sockset_t *set);
+void sockset_free(ss_sockset_t *set);
+
+/* Process metadata cache (proccache.c) */
+typedef struct {
+    uid_t uid;
+    uint64_t start_sec;     /* Start time: with the pid, identifies a process */
+    uint64_t start_usec;
+    char name[MAX_PROC_NAME];
+} ss_proc_meta_t;
+
+typedef struct {
+    uint64_t lookups;
+    uint64_t hits;
+    uint64_t misses;        /* Includes reused */
+    uint64_t reused;        /* Cached pid now held by a different process */
+    uint64_t uncached;      /* No start time available */
+} ss_proc_cache_stats_t;
+
+bool proc_cache_get(const struct ss_libproc_ops *ops, pid_t pid, ss_proc_meta_t *out);
+void proc_cache_stats(ss_proc_cache_stats_t *out);
+void proc_cache_free(void);
+
+/* Filter expressions (filter.c) */
+bool filter_compile(int argc, char **argv, ss_filter_t *filter);
+bool filter_state_match(const ss_filter_t *filter, const ss_sock_info_t *sock);
+bool filter_match(const ss_filter_t *filter, const ss_sock_info_t *sock);
+void filter_free(ss_filter_t *filter);
+
+/* Output order (sort.c) */
+bool sort_parse(const char *spec, ss_sort_t *sort);
+int sort_compare(const ss_sort_t *sort, const ss_sock_table_t *table,
+                 const ss_sock_info_t *a, const ss_sock_info_t *b);
+bool sort_indices(const ss_sort_t *sort, const ss_sock_table_t *table, uint32_t *idx, size_t n);
+
+/* Socket aggregation for --group-by (aggregate.c) */
+typedef struct ss_agg_entry ss_agg_entry_t;
+typedef struct ss_agg {
+    ss_group_spec_t spec;
+    ss_agg_entry_t *slots;  /* Open addressing, hash 0 = empty */
+    size_t mask;
+    size_t count;           /* Groups */
+    bool oom;               /* A group was lost for lack of memory */
+} ss_agg_t;
+
+/* One group as printed: up to two key columns, then the totals */
+typedef struct {
+    const char *key[2];     /* Field names (NULL: unused) */
+    const char *title[2];   /* Table column headers */
+    const char *val[2];     /* Values as text (NULL: none) */
+    bool numeric[2];        /* Value is a number (unquoted in JSON) */
+    int width[2];           /* Table column widths */
+    uint64_t sockets;
+    uint64_t recv_q;
+    uint64_t send_q;
+    uint32_t recv_q_max;
+    uint32_t send_q_max;
+} ss_group_row_t;
+
+bool agg_parse(const char *spec, ss_group_spec_t *out);
+bool agg_init(ss_agg_t *agg, const ss_group_spec_t *spec);
+void agg_add(ss_agg_t *agg, const ss_sock_info_t *sock);
+int agg_print(const ss_agg_t *agg, const ss_sock_table_t *table, const ss_options_t *opts);
+void agg_free(ss_agg_t *agg);
+
+/* CIDR lists (cidr.c) */
+bool cidr_trie_add(ss_cidr_trie_t *trie, ss_family_t family, const uint8_t *addr,
+                   unsigned prefix, bool deny);
+int cidr_trie_load(ss_cidr_trie_t *trie, const char *path);
+bool cidr_trie_match(const ss_cidr_trie_t *trie, const ss_sock_info_t *sock,
+                     const ss_addr_t *addr);
+void cidr_trie_free(ss_cidr_trie_t *trie);
+
+/* Binary snapshots for --save / --load (snapshot.c) */
+void snapshot_options(const ss_options_t *opts, ss_options_t *out);
+size_t snapshot_size(const ss_sock_table_t *table);
+void snapshot_encode(const ss_sock_table_t *table, void *buf);
+int snapshot_save(const ss_options_t *opts, const char *path);
+int snapshot_attach(void *map, size_t len, const char *name, ss_sock_table_t *table);
+int snapshot_load(const char *path, ss_sock_table_t *table);
+bool snapshot_include(const ss_sock_info_t *sock, const ss_options_t *opts);
+bool snapshot_group_shown(ss_group_t group, const ss_options_t *opts);
+
+/* Resident collector and its clients (daemon.c) */
+#define SSD_SHM_NAME "/ssd"
+#define SSD_QUERY_PATH "/tmp/ssd.sock"
+
+/* Answers one query in a forked child; output goes to stdout */
+typedef int (*ss_query_fn)(int argc, char **argv, const ss_sock_table_t *table);
+
+int daemon_run(const ss_options_t *opts, ss_query_fn serve);
+int daemon_read_shm(const char *name, ss_sock_table_t *table);
+int daemon_query(const char *path, int argc, char **argv);
+
+/* Synthetic libproc provider (synthetic.c) */
+bool synthetic_configure(const char *spec);
+
+/* Watch mode (watch.c) */
+int watch_sockets(const ss_options_t *opts);
+
+/* Self-profiling for --self-stats / --trace (selfstats.c) */
+typedef enum {
+    SS_PHASE_PIDS,          /* Listing target PIDs */
+    SS_PHASE_SCAN,          /* fd walk, or the whole collection without one */
+    SS_PHASE_MERGE,         /* Merging -j results / rebuilding the watch list */
+    SS_PHASE_GROUP,         /* Grouping records by output section */
+    SS_PHASE_OUTPUT,
+    SS_PHASE_COUNT
+} ss_phase_t;
+
+extern bool selfstats_on;
+void selfstats_start(void);
+uint64_t selfstats_now(void);
+void selfstats_phase_begin(ss_phase_t phase);
+void selfstats_phase_end(ss_phase_t phase);
+void selfstats_dedup(uint64_t t0);
+void selfstats_watch(size_t procs, size_t rescanned);
+const struct ss_libproc_ops *selfstats_wrap_ops(const struct ss_libproc_ops *ops);
+int selfstats_finish(const ss_options_t *opts);
+
+/* Socket collection helpers (shared by the libproc and netlink backends) */
+size_t format_addr_v4(const struct in_addr *addr, uint16_t port, char *buf, size_t buflen);
+size_t format_addr_v6(const struct in6_addr *addr, uint16_t port, char *buf, size_t buflen);
+bool should_include(const ss_sock_info_t *sock, const ss_options_t *opts);
+ss_tcp_state_t darwin_to_ss_state(int state);
+
+/* Summary counters (summary.c) */
+void stats_add(struct ss_stats *stats, const ss_sock_info_t *sock);
+int summarize_pcblist(const ss_options_t *opts, struct ss_stats *stats);
+
+/* Buffered output writer (outbuf.c); out_flush() before exit */
+void out_write(const char *data, size_t len);
+void out_char(char c);
+void out_str(const char *s);
+void out_fill(char c, int n);
+void out_pad(const char *s, size_t len, int width, bool left);
+void out_int(int64_t v, int width, bool left);
+void out_uint(uint64_t v, int width, bool left);
+void out_flush(void);
 
 /* Function declarations - Output */
+void print_begin(const ss_options_t *opts);
+void print_row(const ss_sock_table_t *table, const ss_sock_info_t *sock,
+               const ss_options_t *opts);
+void print_end(const ss_options_t *opts);
 void print_header(const ss_options_t *opts);
-void print_socket(const ss_sock_info_t *sock, const ss_options_t *opts);
+void print_socket(const ss_sock_table_t *table, const ss_sock_info_t *sock,
+                  const ss_options_t *opts);
 void print_summary(const ss_stats_t *stats);
+void print_totals(const ss_stats_t *stats, const ss_options_t *opts);
+void print_group_begin(const ss_group_row_t *row, const ss_options_t *opts);
+void print_group(const ss_group_row_t *row, const ss_options_t *opts);
 void print_help(const char *prog_name);
 void print_version(void);
 
+/* Machine-readable output (serialize.c) */
+void serialize_begin(const ss_options_t *opts);
+void serialize_socket(const ss_sock_table_t *table, const ss_sock_info_t *sock,
+                      const ss_options_t *opts);
+void serialize_end(const ss_options_t *opts);
+void serialize_summary(const ss_stats_t *stats, const ss_options_t *opts);
+void serialize_group_begin(const ss_group_row_t *row, const ss_options_t *opts);
+void serialize_group(const ss_group_row_t *row, const ss_options_t *opts);
+
 /* Utility functions */
 const char *tcp_state_to_string(ss_tcp_state_t state);
+const char *get_proto_name(const ss_sock_info_t *sock);
 
 #endif /* SS_H */
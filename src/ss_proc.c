@@ -1,9 +1,22 @@
 /*
- * ss_proc - Fast port-to-process mapper for iOS
+ * ss_proc - Fast socket-to-process mapper for iOS
  * Replaces lsof for ss command, ~400x faster
  * 
- * Output format: port cmd pid fd
- * Example: 22 sshd 1234 4
+ * Output format: proto local peer pid fd cmd
+ * Example: tcp 192.168.1.20:22 192.168.1.5:52144 1234 4 sshd
+ *
+ * Addresses are written the way ss-ios.sh normalizes netstat's: IPv6 in
+ * brackets, unspecified addresses as 0.0.0.0 / [::], port 0 as '*'. Each
+ * (proto, local, peer) tuple is printed once; a socket open in several
+ * processes is attributed to one that is not launchd.
+ *
+ * socket_fdinfo is read as an opaque blob whose field offsets come from a
+ * layout calibrated on this OS build (see fdinfo_layout.h) and cached in
+ * SS_PROC_LAYOUT (default /var/db/ss_proc.layout), which ss-ios shares.
+ *
+ * Usage: ss_proc [-r] [-d]
+ *   -r  recalibrate even if a cached layout exists
+ *   -d  print the calibration blobs as a tests/fdinfo corpus file and exit
  */
 
 #include <stdio.h>
@@ -14,7 +27,8 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <stdint.h>
-#include <errno.h>
+#include <unistd.h>
+#include "fdinfo_layout.h"
 
 /* libproc API declarations (not in iOS SDK headers) */
 #define PROC_ALL_PIDS 1
@@ -58,22 +72,189 @@ extern int proc_pidinfo(int pid, int flavor, uint64_t arg, void *buffer, int buf
 extern int proc_pidfdinfo(int pid, int fd, int flavor, void *buffer, int buffersize);
 extern int proc_name(int pid, void *buffer, uint32_t buffersize);
 
-/* Structure to hold port->process mapping */
+/* Connection tuple; zero-filled so it can be hashed and compared as bytes */
 typedef struct {
-    uint16_t port;
+    uint8_t protocol;
+    uint8_t family;
+    uint16_t lport;
+    uint16_t fport;
+    uint8_t laddr[16];
+    uint8_t faddr[16];
+} sock_tuple_t;
+
+/* Owner of a socket tuple */
+typedef struct {
+    sock_tuple_t key;
     pid_t pid;
     int fd;
     char cmd[17];
     int is_launchd;  /* Flag to deprioritize launchd */
-} port_proc_t;
+} sock_proc_t;
+
+/* Records in discovery order, indexed by an open-addressing tuple hash */
+static sock_proc_t *socks;
+static size_t num_socks, socks_cap;
+static uint32_t *slots;          /* Record index + 1, 0 = empty */
+static size_t slot_mask;
+
+static uint32_t hash_tuple(const sock_tuple_t *t)
+{
+    const uint8_t *p = (const uint8_t *)t;
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < sizeof(*t); i++) {
+        h = (h ^ p[i]) * 16777619u;
+    }
+    return h;
+}
+
+static uint32_t *find_slot(const sock_tuple_t *t)
+{
+    size_t i = hash_tuple(t) & slot_mask;
+    while (slots[i] != 0 && memcmp(&socks[slots[i] - 1].key, t, sizeof(*t)) != 0) {
+        i = (i + 1) & slot_mask;
+    }
+    return &slots[i];
+}
+
+/* Keep the hash at most half full */
+static bool grow_slots(void)
+{
+    size_t new_size = slots ? (slot_mask + 1) * 2 : 1024;
+    uint32_t *old = slots;
+    size_t old_size = old ? slot_mask + 1 : 0;
+
+    slots = calloc(new_size, sizeof(uint32_t));
+    if (!slots) {
+        slots = old;
+        return false;
+    }
+    slot_mask = new_size - 1;
+    for (size_t i = 0; i < old_size; i++) {
+        if (old[i] != 0) {
+            *find_slot(&socks[old[i] - 1].key) = old[i];
+        }
+    }
+    free(old);
+    return true;
+}
+
+/* Record the owner of a tuple; a non-launchd owner replaces launchd */
+static bool add_sock(const sock_tuple_t *key, pid_t pid, int fd, const char *cmd,
+                     int is_launchd)
+{
+    if ((num_socks + 1) * 2 > (slots ? slot_mask + 1 : 0) && !grow_slots()) {
+        return false;
+    }
+    uint32_t *slot = find_slot(key);
+    sock_proc_t *entry;
+    if (*slot != 0) {
+        entry = &socks[*slot - 1];
+        if (!entry->is_launchd || is_launchd) {
+            return true;
+        }
+    } else {
+        if (num_socks == socks_cap) {
+            size_t new_cap = socks_cap ? socks_cap * 2 : 1024;
+            sock_proc_t *grown = realloc(socks, new_cap * sizeof(sock_proc_t));
+            if (!grown) {
+                return false;
+            }
+            socks = grown;
+            socks_cap = new_cap;
+        }
+        entry = &socks[num_socks++];
+        entry->key = *key;
+        *slot = (uint32_t)num_socks;
+    }
+    entry->pid = pid;
+    entry->fd = fd;
+    strncpy(entry->cmd, cmd, sizeof(entry->cmd) - 1);
+    entry->cmd[sizeof(entry->cmd) - 1] = '\0';
+    entry->is_launchd = is_launchd;
+    return true;
+}
 
-/* Hash table for port->process mapping (simple array, max 65536 ports) */
-static port_proc_t port_map[65536];
+/* Link-local: the kernel embeds the scope in bytes 2-3, netstat does not show it */
+static void clear_scope(uint8_t *addr)
+{
+    if (addr[0] == 0xfe && (addr[1] & 0xc0) == 0x80) {
+        addr[2] = addr[3] = 0;
+    }
+}
+
+/*
+ * Tuple of a parsed socket. A dual-stack IPv6 socket talking IPv4 keeps
+ * its addresses in the last 4 bytes with the rest zero (never a real IPv6
+ * address apart from :: and ::1), which netstat lists as IPv4.
+ */
+static void make_tuple(const fdinfo_sock_t *s, sock_tuple_t *t)
+{
+    static const uint8_t zero[12];
+
+    memset(t, 0, sizeof(*t));
+    t->protocol = (uint8_t)s->protocol;
+    t->family = (uint8_t)s->family;
+    t->lport = s->lport;
+    t->fport = s->fport;
+    if (s->family == FDINFO_AF_INET6 &&
+        memcmp(s->laddr, zero, 12) == 0 && memcmp(s->faddr, zero, 12) == 0 &&
+        (s->laddr[12] | s->laddr[13] | s->laddr[14] | s->faddr[12] | s->faddr[13] | s->faddr[14]) != 0) {
+        t->family = FDINFO_AF_INET;
+        memcpy(t->laddr, s->laddr + 12, 4);
+        memcpy(t->faddr, s->faddr + 12, 4);
+        return;
+    }
+    memcpy(t->laddr, s->laddr, s->family == FDINFO_AF_INET6 ? 16 : 4);
+    memcpy(t->faddr, s->faddr, s->family == FDINFO_AF_INET6 ? 16 : 4);
+
+    if (t->family == FDINFO_AF_INET6) {
+        clear_scope(t->laddr);
+        clear_scope(t->faddr);
+    }
+}
+
+/* "addr:port", "[addr]:port", port 0 as '*' */
+static void print_endpoint(int family, const uint8_t *addr, uint16_t port)
+{
+    char host[INET6_ADDRSTRLEN];
+
+    inet_ntop(family == FDINFO_AF_INET6 ? AF_INET6 : AF_INET, addr, host, sizeof(host));
+    printf(family == FDINFO_AF_INET6 ? "[%s]:" : "%s:", host);
+    if (port) {
+        printf("%u", port);
+    } else {
+        putchar('*');
+    }
+}
 
 int main(int argc, char *argv[]) {
-    /* Initialize port map */
-    memset(port_map, 0, sizeof(port_map));
-    
+    bool recalibrate = false;
+    bool dump = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "rd")) != -1) {
+        switch (opt) {
+            case 'r':
+                recalibrate = true;
+                break;
+            case 'd':
+                dump = true;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-r] [-d]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    /* Field offsets for this OS build; never guess them */
+    fdinfo_layout_t layout;
+    if (!fdinfo_layout_get(&layout, recalibrate, dump)) {
+        return 1;
+    }
+    if (dump) {
+        return 0;
+    }
+
     /* Get all PIDs */
     int bufsize = proc_listpids(PROC_ALL_PIDS, 0, NULL, 0);
     if (bufsize <= 0) {
@@ -121,78 +302,33 @@ int main(int argc, char *argv[]) {
             if (fds[j].proc_fdtype != PROX_FDTYPE_SOCKET) continue;
             
             /* Get socket info - use large buffer for compatibility */
-            char si_buf[2048];
-            memset(si_buf, 0, sizeof(si_buf));
+            uint8_t si_buf[FDINFO_BUF_SIZE];
             int ret = proc_pidfdinfo(pid, fds[j].proc_fd, PROC_PIDFDSOCKETINFO, si_buf, sizeof(si_buf));
             if (ret <= 0) continue;
             
-            /* Parse socket info - find family and port */
-            /* The structure varies between iOS versions, so we search for patterns */
-            int *vals = (int *)si_buf;
-            int family = 0;
-            uint16_t local_port = 0;
+            /* Straight offset reads; skips non-IP sockets */
+            fdinfo_sock_t sock;
+            if (!fdinfo_parse(&layout, si_buf, ret, &sock)) continue;
             
-            /* First int values typically contain family */
-            for (int k = 0; k < 8; k++) {
-                if (vals[k] == AF_INET || vals[k] == AF_INET6) {
-                    family = vals[k];
-                    break;
-                }
-            }
+            if (sock.lport == 0) continue;
             
-            if (family == 0) continue;  /* Not a network socket */
-            
-            /* Extract port from socket_fdinfo structure */
-            /* On iOS 13, local port is at offset 0x10c (268) in big-endian */
-            uint8_t *bytes = (uint8_t *)si_buf;
-            
-            /* Primary offset: 0x10c for iOS 13 */
-            if (ret > 0x10e) {
-                uint16_t port_be = *(uint16_t *)(bytes + 0x10c);
-                local_port = ntohs(port_be);
-            }
-            
-            /* Fallback: scan nearby offsets if primary fails */
-            if (local_port == 0 || local_port >= 65535) {
-                int fallback_offsets[] = {0x10a, 0x10e, 0x110, 0x108, -1};
-                for (int k = 0; fallback_offsets[k] >= 0; k++) {
-                    int off = fallback_offsets[k];
-                    if (off + 2 > ret) continue;
-                    uint16_t port_be = *(uint16_t *)(bytes + off);
-                    uint16_t port = ntohs(port_be);
-                    if (port > 0 && port < 65535) {
-                        local_port = port;
-                        break;
-                    }
-                }
-            }
-            
-            if (local_port == 0 || local_port >= 65535) continue;
-            
-            /* Store in port map - prefer non-launchd processes */
-            port_proc_t *entry = &port_map[local_port];
-            
-            if (entry->port == 0 || 
-                (entry->is_launchd && !is_launchd)) {
-                entry->port = local_port;
-                entry->pid = pid;
-                entry->fd = fds[j].proc_fd;
-                strncpy(entry->cmd, proc_name_buf, sizeof(entry->cmd) - 1);
-                entry->cmd[sizeof(entry->cmd) - 1] = '\0';
-                entry->is_launchd = is_launchd;
+            sock_tuple_t key;
+            make_tuple(&sock, &key);
+            if (!add_sock(&key, pid, fds[j].proc_fd, proc_name_buf, is_launchd)) {
+                fprintf(stderr, "Memory allocation failed\n");
+                return 1;
             }
         }
     }
     
-    /* Output all port mappings */
-    for (int port = 1; port < 65536; port++) {
-        if (port_map[port].port > 0) {
-            printf("%d %s %d %d\n", 
-                   port_map[port].port,
-                   port_map[port].cmd,
-                   port_map[port].pid,
-                   port_map[port].fd);
-        }
+    /* Output the records in discovery order */
+    for (size_t i = 0; i < num_socks; i++) {
+        const sock_proc_t *e = &socks[i];
+        printf("%s ", e->key.protocol == IPPROTO_TCP ? "tcp" : "udp");
+        print_endpoint(e->key.family, e->key.laddr, e->key.lport);
+        putchar(' ');
+        print_endpoint(e->key.family, e->key.faddr, e->key.fport);
+        printf(" %d %d %s\n", e->pid, e->fd, e->cmd);
     }
     
     free(pids);
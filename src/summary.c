@@ -0,0 +1,271 @@
+/*
+ * ss - Socket Statistics for Apple platforms (macOS/iOS)
+ * Summary statistics (-s)
+ *
+ * -s never builds socket records. On macOS/iOS the per-protocol and
+ * per-state totals come straight from the kernel's pcblist sysctls (one
+ * sysctl per protocol). Collectors without such counters run a
+ * counting-only pass: sockets are decoded into a single reused table slot,
+ * filtered and deduplicated, then counted and discarded.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ss.h"
+
+#ifdef __APPLE__
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/sysctl.h>
+#include <arpa/inet.h>
+#endif
+
+/* Add one socket to the summary counters */
+void stats_add(ss_stats_t *stats, const ss_sock_info_t *sock)
+{
+    switch (sock->protocol) {
+        case SS_PROTO_TCP:
+            stats->tcp_total++;
+            switch (sock->state) {
+                case SS_TCP_ESTABLISHED:
+                    stats->tcp_established++;
+                    break;
+                case SS_TCP_SYN_SENT:
+                    stats->tcp_syn_sent++;
+                    break;
+                case SS_TCP_SYN_RECV:
+                    stats->tcp_syn_recv++;
+                    break;
+                case SS_TCP_FIN_WAIT1:
+                    stats->tcp_fin_wait1++;
+                    break;
+                case SS_TCP_FIN_WAIT2:
+                    stats->tcp_fin_wait2++;
+                    break;
+                case SS_TCP_TIME_WAIT:
+                    stats->tcp_time_wait++;
+                    break;
+                case SS_TCP_CLOSE_WAIT:
+                    stats->tcp_close_wait++;
+                    break;
+                case SS_TCP_LAST_ACK:
+                    stats->tcp_last_ack++;
+                    break;
+                case SS_TCP_LISTEN:
+                    stats->tcp_listen++;
+                    break;
+                case SS_TCP_CLOSING:
+                    stats->tcp_closing++;
+                    break;
+                case SS_TCP_CLOSED:
+                    stats->tcp_closed++;
+                    break;
+                default:
+                    break;
+            }
+            break;
+        case SS_PROTO_UDP:
+            stats->udp_total++;
+            break;
+        case SS_PROTO_UNIX_STREAM:
+            stats->unix_stream_total++;
+            break;
+        case SS_PROTO_UNIX_DGRAM:
+            stats->unix_dgram_total++;
+            break;
+        default:
+            break;
+    }
+}
+
+#ifdef __APPLE__
+
+/*
+ * Leading fields of the *_n records exported by the pcblist_n sysctls
+ * (xnu bsd/netinet/in_pcb.h, tcp_var.h, sys/socketvar.h; not in the
+ * public SDK). Every record starts with its length and kind.
+ */
+#define XSO_SOCKET  0x001
+#define XSO_INPCB   0x010
+#define XSO_TCPCB   0x020
+
+#define ROUNDUP64(n) (((n) + sizeof(uint64_t) - 1) & ~(sizeof(uint64_t) - 1))
+
+struct ss_xinpgen {
+    uint32_t xig_len;
+    uint32_t xig_count;
+    uint64_t xig_gen;
+    uint64_t xig_sogen;
+};
+
+struct ss_xgen_n {
+    uint32_t xgn_len;
+    uint32_t xgn_kind;
+};
+
+struct ss_xsocket_n {
+    uint32_t xso_len;
+    uint32_t xso_kind;
+    uint64_t xso_so;
+    short so_type;
+    uint32_t so_options;
+    short so_linger;
+    short so_state;
+    uint64_t so_pcb;
+    int xso_protocol;
+    int xso_family;
+};
+
+struct ss_xinpcb_n {
+    uint32_t xi_len;
+    uint32_t xi_kind;
+    uint64_t xi_inpp;
+    uint16_t inp_fport;
+    uint16_t inp_lport;
+};
+
+struct ss_xtcpcb_n {
+    uint32_t xt_len;
+    uint32_t xt_kind;
+    uint64_t t_segq;
+    int t_dupacks;
+    int t_timer[4];
+    int t_state;
+};
+
+/* Fetch a pcblist sysctl into a malloc'd buffer */
+static char *fetch_pcblist(const char *name, size_t *len)
+{
+    char *buf = NULL;
+
+    /* The list can grow between the size probe and the read: retry */
+    for (int tries = 0; tries < 4; tries++) {
+        if (sysctlbyname(name, NULL, len, NULL, 0) < 0) {
+            break;
+        }
+        *len += *len / 4 + 4096;
+        buf = malloc(*len);
+        if (!buf) {
+            break;
+        }
+        if (sysctlbyname(name, buf, len, NULL, 0) == 0) {
+            return buf;
+        }
+        free(buf);
+        buf = NULL;
+        if (errno != ENOMEM) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+/* Count one pcblist entry through the same filter the listing uses */
+static void count_entry(ss_stats_t *stats, const ss_options_t *opts,
+                        ss_sock_info_t *sock, bool *have)
+{
+    if (*have && should_include(sock, opts)) {
+        stats_add(stats, sock);
+    }
+    *have = false;
+}
+
+/*
+ * Walk one pcblist_n buffer. An inet entry is an XSO_INPCB record
+ * followed by its XSO_SOCKET (and, for TCP, XSO_TCPCB) records; a UNIX
+ * entry is counted from its XSO_SOCKET record.
+ */
+static int count_pcblist(const char *name, ss_proto_t protocol,
+                         const ss_options_t *opts, ss_stats_t *stats)
+{
+    size_t len = 0;
+    char *buf = fetch_pcblist(name, &len);
+    if (!buf) {
+        return -1;
+    }
+    if (len < sizeof(struct ss_xinpgen)) {
+        free(buf);
+        return -1;
+    }
+
+    bool is_unix = (protocol == SS_PROTO_UNIX_STREAM || protocol == SS_PROTO_UNIX_DGRAM);
+    ss_sock_info_t sock;
+    bool have = false;
+
+    const struct ss_xinpgen *head = (const struct ss_xinpgen *)buf;
+    size_t off = ROUNDUP64(head->xig_len);
+    while (off + sizeof(struct ss_xgen_n) <= len) {
+        const struct ss_xgen_n *x = (const struct ss_xgen_n *)(buf + off);
+        /* The list ends with a trailing xinpgen */
+        if (x->xgn_len <= sizeof(struct ss_xinpgen) || off + x->xgn_len > len) {
+            break;
+        }
+
+        switch (x->xgn_kind) {
+            case XSO_INPCB: {
+                const struct ss_xinpcb_n *xi = (const struct ss_xinpcb_n *)x;
+                count_entry(stats, opts, &sock, &have);
+                memset(&sock, 0, sizeof(sock));
+                sock.protocol = (uint8_t)protocol;
+                sock.state = SS_TCP_UNKNOWN;
+                sock.remote_port = ntohs(xi->inp_fport);
+                have = true;
+                break;
+            }
+            case XSO_SOCKET: {
+                const struct ss_xsocket_n *xso = (const struct ss_xsocket_n *)x;
+                if (is_unix) {
+                    memset(&sock, 0, sizeof(sock));
+                    sock.protocol = (uint8_t)protocol;
+                    sock.family = SS_FAMILY_UNIX;
+                    have = true;
+                    count_entry(stats, opts, &sock, &have);
+                } else if (have) {
+                    sock.family = (xso->xso_family == AF_INET6) ? SS_FAMILY_INET6
+                                                               : SS_FAMILY_INET;
+                }
+                break;
+            }
+            case XSO_TCPCB: {
+                const struct ss_xtcpcb_n *xt = (const struct ss_xtcpcb_n *)x;
+                if (have) {
+                    sock.state = darwin_to_ss_state(xt->t_state);
+                }
+                break;
+            }
+            default:
+                break;
+        }
+        off += ROUNDUP64(x->xgn_len);
+    }
+    count_entry(stats, opts, &sock, &have);
+
+    free(buf);
+    return 0;
+}
+
+/* Totals from the kernel pcblists: one sysctl per protocol, no records */
+int summarize_pcblist(const ss_options_t *opts, ss_stats_t *stats)
+{
+    if (opts->show_udp && count_pcblist("net.inet.udp.pcblist_n", SS_PROTO_UDP,
+                                        opts, stats) < 0) {
+        return -1;
+    }
+    if (opts->show_tcp && count_pcblist("net.inet.tcp.pcblist_n", SS_PROTO_TCP,
+                                        opts, stats) < 0) {
+        return -1;
+    }
+    if (opts->show_unix) {
+        if (count_pcblist("net.local.stream.pcblist_n", SS_PROTO_UNIX_STREAM,
+                          opts, stats) < 0 ||
+            count_pcblist("net.local.dgram.pcblist_n", SS_PROTO_UNIX_DGRAM,
+                          opts, stats) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+#endif /* __APPLE__ */
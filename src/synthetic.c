@@ -0,0 +1,513 @@
+/*
+ * ss - Socket Statistics for Apple platforms (macOS/iOS)
+ * Synthetic libproc provider for large-scale testing
+ *
+ * Implements the libproc calls used by the PID/fd walker in-process for a
+ * generated population of N processes x M sockets. Every answer is a pure
+ * function of (seed, pid, fd), so runs are deterministic and the provider
+ * can be queried concurrently.
+ *
+ * Spec (--synthetic=SPEC): comma-separated key=value pairs
+ *   procs   number of processes            socks   sockets per process
+ *   fds     extra non-socket fds/process   seed    generator seed
+ *   tcp/udp/unix  protocol weights         v6      % of inet sockets on IPv6
+ *   listen/estab  % of TCP sockets LISTEN / ESTABLISHED (rest: other states)
+ *   shared  % of sockets inherited from the previous process (dedup load)
+ *   users   number of distinct uids
+ *   churn   % of processes holding one extra socket, re-picked every epoch
+ *   gone    % of processes missing from the PID list, re-picked every epoch;
+ *           a missing process comes back as a new one
+ *   restart % of processes replaced by a new one under the same PID (and
+ *           fd table) every epoch
+ *   epoch   epoch of the first PID listing (each listing starts a new one)
+ *   skew    Zipf exponent x100 for sockets per process (0 = uniform): the
+ *           procs x socks sockets are spread so the process at index i
+ *           holds a share proportional to 1 / (i + 1)^(skew / 100)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "libproc_compat.h"
+#include "ss.h"
+
+/* First synthetic PID (PIDs are contiguous from here) */
+#define SYNTH_PID_BASE  100
+
+/* Darwin TCP states from tcp_fsm.h */
+#define TCPS_CLOSED         0
+#define TCPS_LISTEN         1
+#define TCPS_SYN_SENT       2
+#define TCPS_SYN_RECEIVED   3
+#define TCPS_ESTABLISHED    4
+#define TCPS_CLOSE_WAIT     5
+#define TCPS_FIN_WAIT_1     6
+#define TCPS_CLOSING        7
+#define TCPS_LAST_ACK       8
+#define TCPS_FIN_WAIT_2     9
+#define TCPS_TIME_WAIT      10
+
+typedef struct {
+    uint32_t procs;
+    uint32_t socks;
+    uint32_t fds;
+    uint32_t tcp;
+    uint32_t udp;
+    uint32_t unix_;
+    uint32_t v6;
+    uint32_t listen;
+    uint32_t estab;
+    uint32_t shared;
+    uint32_t users;
+    uint32_t seed;
+    uint32_t churn;
+    uint32_t gone;
+    uint32_t restart;
+    uint32_t epoch;
+    uint32_t skew;
+} synth_config_t;
+
+static synth_config_t cfg = {
+    .procs = 100, .socks = 20, .fds = 8,
+    .tcp = 60, .udp = 25, .unix_ = 15, .v6 = 30,
+    .listen = 10, .estab = 70, .shared = 0,
+    .users = 4, .seed = 1, .churn = 0, .gone = 0, .restart = 0, .epoch = 0,
+    .skew = 0
+};
+
+/* Sockets per process when skewed (cfg.procs entries), else NULL */
+static uint32_t *skewed_socks;
+
+/* Set by the first PID listing; later listings advance cfg.epoch */
+static bool listed;
+
+static const char *proc_names[] = {
+    "nginx", "postgres", "redis-server", "sshd", "node", "envoy",
+    "mDNSResponder", "launchd", "java", "python3", "haproxy", "syslogd"
+};
+
+#define NUM_PROC_NAMES (sizeof(proc_names) / sizeof(proc_names[0]))
+
+/* Non-TCP_LISTEN/ESTABLISHED states, picked uniformly */
+static const int other_states[] = {
+    TCPS_TIME_WAIT, TCPS_CLOSE_WAIT, TCPS_FIN_WAIT_1, TCPS_FIN_WAIT_2,
+    TCPS_SYN_SENT, TCPS_SYN_RECEIVED, TCPS_LAST_ACK, TCPS_CLOSING
+};
+
+/* splitmix64 finalizer */
+static uint64_t mix64(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+static uint64_t synth_hash(uint32_t a, uint32_t b)
+{
+    return mix64(((uint64_t)cfg.seed << 48) ^ ((uint64_t)a << 24) ^ b);
+}
+
+/* Map a PID to its process index, or -1 if it is not synthetic */
+static int proc_index(int pid)
+{
+    if (pid < SYNTH_PID_BASE || (uint32_t)(pid - SYNTH_PID_BASE) >= cfg.procs) {
+        return -1;
+    }
+    return pid - SYNTH_PID_BASE;
+}
+
+static const char *synth_proc_name(uint32_t idx)
+{
+    return proc_names[synth_hash(idx, 0xffffffu) % NUM_PROC_NAMES];
+}
+
+static bool synth_gone(uint32_t idx, uint32_t epoch)
+{
+    return cfg.gone && synth_hash(idx, 0x900000u | (epoch & 0xfffffu)) % 100 < cfg.gone;
+}
+
+static bool synth_restarted(uint32_t idx, uint32_t epoch)
+{
+    return cfg.restart && synth_hash(idx, 0xa00000u | (epoch & 0xfffffu)) % 100 < cfg.restart;
+}
+
+/* Epoch in which the process at idx was last replaced (last 64 epochs), else 0 */
+static uint32_t synth_generation(uint32_t idx)
+{
+    for (uint32_t e = cfg.epoch; e > 0 && cfg.epoch - e < 64; e--) {
+        if (synth_gone(idx, e - 1) || synth_restarted(idx, e)) {
+            return e;
+        }
+    }
+    return 0;
+}
+
+/* Executable name; a restarted process may run something else */
+static const char *synth_exec_name(uint32_t idx)
+{
+    return proc_names[synth_hash(idx, 0xffffffu - synth_generation(idx)) % NUM_PROC_NAMES];
+}
+
+static uid_t synth_uid(uint32_t idx)
+{
+    return 501 + idx % (cfg.users ? cfg.users : 1);
+}
+
+static uint32_t synth_pgid(uint32_t idx)
+{
+    return SYNTH_PID_BASE + (idx / 8) * 8;
+}
+
+/* Sockets held by a process in the current epoch */
+static uint32_t synth_nsocks(uint32_t idx)
+{
+    uint32_t base = skewed_socks ? skewed_socks[idx] : cfg.socks;
+    if (cfg.churn == 0) {
+        return base;
+    }
+    return base + (synth_hash(idx, 0x800000u | (cfg.epoch & 0x7fffffu)) % 100 < cfg.churn);
+}
+
+/*
+ * Spread procs x socks sockets over the processes by a Zipf law. Shares
+ * are rounded on the running total, so the sum is exact.
+ */
+static bool build_skew(void)
+{
+    free(skewed_socks);
+    skewed_socks = NULL;
+    if (cfg.skew == 0 || cfg.procs == 0) {
+        return true;
+    }
+    skewed_socks = malloc((size_t)cfg.procs * sizeof(uint32_t));
+    if (!skewed_socks) {
+        perror("malloc");
+        return false;
+    }
+
+    double exponent = cfg.skew / 100.0;
+    double norm = 0;
+    for (uint32_t i = 0; i < cfg.procs; i++) {
+        norm += pow(i + 1.0, -exponent);
+    }
+    double total = (double)cfg.procs * cfg.socks;
+    double cum = 0;
+    uint64_t given = 0;
+    for (uint32_t i = 0; i < cfg.procs; i++) {
+        cum += pow(i + 1.0, -exponent);
+        uint64_t upto = (uint64_t)(total * cum / norm + 0.5);
+        skewed_socks[i] = (uint32_t)(upto - given);
+        given = upto;
+    }
+    return true;
+}
+
+static uint32_t synth_nfds(uint32_t idx)
+{
+    return 3 + synth_nsocks(idx) + cfg.fds;
+}
+
+static bool parse_u32(const char *val, uint32_t *out)
+{
+    char *end;
+    unsigned long v = strtoul(val, &end, 10);
+    if (end == val || *end != '\0' || v > UINT32_MAX) {
+        return false;
+    }
+    *out = (uint32_t)v;
+    return true;
+}
+
+/* Parse a --synthetic spec into the provider configuration */
+bool synthetic_configure(const char *spec)
+{
+    static const struct {
+        const char *key;
+        uint32_t *val;
+    } keys[] = {
+        { "procs", &cfg.procs },   { "socks", &cfg.socks },
+        { "fds", &cfg.fds },       { "tcp", &cfg.tcp },
+        { "udp", &cfg.udp },       { "unix", &cfg.unix_ },
+        { "v6", &cfg.v6 },         { "listen", &cfg.listen },
+        { "estab", &cfg.estab },   { "shared", &cfg.shared },
+        { "users", &cfg.users },   { "seed", &cfg.seed },
+        { "churn", &cfg.churn },   { "gone", &cfg.gone },
+        { "restart", &cfg.restart }, { "epoch", &cfg.epoch },
+        { "skew", &cfg.skew },
+    };
+
+    char *copy = strdup(spec ? spec : "");
+    if (!copy) {
+        return false;
+    }
+
+    bool ok = true;
+    for (char *tok = strtok(copy, ","); tok && ok; tok = strtok(NULL, ",")) {
+        char *eq = strchr(tok, '=');
+        if (!eq) {
+            fprintf(stderr, "synthetic: expected key=value, got '%s'\n", tok);
+            ok = false;
+            break;
+        }
+        *eq = '\0';
+
+        size_t k;
+        for (k = 0; k < sizeof(keys) / sizeof(keys[0]); k++) {
+            if (strcmp(tok, keys[k].key) == 0) break;
+        }
+        if (k == sizeof(keys) / sizeof(keys[0])) {
+            fprintf(stderr, "synthetic: unknown key '%s'\n", tok);
+            ok = false;
+        } else if (!parse_u32(eq + 1, keys[k].val)) {
+            fprintf(stderr, "synthetic: bad value for '%s'\n", tok);
+            ok = false;
+        }
+    }
+    free(copy);
+
+    if (ok && cfg.tcp + cfg.udp + cfg.unix_ == 0) {
+        fprintf(stderr, "synthetic: protocol weights are all zero\n");
+        ok = false;
+    }
+    if (ok && (uint64_t)cfg.procs + SYNTH_PID_BASE > INT32_MAX) {
+        fprintf(stderr, "synthetic: too many processes\n");
+        ok = false;
+    }
+    return ok && build_skew();
+}
+
+static int synth_listpids(uint32_t type, uint32_t typeinfo, void *buffer, int buffersize)
+{
+    if (buffer == NULL) {
+        return (int)(cfg.procs * sizeof(pid_t));
+    }
+    if (listed) {
+        cfg.epoch++;
+    }
+    listed = true;
+
+    pid_t *pids = buffer;
+    int max = buffersize / (int)sizeof(pid_t);
+    int n = 0;
+    for (uint32_t i = 0; i < cfg.procs && n < max; i++) {
+        if ((type == PROC_UID_ONLY || type == PROC_RUID_ONLY) && synth_uid(i) != typeinfo) {
+            continue;
+        }
+        if (type == PROC_PGRP_ONLY && synth_pgid(i) != typeinfo) {
+            continue;
+        }
+        if (synth_gone(i, cfg.epoch)) {
+            continue;
+        }
+        pids[n++] = (pid_t)(SYNTH_PID_BASE + i);
+    }
+    return n * (int)sizeof(pid_t);
+}
+
+static int synth_pidinfo(int pid, int flavor, uint64_t arg, void *buffer, int buffersize)
+{
+    int idx = proc_index(pid);
+    (void)arg;
+
+    if (idx < 0) {
+        return 0;
+    }
+
+    if (flavor == PROC_PIDLISTFDS) {
+        uint32_t nfds = synth_nfds((uint32_t)idx);
+        uint32_t nsocks = synth_nsocks((uint32_t)idx);
+        if (buffer == NULL) {
+            return (int)(nfds * sizeof(struct proc_fdinfo));
+        }
+        struct proc_fdinfo *fdinfo = buffer;
+        uint32_t max = (uint32_t)buffersize / sizeof(struct proc_fdinfo);
+        uint32_t n = nfds < max ? nfds : max;
+        for (uint32_t fd = 0; fd < n; fd++) {
+            fdinfo[fd].proc_fd = (int32_t)fd;
+            fdinfo[fd].proc_fdtype = (fd >= 3 && fd < 3 + nsocks)
+                                     ? PROX_FDTYPE_SOCKET : PROX_FDTYPE_VNODE;
+        }
+        return (int)(n * sizeof(struct proc_fdinfo));
+    }
+
+    if (flavor == PROC_PIDTBSDINFO) {
+        if (buffer == NULL || buffersize < (int)sizeof(struct proc_bsdinfo)) {
+            return 0;
+        }
+        struct proc_bsdinfo *bi = buffer;
+        memset(bi, 0, sizeof(*bi));
+        bi->pbi_pid = (uint32_t)pid;
+        bi->pbi_ppid = 1;
+        bi->pbi_uid = synth_uid((uint32_t)idx);
+        bi->pbi_ruid = bi->pbi_uid;
+        bi->pbi_gid = 20;
+        bi->pbi_rgid = 20;
+        bi->pbi_nfiles = synth_nfds((uint32_t)idx);
+        bi->pbi_pgid = synth_pgid((uint32_t)idx);
+        bi->pbi_start_tvsec = 1700000000u + (uint64_t)idx;
+        bi->pbi_start_tvusec = synth_generation((uint32_t)idx);
+        strncpy(bi->pbi_comm, synth_exec_name((uint32_t)idx), sizeof(bi->pbi_comm) - 1);
+        strncpy(bi->pbi_name, synth_exec_name((uint32_t)idx), sizeof(bi->pbi_name) - 1);
+        return (int)sizeof(*bi);
+    }
+
+    return 0;
+}
+
+/* Fill an inet address: per-process local address, hashed remote address */
+static void synth_inet_addr(struct in_addr *a4, struct in6_addr *a6, bool v6,
+                            uint32_t host, uint8_t net)
+{
+    if (v6) {
+        uint8_t *b = a6->s6_addr;
+        b[0] = 0xfd;
+        b[1] = net;
+        b[12] = (uint8_t)(host >> 24);
+        b[13] = (uint8_t)(host >> 16);
+        b[14] = (uint8_t)(host >> 8);
+        b[15] = (uint8_t)host;
+    } else {
+        a4->s_addr = htonl(((uint32_t)net << 24) | (host & 0xffffff));
+    }
+}
+
+static void synth_socket(uint32_t idx, uint32_t k, struct socket_fdinfo *si)
+{
+    uint64_t h = synth_hash(idx, k);
+
+    /* Inherited socket: same kernel socket as the previous process */
+    if (idx > 0 && cfg.shared > 0 && (h >> 56) % 100 < cfg.shared) {
+        idx--;
+        h = synth_hash(idx, k);
+    }
+
+    uint32_t weight = (uint32_t)(h % (cfg.tcp + cfg.udp + cfg.unix_));
+    struct socket_info *psi = &si->psi;
+
+    psi->soi_rcv.sbi_hiwat = 131072;
+    psi->soi_snd.sbi_hiwat = 131072;
+    psi->soi_rcv.sbi_lowat = 1;
+    psi->soi_snd.sbi_lowat = 2048;
+    if ((h >> 40) % 100 < 5) {
+        psi->soi_rcv.sbi_cc = (uint32_t)((h >> 20) % 65536);
+    }
+    if ((h >> 44) % 100 < 5) {
+        psi->soi_snd.sbi_cc = (uint32_t)((h >> 28) % 131072);
+    }
+
+    if (weight >= cfg.tcp + cfg.udp) {
+        struct un_sockinfo *un = &psi->soi_proto.pri_un;
+        psi->soi_family = AF_UNIX;
+        psi->soi_type = ((h >> 8) % 100 < 70) ? SOCK_STREAM : SOCK_DGRAM;
+        psi->soi_kind = SOCKINFO_UN;
+        if ((h >> 16) % 100 < 40) {
+            snprintf(un->unsi_addr.ua_sun.sun_path, sizeof(un->unsi_addr.ua_sun.sun_path),
+                     "/var/run/synth/%s.%u.%u.sock", synth_proc_name(idx),
+                     SYNTH_PID_BASE + idx, k);
+        }
+        if ((h >> 24) % 100 < 50) {
+            un->unsi_conn_so = h | 1;
+        }
+        return;
+    }
+
+    bool tcp = weight < cfg.tcp;
+    bool v6 = (h >> 8) % 100 < cfg.v6;
+    struct in_sockinfo *in = &psi->soi_proto.pri_in;
+    int state = TCPS_CLOSED;
+
+    psi->soi_family = v6 ? AF_INET6 : AF_INET;
+    psi->soi_type = tcp ? SOCK_STREAM : SOCK_DGRAM;
+    psi->soi_protocol = tcp ? IPPROTO_TCP : IPPROTO_UDP;
+    psi->soi_kind = tcp ? SOCKINFO_TCP : SOCKINFO_IN;
+
+    if (tcp) {
+        uint32_t pick = (uint32_t)((h >> 16) % 100);
+        if (pick < cfg.listen) {
+            state = TCPS_LISTEN;
+        } else if (pick < cfg.listen + cfg.estab) {
+            state = TCPS_ESTABLISHED;
+        } else {
+            state = other_states[(h >> 24) % (sizeof(other_states) / sizeof(other_states[0]))];
+        }
+    }
+
+    /*
+     * Local endpoint is unique per (process, socket index); a process with
+     * more than 64000 sockets moves on to further local addresses
+     */
+    synth_inet_addr(&in->insi_laddr.ina_46.i46a_addr4, &INSI_ADDR6(in->insi_laddr),
+                    v6, idx + (k / 64000) * 0x100000u, 10);
+    in->insi_lport = htons((uint16_t)(1024 + k % 64000));
+
+    /* Listening and unconnected UDP sockets have no peer */
+    bool connected = tcp ? (state != TCPS_LISTEN) : ((h >> 32) % 100 < 20);
+    if (connected) {
+        static const uint16_t peer_ports[] = { 443, 80, 5432, 6379, 53, 8080 };
+        synth_inet_addr(&in->insi_faddr.ina_46.i46a_addr4, &INSI_ADDR6(in->insi_faddr),
+                        v6, (uint32_t)(h >> 32), 172);
+        in->insi_fport = htons(peer_ports[(h >> 48) % 6]);
+    }
+    in->insi_vflag = v6 ? 2 : 1;
+
+    if (tcp) {
+        struct tcp_sockinfo *t = &psi->soi_proto.pri_tcp;
+        t->tcpsi_state = state;
+        t->tcpsi_mss = v6 ? 1440 : 1460;
+        t->tcpsi_timer[0] = (state == TCPS_ESTABLISHED && (h >> 52) % 100 < 3) ? 400 : 0;
+        t->tcpsi_timer[2] = (state == TCPS_ESTABLISHED) ? 7200000 : 0;
+        t->tcpsi_timer[3] = (state == TCPS_TIME_WAIT) ? 30000 : 0;
+    }
+}
+
+static int synth_pidfdinfo(int pid, int fd, int flavor, void *buffer, int buffersize)
+{
+    int idx = proc_index(pid);
+
+    if (idx < 0 || flavor != PROC_PIDFDSOCKETINFO ||
+        buffersize < (int)sizeof(struct socket_fdinfo)) {
+        return 0;
+    }
+    if (fd < 3 || (uint32_t)fd >= 3 + synth_nsocks((uint32_t)idx)) {
+        return 0;
+    }
+
+    struct socket_fdinfo *si = buffer;
+    memset(si, 0, sizeof(*si));
+    synth_socket((uint32_t)idx, (uint32_t)(fd - 3), si);
+    return (int)sizeof(*si);
+}
+
+static int synth_pidpath(int pid, void *buffer, uint32_t buffersize)
+{
+    int idx = proc_index(pid);
+    if (idx < 0) {
+        return 0;
+    }
+    int n = snprintf(buffer, buffersize, "/usr/sbin/%s", synth_exec_name((uint32_t)idx));
+    return (n > 0 && (uint32_t)n < buffersize) ? n : 0;
+}
+
+static int synth_name(int pid, void *buffer, uint32_t buffersize)
+{
+    int idx = proc_index(pid);
+    if (idx < 0) {
+        return 0;
+    }
+    int n = snprintf(buffer, buffersize, "%s", synth_exec_name((uint32_t)idx));
+    return (n > 0 && (uint32_t)n < buffersize) ? n : 0;
+}
+
+const ss_libproc_ops_t synthetic_libproc = {
+    "synthetic",
+    synth_listpids,
+    synth_pidinfo,
+    synth_pidfdinfo,
+    synth_pidpath,
+    synth_name
+};
@@ -0,0 +1,472 @@
+/*
+ * ss - Socket Statistics for Apple platforms (macOS/iOS)
+ * Watch mode (--interval): redisplay sockets every N seconds
+ *
+ * For PID/fd-walk collectors the per-process results are kept between
+ * ticks. Each tick lists PIDs and fetches every fd table (PROC_PIDLISTFDS),
+ * but proc_pidfdinfo() is only called again for processes whose fd table
+ * differs from the previous tick; other processes reuse their cached
+ * records. Processes that exited are dropped. All buffers are reused
+ * between ticks.
+ *
+ * With -p a process is also re-queried when its start time changed (the
+ * PID was reused), checked through the process metadata cache.
+ *
+ * Because unchanged processes are not re-queried, queue sizes and TCP
+ * states of their sockets are as of the last change to their fd table.
+ * With -i or -o every process is re-queried each tick: stale timers and
+ * buffer fill would be misleading.
+ *
+ * Other collectors (netlink) are simply re-run each tick into a reused
+ * table.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include "libproc_compat.h"
+#include "ss.h"
+
+/* Cached state of one process */
+typedef struct {
+    pid_t pid;
+    bool seen;                  /* Listed in the current tick */
+    uint64_t start_sec;         /* Start time as of the last scan (-p only) */
+    uint64_t start_usec;
+    struct proc_fdinfo *fds;    /* fd table as of the last scan */
+    int num_fds;
+    int fds_cap;
+    ss_sock_table_t socks;      /* Its sockets, filtered but not deduplicated */
+} proc_entry_t;
+
+/* A socket to print and the table holding its strings */
+typedef struct {
+    const ss_sock_table_t *src;
+    const ss_sock_info_t *sock;
+} watch_ref_t;
+
+typedef struct {
+    const ss_libproc_ops_t *ops;
+    const ss_options_t *opts;
+
+    /* Process cache: dense array plus a pid -> entry index hash */
+    proc_entry_t *procs;
+    size_t num_procs, procs_cap;
+    int32_t *index;             /* -1 = empty */
+    size_t index_mask;
+
+    /* Per-tick buffers, reused */
+    pid_t *pids;
+    int pids_cap;
+    int32_t *order;             /* Entry of each listed PID, in list order */
+    int order_cap;
+    struct proc_fdinfo *scratch;
+    int scratch_cap;
+    watch_ref_t *refs;
+    size_t refs_cap;
+    watch_ref_t *grouped;
+    size_t num_grouped;
+    ss_sockset_t seen;
+    int prev_pids;
+
+    /* Last tick: processes re-queried; any change to the output list */
+    size_t rescanned;
+    bool changed;
+} watch_state_t;
+
+static size_t hash_pid(pid_t pid)
+{
+    return (size_t)((uint32_t)pid * 2654435761u);
+}
+
+static void index_insert(watch_state_t *w, int32_t e)
+{
+    size_t i = hash_pid(w->procs[e].pid) & w->index_mask;
+    while (w->index[i] >= 0) {
+        i = (i + 1) & w->index_mask;
+    }
+    w->index[i] = e;
+}
+
+/* Rebuild the pid -> entry hash for the current procs array */
+static bool rebuild_index(watch_state_t *w)
+{
+    size_t size = 1024;
+    while (size < w->num_procs * 2) {
+        size *= 2;
+    }
+    if (size != w->index_mask + 1 || !w->index) {
+        int32_t *index = realloc(w->index, size * sizeof(int32_t));
+        if (!index) {
+            return false;
+        }
+        w->index = index;
+        w->index_mask = size - 1;
+    }
+    memset(w->index, 0xff, size * sizeof(int32_t));
+
+    for (size_t e = 0; e < w->num_procs; e++) {
+        index_insert(w, (int32_t)e);
+    }
+    return true;
+}
+
+static int32_t find_proc(const watch_state_t *w, pid_t pid)
+{
+    size_t i = hash_pid(pid) & w->index_mask;
+    while (w->index[i] >= 0) {
+        if (w->procs[w->index[i]].pid == pid) {
+            return w->index[i];
+        }
+        i = (i + 1) & w->index_mask;
+    }
+    return -1;
+}
+
+/* New cache entry for pid, added to the index */
+static int32_t add_proc(watch_state_t *w, pid_t pid)
+{
+    if (w->num_procs == w->procs_cap) {
+        size_t new_cap = w->procs_cap ? w->procs_cap * 2 : 256;
+        proc_entry_t *procs = realloc(w->procs, new_cap * sizeof(proc_entry_t));
+        if (!procs) {
+            return -1;
+        }
+        w->procs = procs;
+        w->procs_cap = new_cap;
+    }
+    proc_entry_t *p = &w->procs[w->num_procs];
+    memset(p, 0, sizeof(*p));
+    p->pid = pid;
+    p->num_fds = -1;    /* Never scanned */
+    int32_t e = (int32_t)w->num_procs++;
+
+    /* Keep the index at most half full */
+    if (w->num_procs * 2 > w->index_mask + 1) {
+        if (!rebuild_index(w)) {
+            w->num_procs--;
+            return -1;
+        }
+    } else {
+        index_insert(w, e);
+    }
+    return e;
+}
+
+/* Fetch the fd table of a process into the scratch buffer */
+static int fetch_fds(watch_state_t *w, pid_t pid)
+{
+    for (;;) {
+        int bytes = w->ops->pidinfo(pid, PROC_PIDLISTFDS, 0, w->scratch,
+                                    w->scratch_cap * (int)sizeof(struct proc_fdinfo));
+        int n = bytes > 0 ? bytes / (int)sizeof(struct proc_fdinfo) : 0;
+        if (n < w->scratch_cap) {
+            return n;
+        }
+
+        /* Buffer full: the table may be larger, grow and retry */
+        int need = w->ops->pidinfo(pid, PROC_PIDLISTFDS, 0, NULL, 0);
+        int new_cap = w->scratch_cap ? w->scratch_cap * 2 : 256;
+        while (new_cap < need / (int)sizeof(struct proc_fdinfo) + 16) {
+            new_cap *= 2;
+        }
+        struct proc_fdinfo *scratch = realloc(w->scratch, (size_t)new_cap * sizeof(*scratch));
+        if (!scratch) {
+            return n;
+        }
+        w->scratch = scratch;
+        w->scratch_cap = new_cap;
+    }
+}
+
+/* Refresh one process; its sockets are only re-queried if its fd table changed */
+static void refresh_proc(watch_state_t *w, proc_entry_t *p, uint32_t pid_idx)
+{
+    int n = fetch_fds(w, p->pid);
+    bool same_proc = true;
+
+    if (w->opts->show_process) {
+        ss_proc_meta_t meta;
+        proc_cache_get(w->ops, p->pid, &meta);
+        same_proc = (meta.start_sec == p->start_sec && meta.start_usec == p->start_usec);
+        p->start_sec = meta.start_sec;
+        p->start_usec = meta.start_usec;
+    }
+
+    bool live = w->opts->tcp_info || w->opts->timers;
+    if (same_proc && !live && n == p->num_fds &&
+        memcmp(w->scratch, p->fds, (size_t)n * sizeof(struct proc_fdinfo)) == 0) {
+        return;
+    }
+
+    if (n > p->fds_cap) {
+        struct proc_fdinfo *fds = realloc(p->fds, (size_t)n * sizeof(*fds));
+        if (!fds) {
+            return;
+        }
+        p->fds = fds;
+        p->fds_cap = n;
+    }
+    if (n > 0) {
+        memcpy(p->fds, w->scratch, (size_t)n * sizeof(struct proc_fdinfo));
+    }
+    p->num_fds = n;
+
+    /* Size a new table to the process instead of the default minimum */
+    if (p->socks.cap == 0) {
+        size_t nsock = 0;
+        for (int i = 0; i < n; i++) {
+            nsock += (p->fds[i].proc_fdtype == PROX_FDTYPE_SOCKET);
+        }
+        p->socks.recs = malloc((nsock + 1) * sizeof(ss_sock_info_t));
+        p->socks.cap = p->socks.recs ? nsock + 1 : 0;
+    }
+
+    sock_table_reset(&p->socks);
+    collect_fd_range(w->ops, p->pid, pid_idx, p->fds, 0, n, &p->socks, w->opts, NULL);
+    sock_table_trim(&p->socks);
+    w->rescanned++;
+    w->changed = true;
+}
+
+static void free_proc(proc_entry_t *p)
+{
+    free(p->fds);
+    sock_table_free(&p->socks);
+}
+
+/* Bring the process cache up to date with the current PID list */
+static int refresh_procs(watch_state_t *w)
+{
+    int num_pids = list_target_pids(w->ops, w->opts, &w->pids, &w->pids_cap);
+    if (num_pids < 0) {
+        return -1;
+    }
+    if (w->pids_cap > w->order_cap) {
+        int32_t *order = realloc(w->order, (size_t)w->pids_cap * sizeof(int32_t));
+        if (!order) {
+            perror("realloc");
+            return -1;
+        }
+        for (int i = w->order_cap; i < w->pids_cap; i++) {
+            order[i] = -1;
+        }
+        w->order = order;
+        w->order_cap = w->pids_cap;
+    }
+
+    for (size_t e = 0; e < w->num_procs; e++) {
+        w->procs[e].seen = false;
+    }
+
+    w->rescanned = 0;
+    w->changed = (num_pids != w->prev_pids);
+    w->prev_pids = num_pids;
+    selfstats_phase_begin(SS_PHASE_SCAN);
+    for (int i = 0; i < num_pids; i++) {
+        if (w->pids[i] == 0) {
+            w->order[i] = -1;
+            continue;
+        }
+
+        int32_t e = find_proc(w, w->pids[i]);
+        if (e < 0) {
+            e = add_proc(w, w->pids[i]);
+            if (e < 0) {
+                w->order[i] = -1;
+                continue;
+            }
+        }
+        w->procs[e].seen = true;
+        if (w->order[i] != e) {
+            w->order[i] = e;
+            w->changed = true;
+        }
+        refresh_proc(w, &w->procs[e], (uint32_t)i);
+    }
+    selfstats_phase_end(SS_PHASE_SCAN);
+
+    /* Drop processes that exited, then renumber */
+    size_t kept = 0;
+    for (size_t e = 0; e < w->num_procs; e++) {
+        if (!w->procs[e].seen) {
+            free_proc(&w->procs[e]);
+            continue;
+        }
+        w->procs[kept++] = w->procs[e];
+    }
+    if (kept != w->num_procs) {
+        w->num_procs = kept;
+        w->changed = true;
+        if (!rebuild_index(w)) {
+            return -1;
+        }
+        for (int i = 0; i < num_pids; i++) {
+            if (w->order[i] >= 0) {
+                w->order[i] = find_proc(w, w->pids[i]);
+            }
+        }
+    }
+    return num_pids;
+}
+
+/*
+ * Rebuild the output list in the order a cold run would print it: PID
+ * order with the first occurrence of a shared socket kept, grouped UDP,
+ * TCP, UNIX with the newest record first in each group.
+ */
+static int build_output(watch_state_t *w, int num_pids)
+{
+    size_t total = 0;
+    for (size_t e = 0; e < w->num_procs; e++) {
+        total += w->procs[e].socks.count;
+    }
+    if (total > w->refs_cap) {
+        watch_ref_t *refs = realloc(w->refs, total * sizeof(watch_ref_t));
+        watch_ref_t *grouped = realloc(w->grouped, total * sizeof(watch_ref_t));
+        if (refs) w->refs = refs;
+        if (grouped) w->grouped = grouped;
+        if (!refs || !grouped) {
+            perror("realloc");
+            return -1;
+        }
+        w->refs_cap = total;
+    }
+
+    size_t n = 0;
+    size_t group_start[SS_GROUP_COUNT + 1] = {0};
+    sockset_clear(&w->seen);
+    for (int i = 0; i < num_pids; i++) {
+        if (w->order[i] < 0) continue;
+        const ss_sock_table_t *t = &w->procs[w->order[i]].socks;
+        for (size_t j = 0; j < t->count; j++) {
+            if (!sockset_insert(&w->seen, t, &t->recs[j])) continue;
+            w->refs[n].src = t;
+            w->refs[n].sock = &t->recs[j];
+            group_start[sock_group(&t->recs[j]) + 1]++;
+            n++;
+        }
+    }
+
+    size_t cursor[SS_GROUP_COUNT];
+    for (int g = 0; g < SS_GROUP_COUNT; g++) {
+        group_start[g + 1] += group_start[g];
+        cursor[g] = group_start[g];
+    }
+    for (size_t i = n; i-- > 0; ) {
+        w->grouped[cursor[sock_group(w->refs[i].sock)]++] = w->refs[i];
+    }
+    w->num_grouped = n;
+    return 0;
+}
+
+/* Print the current output list; it is only rebuilt if something changed */
+static int print_cached(watch_state_t *w, int num_pids)
+{
+    if (w->changed) {
+        selfstats_phase_begin(SS_PHASE_MERGE);
+        int ret = build_output(w, num_pids);
+        selfstats_phase_end(SS_PHASE_MERGE);
+        if (ret < 0) {
+            return -1;
+        }
+    }
+
+    selfstats_phase_begin(SS_PHASE_OUTPUT);
+    print_begin(w->opts);
+    for (size_t i = 0; i < w->num_grouped; i++) {
+        print_row(w->grouped[i].src, w->grouped[i].sock, w->opts);
+    }
+    print_end(w->opts);
+    selfstats_phase_end(SS_PHASE_OUTPUT);
+    return 0;
+}
+
+static void sleep_interval(double secs)
+{
+    if (secs <= 0) {
+        return;
+    }
+    struct timespec ts;
+    ts.tv_sec = (time_t)secs;
+    ts.tv_nsec = (long)((secs - (double)ts.tv_sec) * 1e9);
+    while (nanosleep(&ts, &ts) < 0 && errno == EINTR) {
+        continue;
+    }
+}
+
+/* One full collection into a reused table (collectors without a PID walk) */
+static int tick_full(const ss_options_t *opts, ss_sock_table_t *table)
+{
+    sock_table_reset(table);
+    int ret = collect_all_sockets(opts, table);
+
+    selfstats_phase_begin(SS_PHASE_OUTPUT);
+    print_begin(opts);
+    size_t end = table->group_start[SS_GROUP_COUNT];
+    for (size_t i = table->group_start[0]; i < end; i++) {
+        print_row(table, &table->recs[i], opts);
+    }
+    print_end(opts);
+    selfstats_phase_end(SS_PHASE_OUTPUT);
+    return ret;
+}
+
+/* Display sockets every opts->interval seconds, opts->count times (0 = forever) */
+int watch_sockets(const ss_options_t *opts)
+{
+    const ss_collector_t *collector = find_collector(opts->collector);
+    if (!collector) {
+        return -1;
+    }
+
+    watch_state_t w = { .ops = selfstats_wrap_ops(collector->libproc), .opts = opts };
+    ss_sock_table_t table = {0};
+    int ret = 0;
+
+    if (w.ops && (!sockset_init(&w.seen, 0) || !rebuild_index(&w))) {
+        perror("malloc");
+        sockset_free(&w.seen);
+        return -1;
+    }
+
+    for (long tick = 0; opts->count == 0 || tick < opts->count; tick++) {
+        if (tick > 0) {
+            sleep_interval(opts->interval);
+            if (opts->format == SS_FORMAT_TABLE) {
+                out_char('\n');
+            }
+        }
+
+        if (opts->summary) {
+            ss_stats_t stats = {0};
+            ret = collect_summary(opts, &stats);
+            print_totals(&stats, opts);
+        } else if (w.ops) {
+            int num_pids = refresh_procs(&w);
+            ret = (num_pids < 0) ? -1 : print_cached(&w, num_pids);
+            selfstats_watch(w.num_procs, w.rescanned);
+        } else {
+            ret = tick_full(opts, &table);
+        }
+        if (ret < 0) {
+            break;
+        }
+    }
+
+    for (size_t e = 0; e < w.num_procs; e++) {
+        free_proc(&w.procs[e]);
+    }
+    free(w.procs);
+    free(w.index);
+    free(w.pids);
+    free(w.order);
+    free(w.scratch);
+    free(w.refs);
+    free(w.grouped);
+    sockset_free(&w.seen);
+    sock_table_free(&table);
+    return ret;
+}
@@ -152,25 +152,22 @@ if $SHOW_PROCESS; then
     if [[ -x /usr/local/bin/ss_proc ]]; then
         /usr/local/bin/ss_proc > "$PROC_FILE" 2>/dev/null
     else
-        # Fallback: Use awk to parse lsof output in one pass
-        lsof -i -P -n 2>/dev/null | awk 'NR>1 {
-            cmd=$1; pid=$2; fd=$4
-            name=$9
+        # Fallback: Use awk to parse lsof output in one pass, into the
+        # ss_proc format: proto local peer pid fd cmd
+        lsof -i -P -n 2>/dev/null | awk 'NR>1 && ($8 == "TCP" || $8 == "UDP") {
+            cmd=$1; pid=$2; fd=$4; v6=($5 == "IPv6")
             gsub(/[^0-9]/, "", fd)
-            if (index(name, "->") > 0) {
-                split(name, parts, "->")
-                n = split(parts[1], addr, ":")
-                port = addr[n]
-            } else {
-                n = split(name, addr, ":")
-                port = addr[n]
-                gsub(/[^0-9]/, "", port)
-            }
-            if (port ~ /^[0-9]+$/) {
-                priority = (cmd == "launchd") ? 1 : 0
-                print priority, port, cmd, pid, fd
-            }
-        }' | sort -k1,1n -k2,2n | awk '!seen[$2]++ {print $2, $3, $4, $5}' > "$PROC_FILE"
+            n = split($9, ends, "->")
+            local = norm(ends[1], v6)
+            peer = (n > 1) ? norm(ends[2], v6) : (v6 ? "[::]:*" : "0.0.0.0:*")
+            priority = (cmd == "launchd") ? 1 : 0
+            print priority, tolower($8), local, peer, pid, fd, cmd
+        }
+        function norm(ep, v6) {
+            sub(/%[^]:]*/, "", ep)
+            if (ep ~ /^\*:/) return (v6 ? "[::]" : "0.0.0.0") substr(ep, 2)
+            return ep
+        }' | sort -k1,1n | awk '!seen[$2 " " $3 " " $4]++ {print $2, $3, $4, $5, $6, $7}' > "$PROC_FILE"
     fi
 fi
 
@@ -204,24 +201,30 @@ fi
        -v show_tcp="$SHOW_TCP" \
        -v show_udp="$SHOW_UDP" '
 BEGIN {
-    # Load process info into array if file exists
+    # Load process info, keyed on the full (proto, local, peer) tuple
     if (show_process == "true" && proc_file != "") {
         while ((getline line < proc_file) > 0) {
-            split(line, parts, " ")
-            port = parts[1]
-            cmd = parts[2]
-            pid = parts[3]
-            fd = parts[4]
-            if (!(port in proc_cmd)) {
-                proc_cmd[port] = cmd
-                proc_pid[port] = pid
-                proc_fd[port] = fd
-            }
+            n = split(line, f, " ")
+            if (n < 6) continue
+            cmd = f[6]
+            for (i = 7; i <= n; i++) cmd = cmd " " f[i]
+            info = "users:((\"" cmd "\",pid=" f[4] ",fd=" f[5] "))"
+            key = f[1] " " f[2] " " f[3]
+            if (!(key in proc_by_tuple)) proc_by_tuple[key] = info
+            
+            # Port-pair fallback for addresses netstat truncates; dropped if ambiguous
+            pkey = f[1] " " port_of(f[2]) " " port_of(f[3])
+            if (pkey in proc_by_ports && proc_by_ports[pkey] != info) proc_by_ports[pkey] = ""
+            else proc_by_ports[pkey] = info
         }
         close(proc_file)
     }
 }
 
+function port_of(endpoint) {
+    return substr(endpoint, match(endpoint, /:[^:]*$/) + 1)
+}
+
 function convert_addr(addr, proto) {
     is_ipv6 = (proto ~ /6$/)
     
@@ -243,6 +246,9 @@ function convert_addr(addr, proto) {
         return is_ipv6 ? "[::]:" port : "0.0.0.0:" port
     }
     
+    # Drop the zone of link-local addresses (fe80::1%lo0)
+    sub(/%.*/, "", ip)
+    
     # Check if IPv6 by looking for colons
     if (index(ip, ":") > 0) {
         return "[" ip "]:" port
@@ -290,10 +296,11 @@ function get_port(addr) {
     return parts[n]
 }
 
-function get_process(port) {
-    if (port in proc_cmd) {
-        return "users:((\"" proc_cmd[port] "\",pid=" proc_pid[port] ",fd=" proc_fd[port] "))"
-    }
+function get_process(netid, local_addr, foreign_addr) {
+    key = netid " " local_addr " " foreign_addr
+    if (key in proc_by_tuple) return proc_by_tuple[key]
+    pkey = netid " " port_of(local_addr) " " port_of(foreign_addr)
+    if (pkey in proc_by_ports) return proc_by_ports[pkey]
     return ""
 }
 
@@ -325,7 +332,6 @@ function get_process(port) {
     if (is_udp) {
         if (show_listening == "true" && foreign != "*.*") next
         ss_state = "UNCONN"
-        dedup_key = proto ":" local_port
     }
     # TCP handling
     else {
@@ -338,13 +344,8 @@ function get_process(port) {
         }
         
         ss_state = map_state(state)
-        dedup_key = proto ":" local_port ":" ss_state
     }
     
-    # Deduplication
-    if (dedup_key in seen) next
-    seen[dedup_key] = 1
-    
     # Convert addresses
     local_addr = convert_addr(local, proto)
     foreign_addr = convert_addr(foreign, proto)
@@ -352,9 +353,14 @@ function get_process(port) {
     # Netid
     netid = is_udp ? "udp" : "tcp"
     
+    # Deduplication (one row per connection)
+    dedup_key = netid " " local_addr " " foreign_addr " " ss_state
+    if (dedup_key in seen) next
+    seen[dedup_key] = 1
+    
     # Output
     if (show_process == "true") {
-        proc_info = get_process(local_port)
+        proc_info = get_process(netid, local_addr, foreign_addr)
         printf "%-7s %-8s %8s %8s %40s %20s %s\n", netid, ss_state, recvq, sendq, local_addr, foreign_addr, proc_info
     } else {
         printf "%-6s %-12s %8s %8s %-40s %-40s\n", netid, ss_state, recvq, sendq, local_addr, foreign_addr
@@ -0,0 +1,353 @@
+/*
+ * ss - Socket Statistics for Apple platforms (macOS/iOS)
+ * socket_fdinfo layout test: replays corpus files through the calibration
+ *
+ * Each corpus file (tests/fdinfo, in the format ss_proc -d prints) holds
+ * the probe blobs of one OS build, the offsets calibration must find
+ * ("expect"), and further socket blobs ("sock") whose fields must parse
+ * back to the recorded values. A sock record with no fields beyond the
+ * family is a non-IP socket that must be rejected. Every record is also
+ * read into the libproc_compat.h struct the way ss-ios reads it, buffer
+ * limits and MSS included where recorded, and one of the recorded layouts
+ * must be the one that header declares.
+ *
+ * Usage: test_fdinfo corpus.txt...
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+#include "../src/libproc_compat.h"
+#include "../src/fdinfo_layout.h"
+
+#define MAX_RECORDS 64
+#define MAX_BLOB 4096
+
+typedef struct {
+    bool probe;
+    bool has_fields;        /* IP socket with known fields */
+    fdinfo_sock_t sock;
+    int rcvbuf, sndbuf, mss;    /* FDINFO_NONE if not recorded */
+    uint8_t blob[MAX_BLOB];
+    int len;
+} record_t;
+
+static int failures;
+static int compat_matches;
+
+__attribute__((format(printf, 2, 3)))
+static void fail(const char *file, const char *fmt, ...)
+{
+    va_list ap;
+
+    fprintf(stderr, "%s: ", file);
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    fputc('\n', stderr);
+    failures++;
+}
+
+static bool parse_hex(const char *s, record_t *r)
+{
+    size_t n = strcspn(s, " \n");
+    if (n % 2 || n / 2 > MAX_BLOB) {
+        return false;
+    }
+    for (size_t i = 0; i < n / 2; i++) {
+        unsigned v;
+        if (sscanf(s + 2 * i, "%2x", &v) != 1) {
+            return false;
+        }
+        r->blob[i] = (uint8_t)v;
+    }
+    r->len = (int)(n / 2);
+    return true;
+}
+
+/* "probe|sock key=value ... blob=HEX" */
+static bool parse_record(char *line, record_t *r)
+{
+    memset(r, 0, sizeof(*r));
+    r->probe = strncmp(line, "probe ", 6) == 0;
+    r->sock.tcp_state = FDINFO_NONE;
+    r->rcvbuf = r->sndbuf = r->mss = FDINFO_NONE;
+
+    for (char *tok = strtok(line, " \n"); tok; tok = strtok(NULL, " \n")) {
+        char *eq = strchr(tok, '=');
+        if (!eq) {
+            continue;
+        }
+        *eq = '\0';
+        const char *key = tok, *val = eq + 1;
+        int af = (r->sock.family == FDINFO_AF_INET6) ? AF_INET6 : AF_INET;
+
+        if (strcmp(key, "family") == 0) {
+            r->sock.family = atoi(val);
+        } else if (strcmp(key, "protocol") == 0) {
+            r->sock.protocol = atoi(val);
+            r->has_fields = true;
+        } else if (strcmp(key, "lport") == 0) {
+            r->sock.lport = (uint16_t)atoi(val);
+        } else if (strcmp(key, "fport") == 0) {
+            r->sock.fport = (uint16_t)atoi(val);
+        } else if (strcmp(key, "laddr") == 0) {
+            if (inet_pton(af, val, r->sock.laddr) != 1) return false;
+        } else if (strcmp(key, "faddr") == 0) {
+            if (inet_pton(af, val, r->sock.faddr) != 1) return false;
+        } else if (strcmp(key, "state") == 0) {
+            r->sock.tcp_state = atoi(val);
+        } else if (strcmp(key, "rcvbuf") == 0) {
+            r->rcvbuf = atoi(val);
+        } else if (strcmp(key, "sndbuf") == 0) {
+            r->sndbuf = atoi(val);
+        } else if (strcmp(key, "mss") == 0) {
+            r->mss = atoi(val);
+        } else if (strcmp(key, "blob") == 0) {
+            if (!parse_hex(val, r)) return false;
+        }
+    }
+    return r->len > 0;
+}
+
+/* "expect size=N family=N ..." in the order of fdinfo_layout_t */
+static bool parse_expect(const char *line, fdinfo_layout_t *l)
+{
+    return sscanf(line, "expect size=%d family=%d protocol=%d lport=%d fport=%d "
+                  "laddr4=%d faddr4=%d laddr6=%d faddr6=%d tcp_state=%d",
+                  &l->size, &l->family, &l->protocol, &l->lport, &l->fport,
+                  &l->laddr4, &l->faddr4, &l->laddr6, &l->faddr6, &l->tcp_state) == 10;
+}
+
+static void check_layout(const char *file, const fdinfo_layout_t *got,
+                         const fdinfo_layout_t *want)
+{
+    static const char *names[] = {
+        "size", "family", "protocol", "lport", "fport",
+        "laddr4", "faddr4", "laddr6", "faddr6", "tcp_state"
+    };
+    const int *g = &got->size, *w = &want->size;
+
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (g[i] != w[i]) {
+            fail(file, "%s at %d, expected %d", names[i], g[i], w[i]);
+        }
+    }
+}
+
+static void check_sock(const char *file, const fdinfo_layout_t *layout, const record_t *r)
+{
+    fdinfo_sock_t got;
+    bool ok = fdinfo_parse(layout, r->blob, r->len, &got);
+    const fdinfo_sock_t *want = &r->sock;
+
+    if (!r->has_fields) {
+        if (ok) {
+            fail(file, "socket of family %d parsed as IP", want->family);
+        }
+        return;
+    }
+    if (!ok) {
+        fail(file, "socket on port %u not parsed", want->lport);
+        return;
+    }
+
+    size_t alen = (want->family == FDINFO_AF_INET6) ? 16 : 4;
+    if (got.family != want->family || got.protocol != want->protocol ||
+        got.lport != want->lport || got.fport != want->fport ||
+        got.tcp_state != want->tcp_state ||
+        memcmp(got.laddr, want->laddr, alen) != 0 ||
+        memcmp(got.faddr, want->faddr, alen) != 0) {
+        fail(file, "socket on port %u parsed as family %d, protocol %d, ports %u/%u, state %d",
+             want->lport, got.family, got.protocol, got.lport, got.fport, got.tcp_state);
+    }
+}
+
+/* What ss-ios sees of a record: the blob read into struct socket_fdinfo */
+static void check_compat(const char *file, const fdinfo_layout_t *layout, const record_t *r)
+{
+    struct socket_fdinfo si;
+    const fdinfo_sock_t *want = &r->sock;
+
+    if (!fdinfo_read_socket(layout, r->blob, r->len, &si)) {
+        fail(file, "compat: socket of family %d not read", want->family);
+        return;
+    }
+    if (si.psi.soi_family != want->family) {
+        fail(file, "compat: family %d read as %d", want->family, si.psi.soi_family);
+        return;
+    }
+    if (!r->has_fields) {
+        return;
+    }
+
+    const struct in_sockinfo *in = &si.psi.soi_proto.pri_in;
+    const void *laddr = &INSI_ADDR6(in->insi_laddr), *faddr = &INSI_ADDR6(in->insi_faddr);
+    size_t alen = 16;
+    if (want->family == FDINFO_AF_INET) {
+        laddr = &in->insi_laddr.ina_46.i46a_addr4;
+        faddr = &in->insi_faddr.ina_46.i46a_addr4;
+        alen = 4;
+    }
+    int state = (want->protocol == IPPROTO_TCP) ? si.psi.soi_proto.pri_tcp.tcpsi_state
+                                                : FDINFO_NONE;
+    if (si.psi.soi_protocol != want->protocol ||
+        ntohs((uint16_t)in->insi_lport) != want->lport ||
+        ntohs((uint16_t)in->insi_fport) != want->fport || state != want->tcp_state ||
+        memcmp(laddr, want->laddr, alen) != 0 || memcmp(faddr, want->faddr, alen) != 0) {
+        fail(file, "compat: socket on port %u read as protocol %d, ports %u/%u, state %d",
+             want->lport, si.psi.soi_protocol, ntohs((uint16_t)in->insi_lport),
+             ntohs((uint16_t)in->insi_fport), state);
+    }
+
+    /* Internals for -i / -o, where recorded */
+    int rcvbuf = (int)si.psi.soi_rcv.sbi_hiwat, sndbuf = (int)si.psi.soi_snd.sbi_hiwat;
+    int mss = (want->protocol == IPPROTO_TCP) ? si.psi.soi_proto.pri_tcp.tcpsi_mss
+                                              : FDINFO_NONE;
+    if ((r->rcvbuf != FDINFO_NONE && rcvbuf != r->rcvbuf) ||
+        (r->sndbuf != FDINFO_NONE && sndbuf != r->sndbuf) ||
+        (r->mss != FDINFO_NONE && mss != r->mss)) {
+        fail(file, "compat: socket on port %u read as rcvbuf %d, sndbuf %d, mss %d",
+             want->lport, rcvbuf, sndbuf, mss);
+    }
+}
+
+/* Whether a recorded layout is the one libproc_compat.h declares */
+static bool is_compat_layout(const fdinfo_layout_t *l)
+{
+    fdinfo_layout_t compat = {
+        .size      = (int)sizeof(struct socket_fdinfo),
+        .family    = (int)offsetof(struct socket_fdinfo, psi.soi_family),
+        .protocol  = (int)offsetof(struct socket_fdinfo, psi.soi_protocol),
+        .lport     = (int)offsetof(struct socket_fdinfo, psi.soi_proto.pri_in.insi_lport),
+        .fport     = (int)offsetof(struct socket_fdinfo, psi.soi_proto.pri_in.insi_fport),
+        .laddr4    = (int)offsetof(struct socket_fdinfo,
+                                   psi.soi_proto.pri_in.insi_laddr.ina_46.i46a_addr4),
+        .faddr4    = (int)offsetof(struct socket_fdinfo,
+                                   psi.soi_proto.pri_in.insi_faddr.ina_46.i46a_addr4),
+        .laddr6    = (int)offsetof(struct socket_fdinfo, psi.soi_proto.pri_in.insi_laddr),
+        .faddr6    = (int)offsetof(struct socket_fdinfo, psi.soi_proto.pri_in.insi_faddr),
+        .tcp_state = (int)offsetof(struct socket_fdinfo, psi.soi_proto.pri_tcp.tcpsi_state),
+    };
+    return memcmp(&compat, l, sizeof(compat)) == 0;
+}
+
+/* The calibrated layout must survive the cache, and only for its OS build */
+static void check_cache(const char *file, const fdinfo_layout_t *layout)
+{
+    char path[] = "/tmp/fdinfo_layoutXXXXXX";
+    int fd = mkstemp(path);
+    fdinfo_layout_t loaded;
+
+    if (fd < 0) {
+        perror("mkstemp");
+        failures++;
+        return;
+    }
+    close(fd);
+    if (!fdinfo_layout_save(layout, path, "17H35")) {
+        fail(file, "cache: save failed");
+    } else if (!fdinfo_layout_load(&loaded, path, "17H35") ||
+               memcmp(&loaded, layout, sizeof(loaded)) != 0) {
+        fail(file, "cache: saved layout does not load back");
+    } else if (fdinfo_layout_load(&loaded, path, "18A373")) {
+        fail(file, "cache: layout loaded for another OS build");
+    } else {
+        /* A cache others could have written, or a link to one, is ignored */
+        char link[sizeof(path) + 5];
+        snprintf(link, sizeof(link), "%s.link", path);
+        if (symlink(path, link) == 0) {
+            if (fdinfo_layout_load(&loaded, link, "17H35")) {
+                fail(file, "cache: layout loaded through a symlink");
+            }
+            remove(link);
+        }
+        chmod(path, 0666);
+        if (fdinfo_layout_load(&loaded, path, "17H35")) {
+            fail(file, "cache: world-writable layout loaded");
+        }
+    }
+    remove(path);
+}
+
+static void run_corpus(const char *file)
+{
+    static record_t records[MAX_RECORDS];
+    fdinfo_probe_t probes[MAX_RECORDS];
+    fdinfo_layout_t want, got;
+    int num_records = 0, num_probes = 0;
+    bool have_expect = false;
+    int before = failures;
+
+    FILE *fp = fopen(file, "r");
+    if (!fp) {
+        perror(file);
+        failures++;
+        return;
+    }
+    char *line = NULL;
+    size_t cap = 0;
+    while (getline(&line, &cap, fp) != -1) {
+        if (strncmp(line, "expect ", 7) == 0) {
+            have_expect = parse_expect(line, &want);
+        } else if ((strncmp(line, "probe ", 6) == 0 || strncmp(line, "sock ", 5) == 0) &&
+                   num_records < MAX_RECORDS) {
+            record_t *r = &records[num_records];
+            if (!parse_record(line, r)) {
+                fail(file, "record %d is malformed", num_records + 1);
+                continue;
+            }
+            if (r->probe) {
+                probes[num_probes].blob = r->blob;
+                probes[num_probes].len = r->len;
+                probes[num_probes].sock = r->sock;
+                num_probes++;
+            }
+            num_records++;
+        }
+    }
+    free(line);
+    fclose(fp);
+
+    char err[128];
+    if (!fdinfo_calibrate(probes, num_probes, &got, err, sizeof(err))) {
+        fprintf(stderr, "%s: calibration failed: %s\n", file, err);
+        failures++;
+        return;
+    }
+    if (have_expect) {
+        check_layout(file, &got, &want);
+        if (is_compat_layout(&want)) {
+            compat_matches++;
+        }
+    }
+    for (int i = 0; i < num_records; i++) {
+        check_sock(file, &got, &records[i]);
+        check_compat(file, &got, &records[i]);
+    }
+    check_cache(file, &got);
+
+    printf("%s: %s (%d probes, %d records)\n", file,
+           failures == before ? "ok" : "FAILED", num_probes, num_records);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s corpus.txt...\n", argv[0]);
+        return 2;
+    }
+    for (int i = 1; i < argc; i++) {
+        run_corpus(argv[i]);
+    }
+    if (compat_matches == 0) {
+        fprintf(stderr, "libproc_compat.h: socket_fdinfo matches no recorded layout\n");
+        failures++;
+    }
+    return failures ? 1 : 0;
+}